@@ -23,6 +23,7 @@
 #include "exec/exec-all.h"
 #include "exec/page-protection.h"
 #include "system/memory.h"
+#include "system/address-spaces.h"
 #include "accel/tcg/cpu-ldst.h"
 #include "exec/cputlb.h"
 #include "exec/tb-flush.h"
@@ -161,6 +162,109 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
     }
 }
 
+static inline size_t tlb_l2_n_entries(CPUTLBDesc *desc)
+{
+    return (desc->l2_mask + 1) * CPU_L2TLB_WAYS;
+}
+
+/* Return the index of the first way of the l2 tlb set for @page. */
+static inline size_t tlb_l2_set(CPUTLBDesc *desc, vaddr page)
+{
+    return ((page >> TARGET_PAGE_BITS) & desc->l2_mask) * CPU_L2TLB_WAYS;
+}
+
+static void tlb_l2_flush(CPUTLBDesc *desc)
+{
+    if (desc->l2_page) {
+        memset(desc->l2_page, -1, tlb_l2_n_entries(desc) * sizeof(vaddr));
+    }
+}
+
+/*
+ * Size the l2 tlb for a main tlb of @n_entries.  The l2 tlb only
+ * caches page table walks, so if the allocation fails just do without.
+ * The caller is responsible for flushing it.
+ */
+static void tlb_l2_resize(CPUTLBDesc *desc, size_t n_entries)
+{
+    size_t n_sets = MIN(n_entries, 1 << CPU_L2TLB_MAX_SET_BITS);
+
+    if (desc->l2_page && desc->l2_mask + 1 == n_sets) {
+        return;
+    }
+    g_free(desc->l2_page);
+    g_free(desc->l2_full);
+    desc->l2_mask = n_sets - 1;
+    desc->l2_page = g_try_new(vaddr, n_sets * CPU_L2TLB_WAYS);
+    desc->l2_full = g_try_new(CPUTLBEntryFull, n_sets * CPU_L2TLB_WAYS);
+    if (desc->l2_page == NULL || desc->l2_full == NULL) {
+        g_free(desc->l2_page);
+        g_free(desc->l2_full);
+        desc->l2_page = NULL;
+        desc->l2_full = NULL;
+    }
+}
+
+/*
+ * Record the result of a page table walk for @page in the l2 tlb,
+ * as the most recently used entry of its set.
+ */
+static void tlb_l2_insert(CPUTLBDesc *desc, vaddr page,
+                          const CPUTLBEntryFull *full)
+{
+    size_t base, way;
+
+    if (!desc->l2_page) {
+        return;
+    }
+    base = tlb_l2_set(desc, page);
+    for (way = 0; way < CPU_L2TLB_WAYS - 1; way++) {
+        if (desc->l2_page[base + way] == page) {
+            break;
+        }
+    }
+    /* Drop either the old entry for @page or the least recently used. */
+    memmove(&desc->l2_page[base + 1], &desc->l2_page[base],
+            way * sizeof(vaddr));
+    memmove(&desc->l2_full[base + 1], &desc->l2_full[base],
+            way * sizeof(CPUTLBEntryFull));
+
+    /*
+     * Pages that must be filled again on every access are not cached.
+     * Still drop any entry for @page above, and leave way 0 unused.
+     */
+    if (full->lg_page_size < TARGET_PAGE_BITS ||
+        (full->prot & PAGE_WRITE_INV)) {
+        desc->l2_page[base] = -1;
+        return;
+    }
+    desc->l2_page[base] = page;
+    desc->l2_full[base] = *full;
+}
+
+/* Drop the l2 tlb entries matching @page under @mask. */
+static void tlb_l2_flush_page_mask(CPUTLBDesc *desc, vaddr page, vaddr mask)
+{
+    size_t base, way;
+
+    if (!desc->l2_page) {
+        return;
+    }
+    /*
+     * The set is selected by page number bits that @mask must cover,
+     * see tlb_flush_range_locked.
+     */
+    base = tlb_l2_set(desc, page);
+    mask &= TARGET_PAGE_MASK;
+    for (way = 0; way < CPU_L2TLB_WAYS; way++) {
+        vaddr tag = desc->l2_page[base + way];
+
+        if (tag != (vaddr)-1 && ((tag ^ page) & mask) == 0) {
+            desc->l2_page[base + way] = -1;
+        }
+    }
+}
+
 /**
  * tlb_mmu_resize_locked() - perform TLB resize bookkeeping; resize if necessary
  * @desc: The CPUTLBDesc portion of the TLB
@@ -274,16 +378,32 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
         fast->table = g_try_new(CPUTLBEntry, new_size);
         desc->fulltlb = g_try_new(CPUTLBEntryFull, new_size);
     }
+
+    tlb_l2_resize(desc, new_size);
+}
+
+static void tlb_large_pages_clear(CPUTLBDesc *desc)
+{
+    IntervalTreeNode *node;
+
+    while ((node = interval_tree_iter_first(&desc->large_pages,
+                                            0, UINT64_MAX))) {
+        interval_tree_remove(node, &desc->large_pages);
+        g_free(node);
+    }
+    desc->n_large_pages = 0;
 }
 
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
+    tlb_large_pages_clear(desc);
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
+    tlb_l2_flush(desc);
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -305,6 +425,11 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->fulltlb = g_new(CPUTLBEntryFull, n_entries);
+    desc->l2_page = NULL;
+    desc->l2_full = NULL;
+    tlb_l2_resize(desc, n_entries);
+    desc->large_pages = (IntervalTreeRoot){ };
+    desc->n_large_pages = 0;
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -318,6 +443,19 @@ static inline void tlb_n_used_entries_dec(CPUState *cpu, uintptr_t mmu_idx)
     cpu->neg.tlb.d[mmu_idx].n_used_entries--;
 }
 
+/*
+ * TCG dirty ring
+ *
+ * While dirty memory is tracked, writable RAM always enters the TLB
+ * with TLB_NOTDIRTY.  The first write of a vCPU to such a page records
+ * it in the vCPU's ring, and the TLB entry is made writable.  Reaping
+ * the rings marks their pages dirty for migration and write protects
+ * exactly those TLB entries again, so that clearing the migration
+ * bitmap does not have to walk the TLBs of all vCPUs for all of RAM.
+ */
+static uint32_t tlb_dirty_ring_size;
+static bool tlb_dirty_ring_active;
+
 void tlb_init(CPUState *cpu)
 {
     int64_t now = get_clock_realtime();
@@ -328,6 +466,12 @@ void tlb_init(CPUState *cpu)
     /* All tlbs are initialized flushed. */
     cpu->neg.tlb.c.dirty = 0;
 
+    if (tlb_dirty_ring_size) {
+        cpu->neg.tlb.c.dirty_ring = g_new(CPUTLBDirtyRingEntry,
+                                          tlb_dirty_ring_size);
+        cpu->neg.tlb.c.dirty_ring_count = 0;
+    }
+
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&cpu->neg.tlb.d[i], &cpu->neg.tlb.f[i], now);
     }
@@ -338,12 +482,17 @@ void tlb_destroy(CPUState *cpu)
     int i;
 
     qemu_spin_destroy(&cpu->neg.tlb.c.lock);
+    g_free(cpu->neg.tlb.c.dirty_ring);
+    cpu->neg.tlb.c.dirty_ring = NULL;
     for (i = 0; i < NB_MMU_MODES; i++) {
         CPUTLBDesc *desc = &cpu->neg.tlb.d[i];
         CPUTLBDescFast *fast = &cpu->neg.tlb.f[i];
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        g_free(desc->l2_page);
+        g_free(desc->l2_full);
+        tlb_large_pages_clear(desc);
     }
 }
 
@@ -499,6 +648,121 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/* Return true if any comparator of @te is within [@start, @last]. */
+static bool tlb_entry_in_range(const CPUTLBEntry *te, vaddr start, vaddr last)
+{
+    for (int i = 0; i < MMU_ACCESS_COUNT; i++) {
+        /* Comparators are host-word sized, as in tlb_entry_is_empty() */
+        uintptr_t cmp = tlb_read_idx(te, i);
+
+        if (cmp != -1) {
+            cmp &= TARGET_PAGE_MASK;
+            if (cmp >= start && cmp <= last) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Flush all entries for pages within [@addr, @addr + @len - 1].
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_range_entries_locked(CPUState *cpu, int midx,
+                                           vaddr addr, vaddr len)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    size_t n_entries = tlb_n_entries(f);
+    vaddr last = addr + len - 1;
+    size_t i;
+
+    if (len / TARGET_PAGE_SIZE <= n_entries) {
+        for (vaddr ofs = 0; ofs < len; ofs += TARGET_PAGE_SIZE) {
+            vaddr page = addr + ofs;
+
+            if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+            tlb_flush_vtlb_page_locked(cpu, midx, page);
+            tlb_l2_flush_page_mask(d, page, -1);
+        }
+        return;
+    }
+
+    /* There are more pages in the range than entries, test each entry. */
+    for (i = 0; i < n_entries; i++) {
+        CPUTLBEntry *te = &f->table[i];
+
+        if (tlb_entry_in_range(te, addr, last)) {
+            memset(te, -1, sizeof(*te));
+            tlb_n_used_entries_dec(cpu, midx);
+        }
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        if (tlb_entry_in_range(&d->vtable[i], addr, last)) {
+            memset(&d->vtable[i], -1, sizeof(d->vtable[i]));
+        }
+    }
+    if (d->l2_page) {
+        for (i = 0; i < tlb_l2_n_entries(d); i++) {
+            if (d->l2_page[i] != (vaddr)-1 &&
+                d->l2_page[i] >= addr && d->l2_page[i] <= last) {
+                d->l2_page[i] = -1;
+            }
+        }
+    }
+}
+
+/*
+ * Flush the large pages overlapping [@addr, @addr + @len - 1] under
+ * @mask, and all entries within them.  Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_pages_locked(CPUState *cpu, int midx,
+                                         vaddr addr, vaddr len, vaddr mask)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    IntervalTreeNode *hits[CPU_TLB_LARGE_PAGES];
+    IntervalTreeNode *node;
+    uint64_t start = addr, last = addr + len - 1;
+    size_t i, n = 0;
+
+    if (interval_tree_is_empty(&d->large_pages)) {
+        return;
+    }
+
+    /*
+     * Pages that only match under @mask may be anywhere in the tree,
+     * so test all of them.  Large pages are aligned to their size,
+     * so they do not wrap around under @mask.
+     */
+    if (mask != (vaddr)-1) {
+        start = 0;
+        last = UINT64_MAX;
+    }
+    for (node = interval_tree_iter_first(&d->large_pages, start, last);
+         node; node = interval_tree_iter_next(node, start, last)) {
+        if (mask == (vaddr)-1 ||
+            ((node->start & mask) <= ((addr + len - 1) & mask) &&
+             (addr & mask) <= (node->last & mask))) {
+            hits[n++] = node;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        node = hits[i];
+        tlb_debug("flushing large page midx %d (%016" VADDR_PRIx
+                  "-%016" VADDR_PRIx ")\n",
+                  midx, (vaddr)node->start, (vaddr)node->last);
+        interval_tree_remove(node, &d->large_pages);
+        d->n_large_pages--;
+        tlb_flush_range_entries_locked(cpu, midx, node->start,
+                                       node->last - node->start + 1);
+        g_free(node);
+    }
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
@@ -515,6 +779,8 @@ static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
             tlb_n_used_entries_dec(cpu, midx);
         }
         tlb_flush_vtlb_page_locked(cpu, midx, page);
+        tlb_l2_flush_page_mask(&cpu->neg.tlb.d[midx], page, -1);
+        tlb_flush_large_pages_locked(cpu, midx, page, TARGET_PAGE_SIZE, -1);
     }
 }
 
@@ -699,6 +965,14 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         return;
     }
 
+    /*
+     * Likewise, if @mask does not cover the bits selecting the l2 tlb
+     * set, matching entries may be in any set.
+     */
+    if (~mask & (((vaddr)d->l2_mask << TARGET_PAGE_BITS) | ~TARGET_PAGE_MASK)) {
+        tlb_l2_flush(d);
+    }
+
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
         vaddr page = addr + i;
         CPUTLBEntry *entry = tlb_entry(cpu, midx, page);
@@ -707,7 +981,9 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
             tlb_n_used_entries_dec(cpu, midx);
         }
         tlb_flush_vtlb_page_mask_locked(cpu, midx, page, mask);
+        tlb_l2_flush_page_mask(d, page, mask);
     }
+    tlb_flush_large_pages_locked(cpu, midx, addr, len, mask);
 }
 
 typedef struct {
@@ -947,16 +1223,11 @@ static inline void tlb_set_dirty1_locked(CPUTLBEntry *tlb_entry,
     }
 }
 
-/* update the TLB corresponding to virtual page vaddr
-   so that it is no longer dirty */
-static void tlb_set_dirty(CPUState *cpu, vaddr addr)
+/* Called with tlb_c.lock held */
+static void tlb_set_dirty_locked(CPUState *cpu, vaddr addr)
 {
     int mmu_idx;
 
-    assert_cpu_is_self(cpu);
-
-    addr &= TARGET_PAGE_MASK;
-    qemu_spin_lock(&cpu->neg.tlb.c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         tlb_set_dirty1_locked(tlb_entry(cpu, mmu_idx, addr), addr);
     }
@@ -967,16 +1238,195 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
             tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
         }
     }
+}
+
+/*
+ * update the TLB corresponding to virtual page vaddr
+ * so that it is no longer dirty
+ */
+static void tlb_set_dirty(CPUState *cpu, vaddr addr)
+{
+    assert_cpu_is_self(cpu);
+
+    addr &= TARGET_PAGE_MASK;
+    qemu_spin_lock(&cpu->neg.tlb.c.lock);
+    /*
+     * If the dirty ring was enabled since notdirty_write() checked, its
+     * TLB reset might already be done: keep the page write protected,
+     * so that the next write goes to the ring.
+     */
+    if (!tlb_dirty_ring_enabled()) {
+        tlb_set_dirty_locked(cpu, addr);
+    }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+bool tlb_dirty_ring_enabled(void)
+{
+    return qatomic_read(&tlb_dirty_ring_active);
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_dirty_ring_rearm1_locked(CPUTLBEntryFull *full,
+                                         CPUTLBEntry *ent,
+                                         const CPUTLBDirtyRingEntry *e)
+{
+    /* The entry may have been replaced since the page was recorded. */
+    if (ent->addr_write == e->addr &&
+        e->addr + full->xlat_section == e->ram_addr) {
+        qatomic_set(&ent->addr_write, e->addr | TLB_NOTDIRTY);
+    }
+}
+
+/*
+ * Called with tlb_c.lock held.  Like tlb_reset_dirty, this may be
+ * a cross vCPU call.
+ */
+static void tlb_dirty_ring_reap_locked(CPUState *cpu)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    uint32_t i;
+    int mmu_idx, k;
+
+    for (i = 0; i < c->dirty_ring_count; i++) {
+        const CPUTLBDirtyRingEntry *e = &c->dirty_ring[i];
+
+        cpu_physical_memory_set_dirty_range(e->ram_addr, TARGET_PAGE_SIZE,
+                                            1 << DIRTY_MEMORY_MIGRATION);
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+            uintptr_t index = tlb_index(cpu, mmu_idx, e->addr);
+
+            tlb_dirty_ring_rearm1_locked(&desc->fulltlb[index],
+                                         tlb_entry(cpu, mmu_idx, e->addr), e);
+            for (k = 0; k < CPU_VTLB_SIZE; k++) {
+                tlb_dirty_ring_rearm1_locked(&desc->vfulltlb[k],
+                                             &desc->vtable[k], e);
+            }
+        }
+    }
+    c->dirty_ring_count = 0;
+}
+
+static void tlb_dirty_ring_push(CPUState *cpu, vaddr addr,
+                                ram_addr_t ram_addr)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    CPUTLBDirtyRingEntry e = {
+        .addr = addr & TARGET_PAGE_MASK,
+        .ram_addr = ram_addr & TARGET_PAGE_MASK,
+    };
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&c->lock);
+    /* Pages holding code keep trapping, do not record them every time. */
+    if (c->dirty_ring_count == 0 ||
+        c->dirty_ring[c->dirty_ring_count - 1].addr != e.addr ||
+        c->dirty_ring[c->dirty_ring_count - 1].ram_addr != e.ram_addr) {
+        if (c->dirty_ring_count == tlb_dirty_ring_size) {
+            tlb_dirty_ring_reap_locked(cpu);
+        }
+        c->dirty_ring[c->dirty_ring_count++] = e;
+    }
+
+    /*
+     * Unprotect the page under the same lock, so that a concurrent reap
+     * either sees the entry or write protects the page again after us.
+     * As in notdirty_write, only do so if the code has been flushed.
+     */
+    if (cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+        tlb_set_dirty_locked(cpu, e.addr);
+    }
+    qemu_spin_unlock(&c->lock);
+}
+
+static void tlb_dirty_ring_reap(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        qemu_spin_lock(&cpu->neg.tlb.c.lock);
+        tlb_dirty_ring_reap_locked(cpu);
+        qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+    }
+}
+
+static bool tlb_dirty_ring_log_global_start(MemoryListener *listener,
+                                            Error **errp)
+{
+    CPUState *cpu;
+
+    qatomic_set(&tlb_dirty_ring_active, true);
+
+    /*
+     * Write protect the pages that were made writable before.  This
+     * takes the TLB lock of each vCPU, under which tlb_set_page_full()
+     * checks whether the dirty ring is enabled.
+     */
+    CPU_FOREACH(cpu) {
+        tlb_reset_dirty(cpu, 0, UINTPTR_MAX);
+    }
+    return true;
+}
+
+static void tlb_dirty_ring_log_global_stop(MemoryListener *listener)
+{
+    qatomic_set(&tlb_dirty_ring_active, false);
+    tlb_dirty_ring_reap();
+}
+
+static void tlb_dirty_ring_log_sync_global(MemoryListener *listener,
+                                           bool last_stage)
+{
+    tlb_dirty_ring_reap();
+}
+
+static MemoryListener tlb_dirty_ring_listener = {
+    .name = "tcg-dirty-ring",
+    .log_global_start = tlb_dirty_ring_log_global_start,
+    .log_global_stop = tlb_dirty_ring_log_global_stop,
+    .log_sync_global = tlb_dirty_ring_log_sync_global,
+};
+
+void tlb_dirty_ring_init(uint32_t size)
+{
+    assert(size);
+    tlb_dirty_ring_size = size;
+    memory_listener_register(&tlb_dirty_ring_listener, &address_space_memory);
+}
+
+/*
+ * Our TLB does not support large pages, so remember the large pages
+ * and flush all the entries within one of them if it is invalidated.
+ * Beyond CPU_TLB_LARGE_PAGES, remember the area covered by large pages
+ * and trigger a full TLB flush if these are invalidated.
+ */
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
                                vaddr addr, uint64_t size)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    vaddr lp_addr = desc->large_page_addr;
     vaddr lp_mask = ~(size - 1);
+    uint64_t start = addr & lp_mask;
+    uint64_t last = start + size - 1;
+    IntervalTreeNode *node;
+
+    for (node = interval_tree_iter_first(&desc->large_pages, start, last);
+         node; node = interval_tree_iter_next(node, start, last)) {
+        if (node->start <= start && node->last >= last) {
+            return;
+        }
+    }
+    if (desc->n_large_pages < CPU_TLB_LARGE_PAGES) {
+        node = g_new(IntervalTreeNode, 1);
+        node->start = start;
+        node->last = last;
+        interval_tree_insert(node, &desc->large_pages);
+        desc->n_large_pages++;
+        return;
+    }
 
     if (lp_addr == (vaddr)-1) {
         /* No previous large page.  */
@@ -1032,7 +1482,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     hwaddr iotlb, xlat, sz, paddr_page;
     vaddr addr_page;
     int asidx, wp_flags, prot;
-    bool is_ram, is_romd;
+    bool is_ram, is_romd, check_dirty_ring = false;
 
     assert_cpu_is_self(cpu);
 
@@ -1045,6 +1495,8 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     addr_page = addr & TARGET_PAGE_MASK;
     paddr_page = full->phys_addr & TARGET_PAGE_MASK;
 
+    tlb_l2_insert(desc, addr_page, full);
+
     prot = full->prot;
     asidx = cpu_asidx_from_attrs(cpu, full->attrs);
     section = address_space_translate_for_iotlb(cpu, asidx, paddr_page,
@@ -1085,6 +1537,9 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
                 write_flags |= TLB_DISCARD_WRITE;
             } else if (cpu_physical_memory_is_clean(iotlb)) {
                 write_flags |= TLB_NOTDIRTY;
+            } else {
+                /* See below, under the TLB lock. */
+                check_dirty_ring = true;
             }
         }
     } else {
@@ -1116,6 +1571,16 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      */
     qemu_spin_lock(&tlb->c.lock);
 
+    /*
+     * tlb_dirty_ring_log_global_start() enables the dirty ring before it
+     * write protects all TLBs under their lock.  Reading the flag under
+     * the lock too makes sure that an entry installed concurrently is
+     * either write protected there, or created with TLB_NOTDIRTY here.
+     */
+    if (check_dirty_ring && tlb_dirty_ring_enabled()) {
+        write_flags |= TLB_NOTDIRTY;
+    }
+
     /* Note that the tlb is no longer clean.  */
     tlb->c.dirty |= 1 << mmu_idx;
 
@@ -1300,8 +1765,50 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
     }
 }
 
-/* Return true if ADDR is present in the victim tlb, and has been copied
-   back to the main tlb.  */
+/*
+ * Return true if PAGE is present in the l2 tlb with the permissions
+ * required by ACCESS_TYPE, and has been installed in the main tlb.
+ * This skips the page table walk of tlb_fill, but not the rest of
+ * tlb_set_page_full.
+ */
+static bool l2_tlb_hit(CPUState *cpu, size_t mmu_idx,
+                       MMUAccessType access_type, vaddr page)
+{
+    static const uint8_t access_prot[MMU_ACCESS_COUNT] = {
+        [MMU_DATA_LOAD] = PAGE_READ,
+        [MMU_DATA_STORE] = PAGE_WRITE,
+        [MMU_INST_FETCH] = PAGE_EXEC,
+    };
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    size_t base, way;
+
+    if (!desc->l2_page) {
+        return false;
+    }
+    base = tlb_l2_set(desc, page);
+    for (way = 0; way < CPU_L2TLB_WAYS; way++) {
+        if (desc->l2_page[base + way] == page) {
+            /* tlb_set_page_full moves the entry to the front of its set. */
+            CPUTLBEntryFull full = desc->l2_full[base + way];
+
+            if (!(full.prot & access_prot[access_type])) {
+                break;
+            }
+            qatomic_set(&cpu->neg.tlb.c.l2_hit_count,
+                        cpu->neg.tlb.c.l2_hit_count + 1);
+            tlb_set_page_full(cpu, mmu_idx, page, &full);
+            return true;
+        }
+    }
+    qatomic_set(&cpu->neg.tlb.c.l2_miss_count,
+                cpu->neg.tlb.c.l2_miss_count + 1);
+    return false;
+}
+
+/*
+ * Return true if PAGE is present in the victim tlb or the l2 tlb,
+ * and has been copied back to the main tlb.
+ */
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
@@ -1329,7 +1836,7 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             return true;
         }
     }
-    return false;
+    return l2_tlb_hit(cpu, mmu_idx, access_type, page);
 }
 
 static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
@@ -1343,6 +1850,13 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
         tb_invalidate_phys_range_fast(ram_addr, size, retaddr);
     }
 
+    if (tlb_dirty_ring_enabled()) {
+        cpu_physical_memory_set_dirty_range(ram_addr, size,
+                                            1 << DIRTY_MEMORY_VGA);
+        tlb_dirty_ring_push(cpu, mem_vaddr, ram_addr);
+        return;
+    }
+
     /*
      * Set both VGA and migration bits for simplicity and to remove
      * the notdirty callback faster.
@@ -1987,6 +2501,15 @@ static uint64_t do_ld_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
+    /* Side effect free registers may be read from the device's shadow. */
+    if (size == 4 && !(addr & 3)) {
+        uint64_t val;
+
+        if (memory_region_read_shadow(mr, mr_offset, &val, MO_BEUL, attrs)) {
+            return (ret_be << 32) | val;
+        }
+    }
+
     BQL_LOCK_GUARD();
     return int_ld_mmio_beN(cpu, full, ret_be, addr, size, mmu_idx,
                            type, ra, mr, mr_offset);
@@ -17,6 +17,9 @@ extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
 
+/* user-mode only: translate successors of new TBs in the background */
+extern bool tb_pretranslate;
+
 extern bool icount_align_option;
 
 /*
@@ -65,6 +68,13 @@ void tlb_init(CPUState *cpu);
  * @cpu: CPU whose TLB should be destroyed
  */
 void tlb_destroy(CPUState *cpu);
+/**
+ * tlb_dirty_ring_init - record dirty pages in per-vCPU rings
+ * @size: number of entries in the ring of each vCPU
+ *
+ * Must be called before any vCPU is created.
+ */
+void tlb_dirty_ring_init(uint32_t size);
 
 bool tcg_exec_realizefn(CPUState *cpu, Error **errp);
 void tcg_exec_unrealizefn(CPUState *cpu);
@@ -43,4 +43,42 @@ void page_table_config_init(void);
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 #endif /* CONFIG_USER_ONLY */
 
+/*
+ * tb_htable_lookup:
+ *
+ * Look up a translation block in the QHT, bypassing @cpu's jump cache.
+ * Might cause an exception, so have a longjmp destination ready.
+ */
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags);
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * tb_gen_code_speculative:
+ *
+ * Like tb_gen_code(), but for the background worker, whose @cpu never
+ * executes guest code. Returns NULL instead of exiting the cpu loop if
+ * the code buffer is full.
+ * Called with mmap_lock held.
+ */
+TranslationBlock *tb_gen_code_speculative(CPUState *cpu, vaddr pc,
+                                          uint64_t cs_base, uint32_t flags,
+                                          int cflags);
+
+/*
+ * tb_pretranslate_successors:
+ *
+ * Queue the direct branch targets of @tb, which was just translated
+ * by @cpu, for translation by the background worker.
+ * Called with mmap_lock held.
+ */
+void tb_pretranslate_successors(CPUState *cpu, const TranslationBlock *tb);
+#else
+static inline void tb_pretranslate_successors(CPUState *cpu,
+                                              const TranslationBlock *tb)
+{
+}
+#endif /* CONFIG_USER_ONLY */
+
 #endif /* ACCEL_TCG_INTERNAL_H */
@@ -141,6 +141,19 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+static void tlb_l2_counts(size_t *phit, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t hit = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        hit += qatomic_read(&cpu->neg.tlb.c.l2_hit_count);
+        miss += qatomic_read(&cpu->neg.tlb.c.l2_miss_count);
+    }
+    *phit = hit;
+    *pmiss = miss;
+}
+
 static void tcg_dump_info(GString *buf)
 {
     g_string_append_printf(buf, "[TCG profiler not compiled]\n");
@@ -150,7 +163,7 @@ static void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, l2_hit, l2_miss;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -196,6 +209,10 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tlb_l2_counts(&l2_hit, &l2_miss);
+    g_string_append_printf(buf, "TLB L2 hits         %zu\n", l2_hit);
+    g_string_append_printf(buf, "TLB L2 misses       %zu\n", l2_miss);
     tcg_dump_info(buf);
 }
 
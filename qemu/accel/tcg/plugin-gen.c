@@ -218,6 +218,109 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
+static void gen_mem_buffer_append(struct qemu_plugin_mem_buffer_cb *cb,
+                                  qemu_plugin_meminfo_t meminfo,
+                                  TCGv_i64 addr)
+{
+    qemu_plugin_u64 entry = { .score = cb->buf->score };
+    TCGv_ptr ptr = gen_plugin_u64_ptr(entry);
+    TCGv_ptr rec = tcg_temp_ebb_new_ptr();
+    TCGv_i64 n = tcg_temp_ebb_new_i64();
+    TCGv_i64 offset = tcg_temp_ebb_new_i64();
+    size_t base = offsetof(struct qemu_plugin_mem_buffer_vcpu, records);
+
+    /* Room was made before the instruction, see gen_mem_buffer_drain. */
+    tcg_gen_ld_i64(n, ptr, offsetof(struct qemu_plugin_mem_buffer_vcpu, n));
+    tcg_gen_muli_i64(offset, n, sizeof(struct qemu_plugin_mem_record));
+    tcg_gen_trunc_i64_ptr(rec, offset);
+    tcg_gen_add_ptr(rec, rec, ptr);
+
+    tcg_gen_st_i64(addr, rec,
+                   base + offsetof(struct qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(cb->pc), rec,
+                   base + offsetof(struct qemu_plugin_mem_record, pc));
+    tcg_gen_st_i32(tcg_constant_i32(meminfo), rec,
+                   base + offsetof(struct qemu_plugin_mem_record, info));
+
+    tcg_gen_addi_i64(n, n, 1);
+    tcg_gen_st_i64(n, ptr, offsetof(struct qemu_plugin_mem_buffer_vcpu, n));
+
+    tcg_temp_free_i64(offset);
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(ptr);
+}
+
+/*
+ * Records are appended in the middle of the instruction, where we cannot
+ * branch. Instead, drain the buffer at the start of the instruction if
+ * there is no room left for @n_accesses records.
+ */
+static void gen_mem_buffer_drain(struct qemu_plugin_mem_buffer_cb *cb,
+                                 size_t n_accesses)
+{
+    qemu_plugin_u64 entry = { .score = cb->buf->score };
+    TCGv_ptr ptr = gen_plugin_u64_ptr(entry);
+    TCGv_i64 n = tcg_temp_ebb_new_i64();
+    TCGLabel *after_cb = gen_new_label();
+
+    g_assert(n_accesses <= cb->buf->capacity);
+
+    tcg_gen_ld_i64(n, ptr, offsetof(struct qemu_plugin_mem_buffer_vcpu, n));
+    tcg_gen_brcondi_i64(TCG_COND_LEU, n, cb->buf->capacity - n_accesses,
+                        after_cb);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(cb->f.vcpu_udata, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->buf)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(after_cb);
+
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(ptr);
+}
+
+static void inject_mem_buffer_drains(struct qemu_plugin_insn *insn,
+                                     TCGOp *from_insn_op)
+{
+    const GArray *cbs = insn->mem_cbs;
+    size_t n_buffers = 0, n_mem_ops = 0;
+    TCGOp *op;
+    int i;
+
+    for (i = 0; cbs && i < cbs->len; i++) {
+        if (g_array_index(cbs, struct qemu_plugin_dyn_cb, i).type ==
+            PLUGIN_CB_MEM_BUFFER) {
+            n_buffers++;
+        }
+    }
+    if (!n_buffers) {
+        return;
+    }
+
+    for (op = QTAILQ_NEXT(from_insn_op, link);
+         op && op->opc != INDEX_op_insn_start;
+         op = QTAILQ_NEXT(op, link)) {
+        if (op->opc == INDEX_op_plugin_mem_cb) {
+            n_mem_ops++;
+        }
+    }
+    if (!n_mem_ops) {
+        /* accesses from helpers are buffered at run-time */
+        return;
+    }
+
+    /* each buffer might be registered more than once for this insn */
+    for (i = 0; i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+
+        if (cb->type == PLUGIN_CB_MEM_BUFFER) {
+            gen_mem_buffer_drain(&cb->mem_buffer, n_mem_ops * n_buffers);
+        }
+    }
+}
+
 static void inject_cb(struct qemu_plugin_dyn_cb *cb)
 
 {
@@ -255,6 +358,11 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             inject_cb(cb);
         }
         break;
+    case PLUGIN_CB_MEM_BUFFER:
+        if (rw & cb->mem_buffer.rw) {
+            gen_mem_buffer_append(&cb->mem_buffer, meminfo, addr);
+        }
+        break;
     default:
         g_assert_not_reached();
     }
@@ -336,6 +444,8 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                     inject_cb(
                         &g_array_index(cbs, struct qemu_plugin_dyn_cb, i));
                 }
+
+                inject_mem_buffer_drains(insn, op);
                 break;
 
             default:
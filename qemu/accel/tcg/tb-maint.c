@@ -186,12 +186,49 @@ static int v_l2_levels;
 
 static void *l1_map[V_L1_MAX_SIZE];
 
+/* Translated code is tracked in 64 granules per page, 64 bytes for 4KiB. */
+#define PAGE_CODE_GRANULE_BITS  (TARGET_PAGE_BITS - 6)
+
 struct PageDesc {
     QemuSpin lock;
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
+    /*
+     * Granules of the page that may contain translated code, a superset
+     * of those covered by the TBs in first_tb.  Read without the lock
+     * by tb_invalidate_phys_range_fast().
+     */
+    uint64_t code_bitmap;
 };
 
+/* Return the granules covering the offsets [@start, @last] of a page. */
+static inline uint64_t page_code_mask(tb_page_addr_t start,
+                                      tb_page_addr_t last)
+{
+    unsigned first = (start & ~TARGET_PAGE_MASK) >> PAGE_CODE_GRANULE_BITS;
+    unsigned end = (last & ~TARGET_PAGE_MASK) >> PAGE_CODE_GRANULE_BITS;
+
+    return MAKE_64BIT_MASK(first, end - first + 1);
+}
+
+/* Return in [@pstart, @plast] the part of @tb within its page @n. */
+static void tb_page_range(const TranslationBlock *tb, unsigned int n,
+                          tb_page_addr_t *pstart, tb_page_addr_t *plast)
+{
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    tb_page_addr_t tb_start = tb_page_addr0(tb);
+    tb_page_addr_t tb_last = tb_start + tb->size - 1;
+
+    if (n == 0) {
+        tb_last = MIN(tb_last, tb_start | ~TARGET_PAGE_MASK);
+    } else {
+        tb_start = tb_page_addr1(tb);
+        tb_last = tb_start + (tb_last & ~TARGET_PAGE_MASK);
+    }
+    *pstart = tb_start;
+    *plast = tb_last;
+}
+
 void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -671,6 +708,7 @@ static void tb_remove_all_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
+            qatomic_set(&pd[i].code_bitmap, 0);
             page_unlock(&pd[i]);
         }
     } else {
@@ -698,6 +736,7 @@ static void tb_remove_all(void)
 static void tb_page_add(PageDesc *p, TranslationBlock *tb, unsigned int n)
 {
     bool page_already_protected;
+    tb_page_addr_t start, last;
 
     assert_page_locked(p);
 
@@ -705,6 +744,10 @@ static void tb_page_add(PageDesc *p, TranslationBlock *tb, unsigned int n)
     page_already_protected = p->first_tb != 0;
     p->first_tb = (uintptr_t)tb | n;
 
+    tb_page_range(tb, n, &start, &last);
+    qatomic_set(&p->code_bitmap,
+                p->code_bitmap | page_code_mask(start, last));
+
     /*
      * If some code is already present, then the pages are already
      * protected. So we handle the case where only the first TB is
@@ -1109,6 +1152,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 {
     TranslationBlock *tb;
     PageForEachNext n;
+    bool invalidated = false;
 #ifdef TARGET_HAS_PRECISE_SMC
     bool current_tb_modified = false;
     TranslationBlock *current_tb = retaddr ? tcg_tb_lookup(retaddr) : NULL;
@@ -1124,15 +1168,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
     PAGE_FOR_EACH_TB(start, last, p, tb, n) {
         tb_page_addr_t tb_start, tb_last;
 
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        tb_start = tb_page_addr0(tb);
-        tb_last = tb_start + tb->size - 1;
-        if (n == 0) {
-            tb_last = MIN(tb_last, tb_start | ~TARGET_PAGE_MASK);
-        } else {
-            tb_start = tb_page_addr1(tb);
-            tb_last = tb_start + (tb_last & ~TARGET_PAGE_MASK);
-        }
+        tb_page_range(tb, n, &tb_start, &tb_last);
         if (!(tb_last < start || tb_start > last)) {
 #ifdef TARGET_HAS_PRECISE_SMC
             if (current_tb == tb &&
@@ -1149,7 +1185,21 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
             }
 #endif /* TARGET_HAS_PRECISE_SMC */
             tb_phys_invalidate__locked(tb);
+            invalidated = true;
+        }
+    }
+
+    /* Drop the granules of the TBs that were removed. */
+    if (invalidated) {
+        uint64_t code_bitmap = 0;
+
+        PAGE_FOR_EACH_TB(start, last, p, tb, n) {
+            tb_page_addr_t tb_start, tb_last;
+
+            tb_page_range(tb, n, &tb_start, &tb_last);
+            code_bitmap |= page_code_mask(tb_start, tb_last);
         }
+        qatomic_set(&p->code_bitmap, code_bitmap);
     }
 
     /* if no code remaining, no need to continue to use slow writes */
@@ -1228,6 +1278,24 @@ void tb_invalidate_phys_range_fast(ram_addr_t ram_addr,
                                    uintptr_t retaddr)
 {
     struct page_collection *pages;
+    PageDesc *p = page_find(ram_addr >> TARGET_PAGE_BITS);
+    uint64_t code_bitmap;
+
+    if (!p) {
+        return;
+    }
+
+    /*
+     * Data next to code in the same page, such as literal pools, is
+     * written often.  Skip the page locks and the walk of its TBs unless
+     * the write touches a granule with translated code.  If there is no
+     * code left at all, go on so that the page stops using slow writes.
+     */
+    code_bitmap = qatomic_read(&p->code_bitmap);
+    if (code_bitmap &&
+        !(code_bitmap & page_code_mask(ram_addr, ram_addr + size - 1))) {
+        return;
+    }
 
     pages = page_collection_lock(ram_addr, ram_addr + size - 1);
     tb_invalidate_phys_page_fast__locked(pages, ram_addr, size, retaddr);
@@ -0,0 +1,235 @@
+/*
+ * Speculative translation of translation block successors
+ *
+ * When a vCPU translates a block, the targets of its direct branches are
+ * known. A worker thread translates them ahead of time, so that a vCPU
+ * running into new code usually finds the next block in the QHT instead
+ * of stalling in tb_gen_code().
+ *
+ * This is only implemented for user-mode emulation: guest code is read
+ * straight from host memory there, whereas in system mode fetching code
+ * goes through the softmmu TLB of the vCPU, which only its own thread
+ * may use.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/plugin.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "exec/exec-all.h"
+#include "exec/page-protection.h"
+#include "exec/tb-flush.h"
+#include "exec/translation-block.h"
+#include "user/page-protection.h"
+#include "accel/tcg/tb-pretranslate.h"
+#include "tcg/tcg.h"
+#include "internal-common.h"
+#include "internal-target.h"
+
+/* Requests beyond this are dropped, oldest first. */
+#define TB_PRETRANSLATE_QUEUE_SIZE 64
+
+typedef struct TBPretranslateReq {
+    vaddr pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBPretranslateReq;
+
+static struct {
+    /* @lock protects all fields but @cpu */
+    QemuMutex lock;
+    /* signals new requests */
+    QemuCond cond;
+    QemuThread thread;
+    bool started;
+    /* CPU the worker translates with, set before it starts */
+    CPUState *cpu;
+    TBPretranslateReq queue[TB_PRETRANSLATE_QUEUE_SIZE];
+    unsigned head;
+    unsigned count;
+} pt;
+
+bool tb_pretranslate;
+
+static void tb_pretranslate_one(CPUState *cpu, const TBPretranslateReq *req)
+{
+    vaddr next = (req->pc & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+
+    mmap_lock();
+    /*
+     * Fetching code from a page that is not executable raises a guest
+     * signal on the vCPU. Guest mappings cannot change under mmap_lock,
+     * so just give up unless the block cannot fault, even if it crosses
+     * into the next page.
+     */
+    if ((page_get_flags(req->pc) & PAGE_EXEC) &&
+        (page_get_flags(next) & PAGE_EXEC) &&
+        !tb_htable_lookup(cpu, req->pc, req->cs_base,
+                          req->flags, req->cflags)) {
+        tb_gen_code_speculative(cpu, req->pc, req->cs_base,
+                                req->flags, req->cflags);
+    }
+    mmap_unlock();
+}
+
+static void *tb_pretranslate_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock(&pt.lock);
+    for (;;) {
+        TBPretranslateReq req;
+
+        while (pt.count == 0) {
+            qemu_cond_wait(&pt.cond, &pt.lock);
+        }
+        req = pt.queue[pt.head];
+        pt.head = (pt.head + 1) % TB_PRETRANSLATE_QUEUE_SIZE;
+        pt.count--;
+        qemu_mutex_unlock(&pt.lock);
+
+        tb_pretranslate_one(pt.cpu, &req);
+
+        qemu_mutex_lock(&pt.lock);
+    }
+    return NULL;
+}
+
+/*
+ * The worker translates with a CPU of its own, so that it never reads
+ * the state of a running vCPU. Like cpu_copy() does for new guest
+ * threads, take its configuration from @cpu, which all vCPUs share.
+ * The rest of the state does not matter: a TB can be executed by any
+ * vCPU, so its code only depends on the configuration and on the pc,
+ * cs_base, flags and cflags in the request.
+ * Called from @cpu's thread.
+ */
+static CPUState *tb_pretranslate_cpu_new(CPUState *cpu)
+{
+    CPUState *new_cpu = cpu_create(object_get_typename(OBJECT(cpu)));
+
+    /* It never runs, keep it out of sight of the guest and gdbstub. */
+    cpu_list_remove(new_cpu);
+    cpu_reset(new_cpu);
+
+    new_cpu->tcg_cflags = cpu->tcg_cflags;
+    memcpy(cpu_env(new_cpu), cpu_env(cpu), sizeof(CPUArchState));
+    return new_cpu;
+}
+
+static void tb_pretranslate_push__locked(const TBPretranslateReq *req)
+{
+    unsigned tail;
+
+    if (pt.count == TB_PRETRANSLATE_QUEUE_SIZE) {
+        pt.head = (pt.head + 1) % TB_PRETRANSLATE_QUEUE_SIZE;
+        pt.count--;
+    }
+    tail = (pt.head + pt.count) % TB_PRETRANSLATE_QUEUE_SIZE;
+    pt.queue[tail] = *req;
+    pt.count++;
+}
+
+void tb_pretranslate_successors(CPUState *cpu, const TranslationBlock *tb)
+{
+    TBPretranslateReq req;
+    int i;
+
+    if (!tcg_ctx->record_tb_succ || tcg_ctx->nb_gen_tb_succ == 0) {
+        return;
+    }
+    /* Only regular blocks, not one-shot or single-stepped ones. */
+    if (tb_cflags(tb) != curr_cflags(cpu)) {
+        return;
+    }
+    /*
+     * The worker's CPU has no breakpoints. Stay out of the way while the
+     * guest is being debugged, see tb_pretranslate_flush().
+     */
+    if (!QTAILQ_EMPTY(&cpu->breakpoints)) {
+        return;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Plugins expect translation callbacks from the vCPU thread. */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return;
+    }
+#endif
+
+    /*
+     * Successors are assumed to run in the same CPU state as @tb. If
+     * they do not, the speculative TB is never looked up: it only wastes
+     * some space in the code buffer.
+     */
+    req.cs_base = tb->cs_base;
+    req.flags = tb->flags;
+    req.cflags = tb_cflags(tb);
+
+    qemu_mutex_lock(&pt.lock);
+    if (!pt.started) {
+        if (!pt.cpu) {
+            pt.cpu = tb_pretranslate_cpu_new(cpu);
+        }
+        qemu_thread_create(&pt.thread, "tb-pretranslate",
+                           tb_pretranslate_thread, NULL, QEMU_THREAD_DETACHED);
+        pt.started = true;
+    }
+    for (i = 0; i < tcg_ctx->nb_gen_tb_succ; i++) {
+        req.pc = tcg_ctx->gen_tb_succ[i];
+        tb_pretranslate_push__locked(&req);
+    }
+    qemu_cond_broadcast(&pt.cond);
+    qemu_mutex_unlock(&pt.lock);
+}
+
+/*
+ * Drop the pending requests and all speculative TBs, e.g. because a
+ * breakpoint was inserted. A TB that the worker is generating right now
+ * is flushed as well, since tb_flush() waits for mmap_lock.
+ */
+void tb_pretranslate_flush(CPUState *cpu)
+{
+    qemu_mutex_lock(&pt.lock);
+    pt.head = 0;
+    pt.count = 0;
+    qemu_mutex_unlock(&pt.lock);
+
+    tb_flush(cpu);
+}
+
+/*
+ * The worker only takes @pt.lock without holding mmap_lock, so this is
+ * called after mmap_fork_start().
+ */
+void tb_pretranslate_fork_start(void)
+{
+    qemu_mutex_lock(&pt.lock);
+}
+
+void tb_pretranslate_fork_end(bool child)
+{
+    if (child) {
+        /*
+         * The worker did not survive fork(), restart it on demand.
+         * Its CPU is still good to use.
+         */
+        qemu_mutex_init(&pt.lock);
+        qemu_cond_init(&pt.cond);
+        pt.started = false;
+        pt.head = 0;
+        pt.count = 0;
+    } else {
+        qemu_mutex_unlock(&pt.lock);
+    }
+}
+
+static void __attribute__((__constructor__)) tb_pretranslate_init(void)
+{
+    qemu_mutex_init(&pt.lock);
+    qemu_cond_init(&pt.cond);
+}
@@ -52,8 +52,10 @@ struct TCGState {
 
     OnOffAuto mttcg_enabled;
     bool one_insn_per_tb;
+    bool pretranslate;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t dirty_ring_size;
 };
 typedef struct TCGState TCGState;
 
@@ -134,6 +136,12 @@ static int tcg_init_machine(MachineState *ms)
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads);
 
+#ifndef CONFIG_USER_ONLY
+    if (s->dirty_ring_size) {
+        tlb_dirty_ring_init(s->dirty_ring_size);
+    }
+#endif
+
 #if defined(CONFIG_SOFTMMU)
     /*
      * There's no guest base to take into account, so go ahead and
@@ -197,6 +205,32 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+#ifndef CONFIG_USER_ONLY
+static void tcg_get_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->dirty_ring_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->dirty_ring_size = value;
+}
+#endif
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -223,6 +257,21 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+#ifdef CONFIG_USER_ONLY
+static bool tcg_get_pretranslate(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->pretranslate;
+}
+
+static void tcg_set_pretranslate(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->pretranslate = value;
+    qatomic_set(&tb_pretranslate, value);
+}
+#endif
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -258,6 +307,14 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add(oc, "dirty-ring-size", "uint32",
+        tcg_get_dirty_ring_size, tcg_set_dirty_ring_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-size",
+        "Size of the per-vCPU dirty page ring (0 to use the dirty bitmap)");
+#endif
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -268,6 +325,14 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+#ifdef CONFIG_USER_ONLY
+    object_class_property_add_bool(oc, "pretranslate",
+                                   tcg_get_pretranslate,
+                                   tcg_set_pretranslate);
+    object_class_property_set_description(oc, "pretranslate",
+        "Translate the successors of new blocks in a background thread");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -9,6 +9,15 @@
 #define CPU_TLB_DYN_MIN_BITS 6
 #define CPU_TLB_DYN_DEFAULT_BITS 8
 
+/*
+ * The second level tlb has as many sets as the main tlb has entries,
+ * but no more than 2**14 sets, i.e. 2**16 entries.
+ */
+#define CPU_L2TLB_MAX_SET_BITS 14
+
+/* Number of large pages per mmu_idx that are flushed individually. */
+#define CPU_TLB_LARGE_PAGES 64
+
 # if HOST_LONG_BITS == 32
 /* Make sure we do not require a double-word shift for the TLB load */
 #  define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
@@ -290,10 +290,16 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              vaddr pc, uint64_t cs_base,
-                              uint32_t flags, int cflags)
+/*
+ * Called with mmap_lock held for user mode emulation.
+ * A @speculative translation is not requested by @cpu itself: rather
+ * than exiting the cpu loop when the code buffer is full, or creating
+ * a one-shot TB, give up and return NULL.
+ */
+static TranslationBlock *tb_gen_code_common(CPUState *cpu,
+                                            vaddr pc, uint64_t cs_base,
+                                            uint32_t flags, int cflags,
+                                            bool speculative)
 {
     CPUArchState *env = cpu_env(cpu);
     TranslationBlock *tb, *existing_tb;
@@ -309,6 +315,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
 
     if (phys_pc == -1) {
+        if (speculative) {
+            return NULL;
+        }
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | 1;
     }
@@ -323,6 +332,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
+        if (speculative) {
+            /* leave the flush to the next vCPU translation */
+            return NULL;
+        }
         /* flush must be done */
         tb_flush(cpu);
         mmap_unlock();
@@ -357,6 +370,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
  restart_translate:
     trace_translate_block(tb, pc, tb->tc.ptr);
+#ifdef CONFIG_USER_ONLY
+    tcg_ctx->record_tb_succ = !speculative && qatomic_read(&tb_pretranslate);
+    tcg_ctx->nb_gen_tb_succ = 0;
+#endif
 
     gen_code_size = setjmp_gen_code(env, tb, pc, host_pc, &max_insns, &ti);
     if (unlikely(gen_code_size < 0)) {
@@ -572,9 +589,29 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tcg_tb_remove(tb);
         return existing_tb;
     }
+
+    if (!speculative) {
+        tb_pretranslate_successors(cpu, tb);
+    }
     return tb;
 }
 
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              vaddr pc, uint64_t cs_base,
+                              uint32_t flags, int cflags)
+{
+    return tb_gen_code_common(cpu, pc, cs_base, flags, cflags, false);
+}
+
+#ifdef CONFIG_USER_ONLY
+TranslationBlock *tb_gen_code_speculative(CPUState *cpu,
+                                          vaddr pc, uint64_t cs_base,
+                                          uint32_t flags, int cflags)
+{
+    return tb_gen_code_common(cpu, pc, cs_base, flags, cflags, true);
+}
+#endif
+
 /* user-mode: call with mmap_lock held */
 void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
 {
@@ -110,6 +110,12 @@ bool translator_is_same_page(const DisasContextBase *db, vaddr addr)
 
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
 {
+    /* Remember static successors, they may be translated speculatively. */
+    if (tcg_ctx->record_tb_succ &&
+        tcg_ctx->nb_gen_tb_succ < ARRAY_SIZE(tcg_ctx->gen_tb_succ)) {
+        tcg_ctx->gen_tb_succ[tcg_ctx->nb_gen_tb_succ++] = dest;
+    }
+
     /* Suppress goto_tb if requested. */
     if (tb_cflags(db->tb) & CF_NO_GOTO_TB) {
         return false;
@@ -41,7 +41,9 @@ typedef enum {
     COPY_READ_WRITE,
     COPY_WRITE_ZEROES,
     COPY_RANGE_SMALL,
-    COPY_RANGE_FULL
+    COPY_RANGE_FULL,
+    COPY_CLONE_SMALL,
+    COPY_CLONE_FULL
 } BlockCopyMethod;
 
 static coroutine_fn int block_copy_task_entry(AioTask *task);
@@ -170,9 +172,11 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
         return s->cluster_size;
     case COPY_READ_WRITE:
     case COPY_RANGE_SMALL:
+    case COPY_CLONE_SMALL:
         return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_BUFFER),
                    s->max_transfer);
     case COPY_RANGE_FULL:
+    case COPY_CLONE_FULL:
         return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_COPY_RANGE),
                    s->max_transfer);
     default:
@@ -303,9 +307,11 @@ void block_copy_set_copy_opts(BlockCopyState *s, bool use_copy_range,
     } else {
         /*
          * If copy range enabled, start with COPY_RANGE_SMALL, until first
-         * successful copy_range (look at block_copy_do_copy).
+         * successful copy_range (look at block_copy_do_copy).  Otherwise
+         * still try to share extents between source and target, which
+         * costs no I/O at all where it works.
          */
-        s->method = use_copy_range ? COPY_RANGE_SMALL : COPY_READ_WRITE;
+        s->method = use_copy_range ? COPY_RANGE_SMALL : COPY_CLONE_SMALL;
     }
 }
 
@@ -494,7 +500,8 @@ static coroutine_fn int block_copy_task_run(AioTaskPool *pool,
  * No sync here: neither bitmap nor intersecting requests handling, only copy.
  *
  * @method is an in-out argument, so that copy_range can be either extended to
- * a full-size buffer or disabled if the copy_range attempt fails.  The output
+ * a full-size buffer or disabled if the copy_range attempt fails.  Cloning is
+ * disabled the same way if it never succeeded.  The output
  * value of @method should be used for subsequent tasks.
  * Returns 0 on success.
  */
@@ -514,6 +521,25 @@ block_copy_do_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
            offset + bytes == QEMU_ALIGN_UP(s->len, s->cluster_size));
     assert(nbytes < INT_MAX);
 
+    if (*method == COPY_CLONE_SMALL || *method == COPY_CLONE_FULL) {
+        ret = bdrv_co_copy_range(s->source, offset, s->target, offset, nbytes,
+                                 0, s->write_flags | BDRV_REQ_NO_FALLBACK);
+        if (ret >= 0) {
+            *method = COPY_CLONE_FULL;
+            return 0;
+        }
+
+        trace_block_copy_clone_fail(s, offset, ret);
+        /*
+         * Once cloning worked, keep trying it and only copy this chunk
+         * through a buffer: extents may not be shareable for parts of the
+         * image, e.g. compressed clusters.
+         */
+        if (*method == COPY_CLONE_SMALL) {
+            *method = COPY_READ_WRITE;
+        }
+    }
+
     switch (*method) {
     case COPY_WRITE_ZEROES:
         ret = bdrv_co_pwrite_zeroes(s->target, offset, nbytes, s->write_flags &
@@ -540,6 +566,7 @@ block_copy_do_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
 
     case COPY_READ_WRITE_CLUSTER:
     case COPY_READ_WRITE:
+    case COPY_CLONE_FULL:
         /*
          * In case of failed copy_range request above, we may proceed with
          * buffered request larger than BLOCK_COPY_MAX_BUFFER.
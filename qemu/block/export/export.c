@@ -22,6 +22,7 @@
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block-export.h"
 #include "qapi/qapi-events-block-export.h"
+#include "qapi/util.h"
 #include "qemu/id.h"
 #ifdef CONFIG_VHOST_USER_BLK_SERVER
 #include "vhost-user-blk-server.h"
@@ -80,6 +81,8 @@ BlockExport *blk_exp_add(BlockExportOptions *export, Error **errp)
     BlockExport *exp = NULL;
     BlockDriverState *bs;
     BlockBackend *blk = NULL;
+    IOThread **iothreads = NULL;
+    unsigned nb_iothreads = 0;
     AioContext *ctx;
     uint64_t perm;
     int ret;
@@ -116,15 +119,48 @@ BlockExport *blk_exp_add(BlockExportOptions *export, Error **errp)
 
     ctx = bdrv_get_aio_context(bs);
 
+    if (export->iothread && export->iothread->type == QTYPE_QLIST) {
+        strList *name;
+
+        if (!drv->supports_multithread) {
+            error_setg(errp, "Export type does not support multiple "
+                       "iothreads");
+            goto fail;
+        }
+        if (!export->iothread->u.multi) {
+            error_setg(errp, "The list of iothreads must not be empty");
+            goto fail;
+        }
+
+        iothreads = g_new0(IOThread *,
+                           QAPI_LIST_LENGTH(export->iothread->u.multi));
+        for (name = export->iothread->u.multi; name; name = name->next) {
+            IOThread *iothread = iothread_by_id(name->value);
+
+            if (!iothread) {
+                error_setg(errp, "iothread \"%s\" not found", name->value);
+                goto fail;
+            }
+            /* Released in blk_exp_delete_bh() */
+            object_ref(OBJECT(iothread));
+            iothreads[nb_iothreads++] = iothread;
+        }
+    }
+
     if (export->iothread) {
         IOThread *iothread;
         AioContext *new_ctx;
         Error **set_context_errp;
 
-        iothread = iothread_by_id(export->iothread);
-        if (!iothread) {
-            error_setg(errp, "iothread \"%s\" not found", export->iothread);
-            goto fail;
+        if (iothreads) {
+            iothread = iothreads[0];
+        } else {
+            iothread = iothread_by_id(export->iothread->u.single);
+            if (!iothread) {
+                error_setg(errp, "iothread \"%s\" not found",
+                           export->iothread->u.single);
+                goto fail;
+            }
         }
 
         new_ctx = iothread_get_aio_context(iothread);
@@ -193,6 +229,8 @@ BlockExport *blk_exp_add(BlockExportOptions *export, Error **errp)
         .id         = g_strdup(export->id),
         .ctx        = ctx,
         .blk        = blk,
+        .iothreads  = iothreads,
+        .nb_iothreads = nb_iothreads,
     };
 
     ret = drv->create(exp, export, errp);
@@ -214,9 +252,25 @@ fail:
         g_free(exp->id);
         g_free(exp);
     }
+    for (unsigned i = 0; i < nb_iothreads; i++) {
+        object_unref(OBJECT(iothreads[i]));
+    }
+    g_free(iothreads);
     return NULL;
 }
 
+/*
+ * Returns the AioContext in which the @n-th virtqueue or client connection of
+ * @exp should be processed.
+ */
+AioContext *blk_exp_get_queue_aio_context(BlockExport *exp, unsigned n)
+{
+    if (!exp->iothreads) {
+        return exp->ctx;
+    }
+    return iothread_get_aio_context(exp->iothreads[n % exp->nb_iothreads]);
+}
+
 void blk_exp_ref(BlockExport *exp)
 {
     assert(qatomic_read(&exp->refcount) > 0);
@@ -234,6 +288,10 @@ static void blk_exp_delete_bh(void *opaque)
     blk_set_dev_ops(exp->blk, NULL, NULL);
     blk_unref(exp->blk);
     qapi_event_send_block_export_deleted(exp->id);
+    for (unsigned i = 0; i < exp->nb_iothreads; i++) {
+        object_unref(OBJECT(exp->iothreads[i]));
+    }
+    g_free(exp->iothreads);
     g_free(exp->id);
     g_free(exp);
 }
@@ -364,6 +422,9 @@ BlockExportInfoList *qmp_query_block_exports(Error **errp)
             .node_name      = g_strdup(bdrv_get_node_name(blk_bs(exp->blk))),
             .shutting_down  = !exp->user_owned,
         };
+        if (exp->drv->query) {
+            exp->drv->query(exp, info);
+        }
 
         QAPI_LIST_APPEND(tail, info);
     }
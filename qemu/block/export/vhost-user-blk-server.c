@@ -44,8 +44,10 @@ static void vu_blk_req_complete(VuBlkReq *req, size_t in_len)
 {
     VuDev *vu_dev = &req->server->vu_dev;
 
+    vhost_user_server_lock_queue(req->server, req->vq);
     vu_queue_push(vu_dev, req->vq, &req->elem, in_len);
     vu_queue_notify(vu_dev, req->vq);
+    vhost_user_server_unlock_queue(req->server, req->vq);
 
     free(req);
 }
@@ -321,6 +323,7 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     BlockExportOptionsVhostUserBlk *vu_opts = &opts->u.vhost_user_blk;
     uint64_t logical_block_size;
     uint16_t num_queues = VHOST_USER_BLK_NUM_QUEUES_DEFAULT;
+    g_autofree AioContext **queue_ctx = NULL;
 
     vexp->blkcfg.wce = 0;
 
@@ -340,6 +343,13 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         error_setg(errp, "num-queues must be greater than 0");
         return -EINVAL;
     }
+    if (exp->iothreads) {
+        queue_ctx = g_new(AioContext *, num_queues);
+        for (int i = 0; i < num_queues; i++) {
+            queue_ctx[i] = blk_exp_get_queue_aio_context(exp, i);
+        }
+    }
+
     vexp->handler.blk = exp->blk;
     vexp->handler.serial = g_strdup("vhost_user_blk");
     vexp->handler.logical_block_size = logical_block_size;
@@ -354,7 +364,8 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     blk_set_dev_ops(exp->blk, &vu_blk_dev_ops, vexp);
 
     if (!vhost_user_server_start(&vexp->vu_server, vu_opts->addr, exp->ctx,
-                                 num_queues, &vu_blk_iface, errp)) {
+                                 num_queues, queue_ctx, &vu_blk_iface,
+                                 errp)) {
         blk_remove_aio_context_notifier(exp->blk, blk_aio_attached,
                                         blk_aio_detach, vexp);
         g_free(vexp->handler.serial);
@@ -379,4 +390,5 @@ const BlockExportDriver blk_exp_vhost_user_blk = {
     .create             = vu_blk_exp_create,
     .delete             = vu_blk_exp_delete,
     .request_shutdown   = vu_blk_exp_request_shutdown,
+    .supports_multithread = true,
 };
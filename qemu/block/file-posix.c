@@ -161,8 +161,13 @@ typedef struct BDRVRawState {
     bool use_linux_aio:1;
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
+    bool io_uring_fixed_files:1;
+    bool io_uring_fixed_bufs:1;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
+    /* FICLONERANGE works on this file, with ranges aligned to clone_align */
+    bool has_clone;
+    uint32_t clone_align;
     bool needs_alignment;
     bool force_alignment;
     bool drop_cache;
@@ -174,8 +179,28 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+
+#ifdef CONFIG_LINUX_IO_URING
+    /*
+     * Registrations with the io_uring ring of the node's AioContext.  They
+     * are made by the first request submitted there, because the ring is
+     * created lazily by the thread that uses it.
+     */
+    QemuMutex io_uring_lock;
+    AioContext *io_uring_ctx;   /* NULL if not registered yet */
+    int io_uring_fixed_file;    /* -1 if s->fd is not registered */
+    GArray *io_uring_bufs;      /* RawIoUringBuf, from bdrv_register_buf() */
+#endif
 } BDRVRawState;
 
+#ifdef CONFIG_LINUX_IO_URING
+typedef struct RawIoUringBuf {
+    void *host;
+    size_t size;
+    bool registered;
+} RawIoUringBuf;
+#endif
+
 typedef struct BDRVRawReopenState {
     int open_flags;
     bool drop_cache;
@@ -562,6 +587,16 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+        {
+            .name = "aio-fixed-files",
+            .type = QEMU_OPT_BOOL,
+            .help = "register the file with io_uring (default: off)",
+        },
+        {
+            .name = "aio-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM with io_uring (default: off)",
+        },
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -643,6 +678,17 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
 
+    s->io_uring_fixed_files = qemu_opt_get_bool(opts, "aio-fixed-files", false);
+    s->io_uring_fixed_bufs = qemu_opt_get_bool(opts, "aio-fixed-buffers",
+                                               false);
+    if ((s->io_uring_fixed_files || s->io_uring_fixed_bufs) &&
+        !s->use_linux_io_uring) {
+        error_setg(errp, "aio-fixed-files and aio-fixed-buffers require "
+                   "aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
                               ON_OFF_AUTO_AUTO, &local_err);
@@ -758,6 +804,10 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
             goto fail;
         } else {
             s->has_fallocate = true;
+#ifdef FICLONERANGE
+            s->has_clone = true;
+            s->clone_align = MAX(st.st_blksize, BDRV_SECTOR_SIZE);
+#endif
         }
     } else {
         if (!(S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))) {
@@ -817,6 +867,12 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+
+#ifdef CONFIG_LINUX_IO_URING
+    qemu_mutex_init(&s->io_uring_lock);
+    s->io_uring_fixed_file = -1;
+    s->io_uring_bufs = g_array_new(false, false, sizeof(RawIoUringBuf));
+#endif
     ret = 0;
 fail:
     if (ret < 0 && s->fd != -1) {
@@ -2230,9 +2286,60 @@ static int handle_aiocb_zone_mgmt(void *opaque)
 }
 #endif
 
-static int handle_aiocb_copy_range(void *opaque)
+/*
+ * Share the extents of the source range with the destination instead of
+ * copying the data.  Returns -ENOTSUP if this is not possible for the range.
+ */
+static int handle_aiocb_clone_range(RawPosixAIOData *aiocb)
+{
+#ifdef FICLONERANGE
+    BDRVRawState *s = aiocb->bs->opaque;
+    struct file_clone_range range = {
+        .src_fd         = aiocb->aio_fildes,
+        .src_offset     = aiocb->aio_offset,
+        .src_length     = aiocb->aio_nbytes,
+        .dest_offset    = aiocb->copy_range.aio_offset2,
+    };
+    int ret;
+
+    /* Both files are on the same filesystem, so the alignment is the same */
+    if (!s->has_clone || range.src_length == 0 ||
+        !QEMU_IS_ALIGNED(range.src_offset, s->clone_align) ||
+        !QEMU_IS_ALIGNED(range.src_length, s->clone_align) ||
+        !QEMU_IS_ALIGNED(range.dest_offset, s->clone_align)) {
+        return -ENOTSUP;
+    }
+
+    do {
+        ret = ioctl(aiocb->copy_range.aio_fd2, FICLONERANGE, &range);
+    } while (ret < 0 && errno == EINTR);
+    ret = ret < 0 ? -errno : 0;
+    trace_file_clone_range(aiocb->bs, range.src_fd, range.src_offset,
+                           aiocb->copy_range.aio_fd2, range.dest_offset,
+                           range.src_length, ret);
+
+    switch (ret) {
+    case 0:
+        return 0;
+    case -ENOTTY:
+    case -EOPNOTSUPP:
+        /* The filesystem cannot share extents at all */
+        s->has_clone = false;
+        return -ENOTSUP;
+    case -EXDEV:
+    case -EINVAL:
+        /* Not the same filesystem, or not a suitable range */
+        return -ENOTSUP;
+    default:
+        return ret;
+    }
+#else
+    return -ENOTSUP;
+#endif
+}
+
+static int handle_aiocb_copy_file_range(RawPosixAIOData *aiocb)
 {
-    RawPosixAIOData *aiocb = opaque;
     uint64_t bytes = aiocb->aio_nbytes;
     off_t in_off = aiocb->aio_offset;
     off_t out_off = aiocb->copy_range.aio_offset2;
@@ -2264,6 +2371,18 @@ static int handle_aiocb_copy_range(void *opaque)
     return 0;
 }
 
+static int handle_aiocb_copy_range(void *opaque)
+{
+    RawPosixAIOData *aiocb = opaque;
+    int ret;
+
+    ret = handle_aiocb_clone_range(aiocb);
+    if (ret != -ENOTSUP || (aiocb->aio_type & QEMU_AIO_NO_FALLBACK)) {
+        return ret;
+    }
+    return handle_aiocb_copy_file_range(aiocb);
+}
+
 static int handle_aiocb_discard(void *opaque)
 {
     RawPosixAIOData *aiocb = opaque;
@@ -2526,6 +2645,156 @@ static inline bool raw_check_linux_io_uring(BDRVRawState *s)
     }
     return true;
 }
+
+/* Called with s->io_uring_lock held */
+static void raw_io_uring_register_file(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+    Error *local_err = NULL;
+    LuringState *ring = aio_get_linux_io_uring(s->io_uring_ctx);
+
+    s->io_uring_fixed_file = luring_register_file(ring, s->fd, &local_err);
+    if (s->io_uring_fixed_file < 0) {
+        s->io_uring_fixed_file = -1;
+        warn_reportf_err(local_err, "%s: ", bs->filename);
+    }
+}
+
+/* Called with s->io_uring_lock held */
+static void raw_io_uring_unregister_file(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->io_uring_fixed_file >= 0) {
+        luring_unregister_file(aio_get_linux_io_uring(s->io_uring_ctx),
+                               s->io_uring_fixed_file);
+        s->io_uring_fixed_file = -1;
+    }
+}
+
+/* Called with s->io_uring_lock held */
+static void raw_io_uring_register_buf(BlockDriverState *bs, RawIoUringBuf *buf)
+{
+    BDRVRawState *s = bs->opaque;
+    LuringState *ring = aio_get_linux_io_uring(s->io_uring_ctx);
+    Error *local_err = NULL;
+
+    buf->registered = luring_register_buf(ring, buf->host, buf->size,
+                                          &local_err);
+    if (!buf->registered) {
+        warn_reportf_err(local_err, "%s: ", bs->filename);
+    }
+}
+
+/*
+ * Registers the file and the buffers of @bs with the ring of @ctx, which
+ * must be both the node's AioContext and the current one.  Failures only
+ * print a warning, requests can do without registrations.
+ */
+static void raw_io_uring_register(BlockDriverState *bs, AioContext *ctx)
+{
+    BDRVRawState *s = bs->opaque;
+
+    qemu_mutex_lock(&s->io_uring_lock);
+    if (!s->io_uring_ctx) {
+        qatomic_set(&s->io_uring_ctx, ctx);
+        if (s->io_uring_fixed_files) {
+            raw_io_uring_register_file(bs);
+        }
+        for (guint i = 0; i < s->io_uring_bufs->len; i++) {
+            raw_io_uring_register_buf(bs, &g_array_index(s->io_uring_bufs,
+                                                         RawIoUringBuf, i));
+        }
+    }
+    qemu_mutex_unlock(&s->io_uring_lock);
+}
+
+static void raw_io_uring_unregister(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+    LuringState *ring;
+
+    qemu_mutex_lock(&s->io_uring_lock);
+    if (s->io_uring_ctx) {
+        ring = aio_get_linux_io_uring(s->io_uring_ctx);
+        raw_io_uring_unregister_file(bs);
+        for (guint i = 0; i < s->io_uring_bufs->len; i++) {
+            RawIoUringBuf *buf = &g_array_index(s->io_uring_bufs,
+                                                RawIoUringBuf, i);
+            if (buf->registered) {
+                luring_unregister_buf(ring, buf->host, buf->size);
+                buf->registered = false;
+            }
+        }
+        qatomic_set(&s->io_uring_ctx, NULL);
+    }
+    qemu_mutex_unlock(&s->io_uring_lock);
+}
+
+/*
+ * Returns the index of s->fd in the registered file table of the current
+ * AioContext's ring, or -1.  Only the node's own AioContext has its
+ * registrations, requests submitted from other threads go without.
+ */
+static int raw_io_uring_fixed_file(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    if (qatomic_read(&s->io_uring_ctx) != ctx) {
+        if (!(s->io_uring_fixed_files || s->io_uring_fixed_bufs) ||
+            ctx != bdrv_get_aio_context(bs)) {
+            return -1;
+        }
+        raw_io_uring_register(bs, ctx);
+    }
+    return s->io_uring_fixed_file;
+}
+
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+    RawIoUringBuf buf = { .host = host, .size = size };
+
+    if (!s->io_uring_fixed_bufs) {
+        return true;
+    }
+
+    qemu_mutex_lock(&s->io_uring_lock);
+    if (s->io_uring_ctx) {
+        raw_io_uring_register_buf(bs, &buf);
+    }
+    g_array_append_val(s->io_uring_bufs, buf);
+    qemu_mutex_unlock(&s->io_uring_lock);
+    return true;
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    qemu_mutex_lock(&s->io_uring_lock);
+    for (guint i = 0; i < s->io_uring_bufs->len; i++) {
+        RawIoUringBuf *buf = &g_array_index(s->io_uring_bufs,
+                                            RawIoUringBuf, i);
+
+        if (buf->host == host && buf->size == size) {
+            if (buf->registered) {
+                luring_unregister_buf(aio_get_linux_io_uring(s->io_uring_ctx),
+                                      host, size);
+            }
+            g_array_remove_index_fast(s->io_uring_bufs, i);
+            break;
+        }
+    }
+    qemu_mutex_unlock(&s->io_uring_lock);
+}
+
+static void raw_detach_aio_context(BlockDriverState *bs)
+{
+    raw_io_uring_unregister(bs);
+}
 #endif
 
 #ifdef CONFIG_LINUX_AIO
@@ -2582,7 +2851,8 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
 #ifdef CONFIG_LINUX_IO_URING
     } else if (raw_check_linux_io_uring(s)) {
         assert(qiov->size == bytes);
-        ret = luring_co_submit(bs, s->fd, offset, qiov, type, flags);
+        ret = luring_co_submit(bs, s->fd, raw_io_uring_fixed_file(bs),
+                               offset, qiov, type, flags);
         goto out;
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2678,7 +2948,8 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
 
 #ifdef CONFIG_LINUX_IO_URING
     if (raw_check_linux_io_uring(s)) {
-        return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH, 0);
+        return luring_co_submit(bs, s->fd, raw_io_uring_fixed_file(bs), 0,
+                                NULL, QEMU_AIO_FLUSH, 0);
     }
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2693,6 +2964,12 @@ static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
 
+#ifdef CONFIG_LINUX_IO_URING
+    raw_io_uring_unregister(bs);
+    g_array_free(s->io_uring_bufs, true);
+    qemu_mutex_destroy(&s->io_uring_lock);
+#endif
+
     if (s->fd >= 0) {
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
@@ -3887,9 +4164,19 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        qemu_mutex_lock(&s->io_uring_lock);
+        raw_io_uring_unregister_file(bs);
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
+#ifdef CONFIG_LINUX_IO_URING
+        if (s->io_uring_ctx && s->io_uring_fixed_files) {
+            raw_io_uring_register_file(bs);
+        }
+        qemu_mutex_unlock(&s->io_uring_lock);
+#endif
     }
     s->perm_change_fd = 0;
 
@@ -3953,6 +4240,9 @@ raw_co_copy_range_to(BlockDriverState *bs,
             .aio_offset2    = dst_offset,
         },
     };
+    if (write_flags & BDRV_REQ_NO_FALLBACK) {
+        acb.aio_type |= QEMU_AIO_NO_FALLBACK;
+    }
 
     return raw_thread_pool_submit(handle_aiocb_copy_range, &acb);
 }
@@ -3969,6 +4259,11 @@ BlockDriver bdrv_file = {
     .bdrv_reopen_commit = raw_reopen_commit,
     .bdrv_reopen_abort = raw_reopen_abort,
     .bdrv_close = raw_close,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_detach_aio_context = raw_detach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .bdrv_co_create = raw_co_create,
     .bdrv_co_create_opts = raw_co_create_opts,
     .bdrv_has_zero_init = bdrv_has_zero_init_1,
@@ -4332,6 +4627,11 @@ static BlockDriver bdrv_host_device = {
     .bdrv_parse_filename = hdev_parse_filename,
     .bdrv_open          = hdev_open,
     .bdrv_close         = raw_close,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_detach_aio_context = raw_detach_aio_context,
+    .bdrv_register_buf  = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .bdrv_reopen_prepare = raw_reopen_prepare,
     .bdrv_reopen_commit  = raw_reopen_commit,
     .bdrv_reopen_abort   = raw_reopen_abort,
@@ -16,6 +16,11 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "system/block-backend.h"
 #include "trace.h"
@@ -23,9 +28,21 @@
 /* Only used for assertions.  */
 #include "qemu/coroutine_int.h"
 
+/* Only defined by liburing 2.0 and newer */
+#ifndef IORING_FEAT_SQPOLL_NONFIXED
+#define IORING_FEAT_SQPOLL_NONFIXED (1U << 7)
+#endif
+
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Size of the registered file and buffer tables */
+#define MAX_FIXED_FILES 64
+#define MAX_FIXED_BUFS 1024
+
+/* The kernel limits each registered buffer to 1 GiB */
+#define FIXED_BUF_MAX_SIZE (1 * GiB)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -49,6 +66,23 @@ typedef struct LuringQueue {
     QSIMPLEQ_HEAD(, LuringAIOCB) submit_queue;
 } LuringQueue;
 
+typedef struct LuringFixedBuf {
+    void *host;         /* NULL if the slot is free */
+    size_t size;
+    unsigned refcnt;
+} LuringFixedBuf;
+
+/* Read-only copy of the registered buffers for request submission */
+typedef struct LuringFixedBufMap {
+    struct rcu_head rcu;
+    unsigned nr;
+    struct {
+        uintptr_t start;
+        uintptr_t end;
+        unsigned index;
+    } bufs[];
+} LuringFixedBufMap;
+
 struct LuringState {
     AioContext *aio_context;
 
@@ -58,6 +92,23 @@ struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /*
+     * Registered files and buffers.  The users of a file slot keep track
+     * of its index themselves, buffers are looked up for each request.
+     * Both can be registered from other threads, so @lock protects them.
+     */
+    QemuMutex lock;
+    int *fixed_files;
+    LuringFixedBuf *fixed_bufs;
+    unsigned nr_fixed_bufs;     /* slots in use are below this index */
+
+    /*
+     * Rebuilt from @fixed_bufs with @lock held whenever a buffer is added
+     * or removed, NULL if there are none.  Request submission looks up
+     * buffers here under the RCU read lock instead of taking @lock.
+     */
+    LuringFixedBufMap *fixed_buf_map;
 };
 
 /**
@@ -90,6 +141,15 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luringcb->total_read += nread;
     remaining = luringcb->qiov->size - luringcb->total_read;
 
+    /* A registered buffer is contiguous, read into the rest of it */
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.off += nread;
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len = remaining;
+        luring_resubmit(s, luringcb);
+        return;
+    }
+
     /* Shorten qiov */
     resubmit_qiov = &luringcb->resubmit_qiov;
     if (resubmit_qiov->iov == NULL) {
@@ -323,9 +383,44 @@ static void luring_deferred_fn(void *opaque)
     }
 }
 
+/**
+ * luring_find_fixed_buf:
+ * @s: AIO state
+ * @qiov: request buffer
+ *
+ * Returns the index of the registered buffer that contains all of @qiov,
+ * or -1 if there is none.  Only single element vectors are looked up, the
+ * fixed buffer opcodes do not take a vector.
+ */
+static int luring_find_fixed_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    LuringFixedBufMap *map;
+    uintptr_t start, end;
+
+    if (qiov->niov != 1) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+
+    RCU_READ_LOCK_GUARD();
+    map = qatomic_rcu_read(&s->fixed_buf_map);
+    if (!map) {
+        return -1;
+    }
+    for (unsigned i = 0; i < map->nr; i++) {
+        if (start >= map->bufs[i].start && end <= map->bufs[i].end) {
+            return map->bufs[i].index;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
+ * @fixed_file: index of @fd in the registered file table, or -1
  * @luringcb: AIO control block
  * @s: AIO state
  * @offset: offset for request
@@ -334,14 +429,29 @@ static void luring_deferred_fn(void *opaque)
  * Fetches sqes from ring, adds to pending queue and preps them
  *
  */
-static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
-                            uint64_t offset, int type, BdrvRequestFlags flags)
+static int luring_do_submit(int fd, int fixed_file, LuringAIOCB *luringcb,
+                            LuringState *s, uint64_t offset, int type,
+                            BdrvRequestFlags flags)
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int fixed_buf = -1;
+
+    if ((flags & BDRV_REQ_REGISTERED_BUF) &&
+        (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE)) {
+        fixed_buf = luring_find_fixed_buf(s, luringcb->qiov);
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
+        if (fixed_buf >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->size, offset, fixed_buf);
+#ifdef HAVE_IO_URING_PREP_WRITEV2
+            sqes->rw_flags = (flags & BDRV_REQ_FUA) ? RWF_DSYNC : 0;
+#endif
+            break;
+        }
 #ifdef HAVE_IO_URING_PREP_WRITEV2
     {
         int luring_flags = (flags & BDRV_REQ_FUA) ? RWF_DSYNC : 0;
@@ -349,7 +459,7 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                               luringcb->qiov->niov, offset, luring_flags);
     }
 #else
-        assert(flags == 0);
+        assert(!(flags & BDRV_REQ_FUA));
         io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
                              luringcb->qiov->niov, offset);
 #endif
@@ -359,6 +469,11 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                              luringcb->qiov->niov, offset);
         break;
     case QEMU_AIO_READ:
+        if (fixed_buf >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->size, offset, fixed_buf);
+            break;
+        }
         io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
                             luringcb->qiov->niov, offset);
         break;
@@ -370,6 +485,10 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (fixed_file >= 0) {
+        sqes->fd = fixed_file;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -388,9 +507,9 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     return 0;
 }
 
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type,
-                                  BdrvRequestFlags flags)
+int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, int fixed_file,
+                                  uint64_t offset, QEMUIOVector *qiov,
+                                  int type, BdrvRequestFlags flags)
 {
     int ret;
     AioContext *ctx = qemu_get_current_aio_context();
@@ -403,7 +522,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     };
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
-    ret = luring_do_submit(fd, &luringcb, s, offset, type, flags);
+    ret = luring_do_submit(fd, fixed_file, &luringcb, s, offset, type, flags);
 
     if (ret < 0) {
         return ret;
@@ -432,15 +551,275 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+/**
+ * luring_register_file:
+ * @s: AIO state
+ * @fd: file descriptor to register
+ * @errp: error object
+ *
+ * Adds @fd to the registered file table of @s, so that the kernel does not
+ * have to look it up for each request that passes the returned index as
+ * @fixed_file to luring_co_submit().
+ *
+ * Returns the index of @fd in the table, or -errno on failure.
+ */
+int luring_register_file(LuringState *s, int fd, Error **errp)
+{
+#ifdef HAVE_IO_URING_REGISTER_FILES_SPARSE
+    QEMU_LOCK_GUARD(&s->lock);
+    int i, ret;
+
+    if (!s->fixed_files) {
+        ret = io_uring_register_files_sparse(&s->ring, MAX_FIXED_FILES);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret,
+                             "failed to set up io_uring registered files");
+            return ret;
+        }
+        s->fixed_files = g_new(int, MAX_FIXED_FILES);
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            s->fixed_files[i] = -1;
+        }
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_files[i] == -1) {
+            break;
+        }
+    }
+    if (i == MAX_FIXED_FILES) {
+        error_setg(errp, "io_uring registered file table is full");
+        return -ENOSPC;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, i, &fd, 1);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "failed to register file with io_uring");
+        return ret;
+    }
+    s->fixed_files[i] = fd;
+    trace_luring_register_file(s, fd, i);
+    return i;
+#else
+    error_setg(errp, "io_uring registered files are not supported "
+               "in this build");
+    return -ENOTSUP;
+#endif
+}
+
+void luring_unregister_file(LuringState *s, int index)
 {
-    int rc;
+    QEMU_LOCK_GUARD(&s->lock);
+    int fd = -1;
+
+    assert(s->fixed_files && s->fixed_files[index] != -1);
+    trace_luring_unregister_file(s, s->fixed_files[index], index);
+    io_uring_register_files_update(&s->ring, index, &fd, 1);
+    s->fixed_files[index] = -1;
+}
+
+/* Called with s->lock held */
+static bool luring_register_buf_chunk(LuringState *s, void *host, size_t size,
+                                      Error **errp)
+{
+    struct iovec iov = { .iov_base = host, .iov_len = size };
+    unsigned i, free_slot = MAX_FIXED_BUFS;
+    int ret;
+
+    for (i = 0; i < MAX_FIXED_BUFS; i++) {
+        LuringFixedBuf *buf = &s->fixed_bufs[i];
+
+        if (buf->host == host && buf->size == size) {
+            buf->refcnt++;
+            return true;
+        }
+        if (!buf->host && free_slot == MAX_FIXED_BUFS) {
+            free_slot = i;
+        }
+    }
+    if (free_slot == MAX_FIXED_BUFS) {
+        error_setg(errp, "io_uring registered buffer table is full");
+        return false;
+    }
+
+    ret = io_uring_register_buffers_update_tag(&s->ring, free_slot, &iov,
+                                               NULL, 1);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret,
+                         "failed to register buffer with io_uring");
+        return false;
+    }
+    trace_luring_register_buf(s, host, size, free_slot);
+
+    s->fixed_bufs[free_slot] = (LuringFixedBuf) {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+    };
+    s->nr_fixed_bufs = MAX(s->nr_fixed_bufs, free_slot + 1);
+    return true;
+}
+
+/* Called with s->lock held */
+static void luring_unregister_buf_chunk(LuringState *s, void *host,
+                                        size_t size)
+{
+    struct iovec iov = { };
+    unsigned i, n;
+
+    for (i = 0; i < s->nr_fixed_bufs; i++) {
+        LuringFixedBuf *buf = &s->fixed_bufs[i];
+
+        if (buf->host == host && buf->size == size) {
+            break;
+        }
+    }
+    if (i == s->nr_fixed_bufs || --s->fixed_bufs[i].refcnt) {
+        return;
+    }
+
+    trace_luring_unregister_buf(s, host, size, i);
+    io_uring_register_buffers_update_tag(&s->ring, i, &iov, NULL, 1);
+
+    s->fixed_bufs[i].host = NULL;
+    for (n = s->nr_fixed_bufs; n > 0 && !s->fixed_bufs[n - 1].host; n--) {
+        /* nothing */
+    }
+    s->nr_fixed_bufs = n;
+}
+
+/* Called with s->lock held */
+static void luring_update_fixed_buf_map(LuringState *s)
+{
+    LuringFixedBufMap *old = s->fixed_buf_map;
+    LuringFixedBufMap *map = NULL;
+    unsigned i, nr = 0;
+
+    for (i = 0; i < s->nr_fixed_bufs; i++) {
+        nr += !!s->fixed_bufs[i].host;
+    }
+    if (nr) {
+        map = g_malloc(sizeof(*map) + nr * sizeof(map->bufs[0]));
+        map->nr = 0;
+        for (i = 0; i < s->nr_fixed_bufs; i++) {
+            LuringFixedBuf *buf = &s->fixed_bufs[i];
+
+            if (buf->host) {
+                map->bufs[map->nr].start = (uintptr_t)buf->host;
+                map->bufs[map->nr].end = (uintptr_t)buf->host + buf->size;
+                map->bufs[map->nr].index = i;
+                map->nr++;
+            }
+        }
+    }
+
+    qatomic_rcu_set(&s->fixed_buf_map, map);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+/**
+ * luring_register_buf:
+ * @s: AIO state
+ * @host: start of the buffer
+ * @size: size of the buffer
+ * @errp: error object
+ *
+ * Registers @host with the kernel, which then keeps its pages pinned instead
+ * of pinning them for each request.  Requests with BDRV_REQ_REGISTERED_BUF
+ * whose buffer lies within a registered buffer use the fixed buffer opcodes.
+ * Registrations are reference counted.
+ *
+ * Returns: true on success, false on failure.
+ */
+bool luring_register_buf(LuringState *s, void *host, size_t size,
+                         Error **errp)
+{
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+    QEMU_LOCK_GUARD(&s->lock);
+    size_t done;
+    int ret;
+
+    if (!s->fixed_bufs) {
+        ret = io_uring_register_buffers_sparse(&s->ring, MAX_FIXED_BUFS);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret,
+                             "failed to set up io_uring registered buffers");
+            return false;
+        }
+        s->fixed_bufs = g_new0(LuringFixedBuf, MAX_FIXED_BUFS);
+    }
+
+    for (done = 0; done < size; done += FIXED_BUF_MAX_SIZE) {
+        if (!luring_register_buf_chunk(s, host + done,
+                                       MIN(size - done, FIXED_BUF_MAX_SIZE),
+                                       errp)) {
+            for (size_t undo = 0; undo < done; undo += FIXED_BUF_MAX_SIZE) {
+                luring_unregister_buf_chunk(s, host + undo,
+                                            FIXED_BUF_MAX_SIZE);
+            }
+            return false;
+        }
+    }
+    luring_update_fixed_buf_map(s);
+    return true;
+#else
+    error_setg(errp, "io_uring registered buffers are not supported "
+               "in this build");
+    return false;
+#endif
+}
+
+void luring_unregister_buf(LuringState *s, void *host, size_t size)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+    size_t done;
+
+    if (!s->fixed_bufs) {
+        return;
+    }
+
+    for (done = 0; done < size; done += FIXED_BUF_MAX_SIZE) {
+        luring_unregister_buf_chunk(s, host + done,
+                                    MIN(size - done, FIXED_BUF_MAX_SIZE));
+    }
+    luring_update_fixed_buf_map(s);
+}
+
+LuringState *luring_init(unsigned sqpoll_idle, Error **errp)
+{
+    int rc = -1;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (sqpoll_idle) {
+        struct io_uring_params params = {
+            .flags = IORING_SETUP_SQPOLL,
+            .sq_thread_idle = sqpoll_idle,
+        };
+
+        rc = io_uring_queue_init_params(MAX_ENTRIES, ring, &params);
+        if (rc < 0) {
+            warn_report("failed to enable io_uring SQPOLL (%s), "
+                        "submitting from the event loop thread",
+                        strerror(-rc));
+        } else if (!(params.features & IORING_FEAT_SQPOLL_NONFIXED)) {
+            /*
+             * Before Linux 5.11, an SQPOLL ring only accepts registered
+             * files and fails all other requests with EBADF.
+             */
+            warn_report("io_uring SQPOLL requires registered files on this "
+                        "host kernel, submitting from the event loop thread");
+            io_uring_queue_exit(ring);
+            rc = -1;
+        }
+    }
+    if (rc < 0) {
+        rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    }
     if (rc < 0) {
         error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
@@ -448,6 +827,7 @@ LuringState *luring_init(Error **errp)
     }
 
     ioq_init(&s->io_q);
+    qemu_mutex_init(&s->lock);
     return s;
 
 }
@@ -455,6 +835,10 @@ LuringState *luring_init(Error **errp)
 void luring_cleanup(LuringState *s)
 {
     io_uring_queue_exit(&s->ring);
+    qemu_mutex_destroy(&s->lock);
+    g_free(s->fixed_files);
+    g_free(s->fixed_bufs);
+    g_free(s->fixed_buf_map);
     trace_luring_cleanup_state(s);
     g_free(s);
 }
@@ -2348,6 +2348,10 @@ iscsi_co_copy_range_to(BlockDriverState *bs,
     if (src->bs->drv->bdrv_co_copy_range_to != iscsi_co_copy_range_to) {
         return -ENOTSUP;
     }
+    /* EXTENDED COPY copies the data, it does not share it */
+    if (write_flags & BDRV_REQ_NO_FALLBACK) {
+        return -ENOTSUP;
+    }
     src_lun = src->bs->opaque;
 
     if (!src_lun->dd || !dst_lun->dd) {
@@ -94,6 +94,12 @@ typedef struct MirrorBlockJob {
     bool prepared;
     bool in_drain;
     bool base_ro;
+    /*
+     * Set once sharing extents between source and target worked, or
+     * once it failed before that, in which case it is not tried again.
+     */
+    bool clone_ok;
+    bool no_clone;
 } MirrorBlockJob;
 
 typedef struct MirrorBDSOpaque {
@@ -336,6 +342,47 @@ mirror_wait_for_free_in_flight_slot(MirrorBlockJob *s)
     abort();
 }
 
+/*
+ * Try to share the extents of the source with the target instead of copying
+ * the data through a buffer.  Returns true if @op was completed.
+ */
+static bool coroutine_fn mirror_co_clone(MirrorOp *op)
+{
+    MirrorBlockJob *s = op->s;
+    int ret;
+
+    if (s->no_clone) {
+        return false;
+    }
+
+    s->in_flight++;
+    s->bytes_in_flight += op->bytes;
+    op->is_in_flight = true;
+
+    WITH_GRAPH_RDLOCK_GUARD() {
+        ret = blk_co_copy_range_from(s->mirror_top_bs->backing, op->offset,
+                                     s->target, op->offset, op->bytes,
+                                     0, BDRV_REQ_NO_FALLBACK);
+    }
+    trace_mirror_clone(s, op->offset, op->bytes, ret);
+
+    if (ret < 0) {
+        /*
+         * Copy through a buffer instead.  Once cloning worked, only do this
+         * for @op, sharing extents may fail for parts of the image.
+         */
+        s->no_clone = !s->clone_ok;
+        s->in_flight--;
+        s->bytes_in_flight -= op->bytes;
+        op->is_in_flight = false;
+        return false;
+    }
+
+    s->clone_ok = true;
+    mirror_write_complete(op, 0);
+    return true;
+}
+
 /* Perform a mirror copy operation.
  *
  * *op->bytes_handled is set to the number of bytes copied after and
@@ -372,6 +419,11 @@ static void coroutine_fn mirror_co_read(void *opaque)
     assert(QEMU_IS_ALIGNED(op->offset, s->granularity));
     /* The range is sector-aligned, since bdrv_getlength() rounds up. */
     assert(QEMU_IS_ALIGNED(op->bytes, BDRV_SECTOR_SIZE));
+
+    if (mirror_co_clone(op)) {
+        return;
+    }
+
     nb_chunks = DIV_ROUND_UP(op->bytes, s->granularity);
 
     while (s->buf_free_count < nb_chunks) {
@@ -45,7 +45,7 @@ qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
     BDRVQcow2State *s = bs->opaque;
 
     qemu_co_mutex_lock(&s->lock);
-    while (s->nb_threads >= QCOW2_MAX_THREADS) {
+    while (s->nb_threads >= s->max_threads) {
         qemu_co_queue_wait(&s->thread_task_queue, &s->lock);
     }
     s->nb_threads++;
@@ -73,7 +73,8 @@ typedef struct Qcow2CompressData {
     size_t dest_size;
     const void *src;
     size_t src_size;
-    ssize_t ret;
+    int n;              /* number of buffers in @src and @dest */
+    ssize_t *ret;       /* result for each buffer */
 
     Qcow2CompressFunc func;
 } Qcow2CompressData;
@@ -329,27 +330,47 @@ static int qcow2_compress_pool_func(void *opaque)
 {
     Qcow2CompressData *data = opaque;
 
-    data->ret = data->func(data->dest, data->dest_size,
-                           data->src, data->src_size);
+    for (int i = 0; i < data->n; i++) {
+        data->ret[i] = data->func(data->dest + i * data->dest_size,
+                                  data->dest_size,
+                                  data->src + i * data->src_size,
+                                  data->src_size);
+    }
 
     return 0;
 }
 
-static ssize_t coroutine_fn
+static void coroutine_fn
 qcow2_co_do_compress(BlockDriverState *bs, void *dest, size_t dest_size,
-                     const void *src, size_t src_size, Qcow2CompressFunc func)
+                     const void *src, size_t src_size, int n, ssize_t *ret,
+                     Qcow2CompressFunc func)
 {
     Qcow2CompressData arg = {
         .dest = dest,
         .dest_size = dest_size,
         .src = src,
         .src_size = src_size,
+        .n = n,
+        .ret = ret,
         .func = func,
     };
 
     qcow2_co_process(bs, qcow2_compress_pool_func, &arg);
+}
 
-    return arg.ret;
+static Qcow2CompressFunc qcow2_compress_func(BDRVQcow2State *s)
+{
+    switch (s->compression_type) {
+    case QCOW2_COMPRESSION_TYPE_ZLIB:
+        return qcow2_zlib_compress;
+
+#ifdef CONFIG_ZSTD
+    case QCOW2_COMPRESSION_TYPE_ZSTD:
+        return qcow2_zstd_compress;
+#endif
+    default:
+        abort();
+    }
 }
 
 /*
@@ -368,24 +389,30 @@ ssize_t coroutine_fn
 qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
                   const void *src, size_t src_size)
 {
-    BDRVQcow2State *s = bs->opaque;
-    Qcow2CompressFunc fn;
-
-    switch (s->compression_type) {
-    case QCOW2_COMPRESSION_TYPE_ZLIB:
-        fn = qcow2_zlib_compress;
-        break;
+    ssize_t ret;
 
-#ifdef CONFIG_ZSTD
-    case QCOW2_COMPRESSION_TYPE_ZSTD:
-        fn = qcow2_zstd_compress;
-        break;
-#endif
-    default:
-        abort();
-    }
+    qcow2_co_do_compress(bs, dest, dest_size, src, src_size, 1, &ret,
+                         qcow2_compress_func(bs->opaque));
+    return ret;
+}
 
-    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn);
+/*
+ * qcow2_co_compress_batch()
+ *
+ * Compress @n buffers of @src_size bytes each with a single thread pool
+ * job, like @n calls to qcow2_co_compress() would.
+ *
+ * @dest - @n destination buffers of @dest_size bytes, one after another
+ * @src - @n source buffers of @src_size bytes, one after another
+ * @out_len - @n return values of qcow2_co_compress()
+ */
+void coroutine_fn
+qcow2_co_compress_batch(BlockDriverState *bs, void *dest, size_t dest_size,
+                        const void *src, size_t src_size, int n,
+                        ssize_t *out_len)
+{
+    qcow2_co_do_compress(bs, dest, dest_size, src, src_size, n, out_len,
+                         qcow2_compress_func(bs->opaque));
 }
 
 /*
@@ -407,6 +434,7 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2CompressFunc fn;
+    ssize_t ret;
 
     switch (s->compression_type) {
     case QCOW2_COMPRESSION_TYPE_ZLIB:
@@ -422,7 +450,8 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
         abort();
     }
 
-    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn);
+    qcow2_co_do_compress(bs, dest, dest_size, src, src_size, 1, &ret, fn);
+    return ret;
 }
 
 
@@ -701,6 +701,8 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_THREADS,
+    QCOW2_OPT_COMPRESSED_READ_AHEAD,
     NULL
 };
 
@@ -817,6 +819,18 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_THREADS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of threads compressing, decompressing "
+                    "or encrypting data at the same time",
+        },
+        {
+            .name = QCOW2_OPT_COMPRESSED_READ_AHEAD,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of compressed clusters to decompress ahead of "
+                    "sequential reads (0 = disabled)",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -979,6 +993,8 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    uint64_t threads;
+    uint64_t read_ahead_clusters;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1079,6 +1095,26 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->threads = qemu_opt_get_number(opts, QCOW2_OPT_THREADS,
+                                     QCOW2_DEFAULT_THREADS);
+    if (r->threads < 1 || r->threads > QCOW2_MAX_THREADS) {
+        error_setg(errp, QCOW2_OPT_THREADS " must be between 1 and %d",
+                   QCOW2_MAX_THREADS);
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    r->read_ahead_clusters =
+        qemu_opt_get_number(opts, QCOW2_OPT_COMPRESSED_READ_AHEAD, 0);
+    if (r->read_ahead_clusters > QCOW2_MAX_THREADS) {
+        error_setg(errp, QCOW2_OPT_COMPRESSED_READ_AHEAD
+                   " must not exceed %d", QCOW2_MAX_THREADS);
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->read_ahead_clusters = MIN(r->read_ahead_clusters,
+                                 QCOW2_MAX_READ_AHEAD_BYTES >> s->cluster_bits);
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1239,6 +1275,12 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
 
     s->discard_no_unref = r->discard_no_unref;
 
+    s->max_threads = r->threads;
+    s->read_ahead_clusters = r->read_ahead_clusters;
+    if (!s->read_ahead_clusters) {
+        qcow2_read_ahead_discard(bs, UINT64_MAX);
+    }
+
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
         s->cache_clean_interval = r->cache_clean_interval;
@@ -1628,6 +1670,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
 
     QLIST_INIT(&s->cluster_allocs);
     QTAILQ_INIT(&s->discards);
+    QTAILQ_INIT(&s->read_ahead);
 
     /* read qcow2 extensions */
     if (qcow2_read_extensions(bs, header.header_length, ext_end, NULL,
@@ -2419,7 +2462,8 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             qemu_iovec_memset(qiov, qiov_offset, 0, cur_bytes);
         } else {
             if (!aio && cur_bytes != bytes) {
-                aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+                aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS,
+                                            s->max_threads));
             }
             ret = qcow2_add_task(bs, aio, qcow2_co_preadv_task_entry, type,
                                  host_offset, offset, cur_bytes,
@@ -2804,6 +2848,7 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     }
 
     cache_clean_timer_del(bs);
+    qcow2_read_ahead_discard(bs, UINT64_MAX);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
 
@@ -4671,41 +4716,25 @@ fail:
     return ret;
 }
 
+/*
+ * Writes the compressed data of the cluster at @offset, or its uncompressed
+ * data from @qiov if @out_len says that compression did not pay off.
+ */
 static int coroutine_fn GRAPH_RDLOCK
-qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
-                                 uint64_t offset, uint64_t bytes,
-                                 QEMUIOVector *qiov, size_t qiov_offset)
+qcow2_co_pwrite_compressed_cluster(BlockDriverState *bs,
+                                   uint64_t offset, uint64_t bytes,
+                                   QEMUIOVector *qiov, size_t qiov_offset,
+                                   const uint8_t *out_buf, ssize_t out_len)
 {
     BDRVQcow2State *s = bs->opaque;
-    int ret;
-    ssize_t out_len;
-    uint8_t *buf, *out_buf;
     uint64_t cluster_offset;
+    int ret;
 
-    assert(bytes == s->cluster_size || (bytes < s->cluster_size &&
-           (offset + bytes == bs->total_sectors << BDRV_SECTOR_BITS)));
-
-    buf = qemu_blockalign(bs, s->cluster_size);
-    if (bytes < s->cluster_size) {
-        /* Zero-pad last write if image size is not cluster aligned */
-        memset(buf + bytes, 0, s->cluster_size - bytes);
-    }
-    qemu_iovec_to_buf(qiov, qiov_offset, buf, bytes);
-
-    out_buf = g_malloc(s->cluster_size);
-
-    out_len = qcow2_co_compress(bs, out_buf, s->cluster_size - 1,
-                                buf, s->cluster_size);
     if (out_len == -ENOMEM) {
         /* could not compress: write normal cluster */
-        ret = qcow2_co_pwritev_part(bs, offset, bytes, qiov, qiov_offset, 0);
-        if (ret < 0) {
-            goto fail;
-        }
-        goto success;
+        return qcow2_co_pwritev_part(bs, offset, bytes, qiov, qiov_offset, 0);
     } else if (out_len < 0) {
-        ret = -EINVAL;
-        goto fail;
+        return -EINVAL;
     }
 
     qemu_co_mutex_lock(&s->lock);
@@ -4713,23 +4742,64 @@ qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
                                                 &cluster_offset);
     if (ret < 0) {
         qemu_co_mutex_unlock(&s->lock);
-        goto fail;
+        return ret;
     }
 
     ret = qcow2_pre_write_overlap_check(bs, 0, cluster_offset, out_len, true);
     qemu_co_mutex_unlock(&s->lock);
     if (ret < 0) {
-        goto fail;
+        return ret;
     }
 
     BLKDBG_CO_EVENT(s->data_file, BLKDBG_WRITE_COMPRESSED);
     ret = bdrv_co_pwrite(s->data_file, cluster_offset, out_len, out_buf, 0);
-    if (ret < 0) {
-        goto fail;
+    return ret < 0 ? ret : 0;
+}
+
+/*
+ * Compresses the clusters in @offset..@offset+@bytes with a single thread
+ * pool job, then writes them one by one.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
+                                 uint64_t offset, uint64_t bytes,
+                                 QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int nb_clusters = DIV_ROUND_UP(bytes, s->cluster_size);
+    size_t buf_size = (size_t)nb_clusters * s->cluster_size;
+    size_t out_size = s->cluster_size - 1;
+    g_autofree ssize_t *out_len = g_new(ssize_t, nb_clusters);
+    uint8_t *buf, *out_buf;
+    int ret = 0;
+
+    assert(nb_clusters <= QCOW2_MAX_COMPRESS_BATCH);
+    assert(QEMU_IS_ALIGNED(bytes, s->cluster_size) ||
+           (offset + bytes == bs->total_sectors << BDRV_SECTOR_BITS));
+
+    buf = qemu_blockalign(bs, buf_size);
+    if (bytes < buf_size) {
+        /* Zero-pad last write if image size is not cluster aligned */
+        memset(buf + bytes, 0, buf_size - bytes);
     }
-success:
-    ret = 0;
-fail:
+    qemu_iovec_to_buf(qiov, qiov_offset, buf, bytes);
+
+    out_buf = g_malloc(nb_clusters * out_size);
+
+    qcow2_co_compress_batch(bs, out_buf, out_size, buf, s->cluster_size,
+                            nb_clusters, out_len);
+
+    for (int i = 0; i < nb_clusters && ret == 0; i++) {
+        uint64_t done = (uint64_t)i * s->cluster_size;
+
+        ret = qcow2_co_pwrite_compressed_cluster(bs, offset + done,
+                                                 MIN(bytes - done,
+                                                     s->cluster_size),
+                                                 qiov, qiov_offset + done,
+                                                 out_buf + i * out_size,
+                                                 out_len[i]);
+    }
+
     qemu_vfree(buf);
     g_free(out_buf);
     return ret;
@@ -4762,6 +4832,7 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     AioTaskPool *aio = NULL;
+    uint64_t batch;
     int ret = 0;
 
     if (has_data_file(bs)) {
@@ -4790,11 +4861,18 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
         return -EINVAL;
     }
 
+    /*
+     * Compress several clusters per thread pool job, but still spread the
+     * request over all threads.
+     */
+    batch = DIV_ROUND_UP(size_to_clusters(s, bytes), s->max_threads);
+    batch = MIN(batch, QCOW2_MAX_COMPRESS_BATCH);
+
     while (bytes && aio_task_pool_status(aio) == 0) {
-        uint64_t chunk_size = MIN(bytes, s->cluster_size);
+        uint64_t chunk_size = MIN(bytes, batch * s->cluster_size);
 
         if (!aio && chunk_size != bytes) {
-            aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+            aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS, s->max_threads));
         }
 
         ret = qcow2_add_task(bs, aio, qcow2_co_pwritev_compressed_task_entry,
@@ -4818,6 +4896,223 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
     return ret;
 }
 
+/*
+ * Compressed cluster read-ahead
+ *
+ * When compressed clusters are read sequentially, the next ones are read
+ * and decompressed in background coroutines, so that decompression runs
+ * on several threads even if the reader only has one request in flight.
+ * Entries are looked up by the host offset and size of the compressed
+ * data, and dropped when the host cluster holding it is freed.
+ */
+struct Qcow2ReadAhead {
+    BlockDriverState *bs;
+    uint64_t coffset;
+    int csize;
+    uint8_t *buf;               /* decompressed cluster */
+    int ret;
+    bool done;
+    bool claimed;               /* taken off the list by a reader */
+    bool stale;                 /* taken off the list because it was freed */
+    CoQueue waiters;
+    QTAILQ_ENTRY(Qcow2ReadAhead) next;
+};
+
+static void qcow2_read_ahead_free(BDRVQcow2State *s, Qcow2ReadAhead *ra)
+{
+    qemu_vfree(ra->buf);
+    g_free(ra);
+    s->nb_read_ahead--;
+}
+
+/*
+ * Drops read-ahead entries whose compressed data overlaps the host cluster
+ * at @host_offset, or all of them if @host_offset is UINT64_MAX.  Called
+ * with s->lock held, or when no request is in flight.
+ */
+void qcow2_read_ahead_discard(BlockDriverState *bs, uint64_t host_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2ReadAhead *ra, *next;
+
+    QTAILQ_FOREACH_SAFE(ra, &s->read_ahead, next, next) {
+        if (host_offset != UINT64_MAX &&
+            (ra->coffset >= host_offset + s->cluster_size ||
+             ra->coffset + ra->csize <= host_offset)) {
+            continue;
+        }
+        QTAILQ_REMOVE(&s->read_ahead, ra, next);
+        if (ra->done) {
+            qcow2_read_ahead_free(s, ra);
+        } else {
+            ra->stale = true;
+        }
+    }
+}
+
+static void coroutine_fn qcow2_read_ahead_entry(void *opaque)
+{
+    Qcow2ReadAhead *ra = opaque;
+    BlockDriverState *bs = ra->bs;
+    BDRVQcow2State *s = bs->opaque;
+    g_autofree uint8_t *buf = g_try_malloc(ra->csize);
+    int ret = -ENOMEM;
+
+    if (buf) {
+        bdrv_graph_co_rdlock();
+        BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
+        ret = bdrv_co_pread(bs->file, ra->coffset, ra->csize, buf, 0);
+        bdrv_graph_co_rdunlock();
+    }
+    if (ret >= 0) {
+        ret = qcow2_co_decompress(bs, ra->buf, s->cluster_size,
+                                  buf, ra->csize) < 0 ? -EIO : 0;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    ra->ret = ret;
+    ra->done = true;
+    if (ra->claimed) {
+        qemu_co_queue_restart_all(&ra->waiters);
+    } else if (ra->stale) {
+        qcow2_read_ahead_free(s, ra);
+    } else if (ret < 0) {
+        QTAILQ_REMOVE(&s->read_ahead, ra, next);
+        qcow2_read_ahead_free(s, ra);
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Makes room for a new entry, evicting the oldest decompressed one that
+ * nobody read if necessary.  Called with s->lock held.
+ */
+static bool qcow2_read_ahead_make_room(BDRVQcow2State *s)
+{
+    Qcow2ReadAhead *ra;
+
+    if (s->nb_read_ahead < 2 * s->read_ahead_clusters) {
+        return true;
+    }
+    QTAILQ_FOREACH(ra, &s->read_ahead, next) {
+        if (ra->done) {
+            QTAILQ_REMOVE(&s->read_ahead, ra, next);
+            qcow2_read_ahead_free(s, ra);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Starts reading ahead of the compressed cluster at guest offset @offset.
+ * Called with s->lock held.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+qcow2_read_ahead_start(BlockDriverState *bs, uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t end = MIN(offset + (s->read_ahead_clusters + 1) * s->cluster_size,
+                       bs->total_sectors << BDRV_SECTOR_BITS);
+    uint64_t pos = offset + s->cluster_size;
+
+    /* Continue where the previous call stopped, unless the reader jumped */
+    if (s->read_ahead_end > pos && s->read_ahead_end <= end) {
+        pos = s->read_ahead_end;
+    }
+
+    while (pos < end && qcow2_read_ahead_make_room(s)) {
+        QCow2SubclusterType type;
+        unsigned int bytes = MIN(end - pos, s->cluster_size);
+        uint64_t l2_entry;
+        Qcow2ReadAhead *ra;
+        uint64_t coffset;
+        int csize;
+
+        if (qcow2_get_host_offset(bs, pos, &bytes, &l2_entry, &type) < 0) {
+            break;
+        }
+        pos += s->cluster_size;
+        if (type != QCOW2_SUBCLUSTER_COMPRESSED) {
+            continue;
+        }
+
+        qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+        QTAILQ_FOREACH(ra, &s->read_ahead, next) {
+            if (ra->coffset == coffset && ra->csize == csize) {
+                break;
+            }
+        }
+        if (ra) {
+            continue;
+        }
+
+        ra = g_new0(Qcow2ReadAhead, 1);
+        ra->bs = bs;
+        ra->coffset = coffset;
+        ra->csize = csize;
+        ra->buf = qemu_blockalign(bs, s->cluster_size);
+        qemu_co_queue_init(&ra->waiters);
+        QTAILQ_INSERT_TAIL(&s->read_ahead, ra, next);
+        s->nb_read_ahead++;
+
+        bdrv_inc_in_flight(bs);
+        aio_co_enter(bdrv_get_aio_context(bs),
+                     qemu_coroutine_create(qcow2_read_ahead_entry, ra));
+    }
+    s->read_ahead_end = pos;
+}
+
+/*
+ * Copies the compressed cluster at guest offset @offset to @qiov if it has
+ * been read ahead, and keeps reading ahead of sequential reads.
+ *
+ * Returns: true if @qiov was filled in, false if the caller has to read
+ * the cluster itself.
+ */
+static bool coroutine_fn GRAPH_RDLOCK
+qcow2_co_read_ahead(BlockDriverState *bs, uint64_t coffset, int csize,
+                    uint64_t offset, uint64_t bytes,
+                    QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t cluster = start_of_cluster(s, offset);
+    Qcow2ReadAhead *ra;
+    bool hit = false;
+
+    qemu_co_mutex_lock(&s->lock);
+    QTAILQ_FOREACH(ra, &s->read_ahead, next) {
+        if (ra->coffset == coffset && ra->csize == csize) {
+            QTAILQ_REMOVE(&s->read_ahead, ra, next);
+            ra->claimed = true;
+            break;
+        }
+    }
+
+    if (ra || cluster == s->read_ahead_last + s->cluster_size) {
+        qcow2_read_ahead_start(bs, cluster);
+    }
+    s->read_ahead_last = cluster;
+
+    if (ra) {
+        while (!ra->done) {
+            qemu_co_queue_wait(&ra->waiters, &s->lock);
+        }
+        if (ra->ret == 0) {
+            qemu_iovec_from_buf(qiov, qiov_offset,
+                                ra->buf + offset_into_cluster(s, offset),
+                                bytes);
+            hit = true;
+        }
+        qcow2_read_ahead_free(s, ra);
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    return hit;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_preadv_compressed(BlockDriverState *bs,
                            uint64_t l2_entry,
@@ -4834,6 +5129,12 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 
     qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
 
+    if (s->read_ahead_clusters &&
+        qcow2_co_read_ahead(bs, coffset, csize, offset, bytes,
+                            qiov, qiov_offset)) {
+        return 0;
+    }
+
     buf = g_try_malloc(csize);
     if (!buf) {
         return -ENOMEM;
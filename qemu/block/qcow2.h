@@ -150,6 +150,8 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_THREADS "threads"
+#define QCOW2_OPT_COMPRESSED_READ_AHEAD "compressed-read-ahead"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -322,7 +324,20 @@ typedef struct Qcow2BitmapHeaderExt {
     uint64_t bitmap_directory_offset;
 } QEMU_PACKED Qcow2BitmapHeaderExt;
 
-#define QCOW2_MAX_THREADS 4
+/* Limits on compression, decompression and encryption thread pool jobs */
+#define QCOW2_DEFAULT_THREADS 4
+#define QCOW2_MAX_THREADS 1024
+
+/* Maximum number of clusters compressed by a single thread pool job */
+#define QCOW2_MAX_COMPRESS_BATCH 16
+
+/*
+ * Maximum size of the compressed cluster read-ahead window.  Up to two
+ * windows' worth of decompressed clusters can be held at a time.
+ */
+#define QCOW2_MAX_READ_AHEAD_BYTES (32 * MiB)
+
+typedef struct Qcow2ReadAhead Qcow2ReadAhead;
 
 typedef struct BDRVQcow2State {
     int cluster_bits;
@@ -410,6 +425,17 @@ typedef struct BDRVQcow2State {
 
     CoQueue thread_task_queue;
     int nb_threads;
+    int max_threads;
+
+    /*
+     * Compressed clusters being decompressed, or already decompressed,
+     * ahead of sequential reads.  Protected by s->lock.
+     */
+    QTAILQ_HEAD(, Qcow2ReadAhead) read_ahead;
+    int nb_read_ahead;          /* also counts entries taken off the list */
+    int read_ahead_clusters;    /* 0 if read-ahead is disabled */
+    uint64_t read_ahead_last;   /* last compressed cluster read */
+    uint64_t read_ahead_end;    /* read-ahead was started up to here */
 
     BdrvChild *data_file;
 
@@ -848,6 +874,8 @@ int qcow2_validate_table(BlockDriverState *bs, uint64_t offset,
                          int64_t max_size_bytes, const char *table_name,
                          Error **errp);
 
+void qcow2_read_ahead_discard(BlockDriverState *bs, uint64_t host_offset);
+
 /* qcow2-refcount.c functions */
 int coroutine_fn GRAPH_RDLOCK qcow2_refcount_init(BlockDriverState *bs);
 void qcow2_refcount_close(BlockDriverState *bs);
@@ -1061,6 +1089,10 @@ uint64_t qcow2_get_persistent_dirty_bitmap_size(BlockDriverState *bs,
 ssize_t coroutine_fn
 qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
                   const void *src, size_t src_size);
+void coroutine_fn
+qcow2_co_compress_batch(BlockDriverState *bs, void *dest, size_t dest_size,
+                        const void *src, size_t src_size, int n,
+                        ssize_t *out_len);
 ssize_t coroutine_fn
 qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
                     const void *src, size_t src_size);
@@ -0,0 +1,869 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * read-cache filter driver
+ *
+ * The driver keeps a copy of the most recently read clusters of its child
+ * in a cache file, typically on fast local storage, and serves reads of
+ * these clusters from there.  The cache file is bounded in size, clusters
+ * are evicted in LRU order and the index of cached clusters persists across
+ * restarts of QEMU, so that it is useful in front of slow children like NBD
+ * or NFS exports.
+ *
+ * Cache file layout (all fields big-endian):
+ *
+ *   [0, 4k)            ReadCacheHeader
+ *   [4k, ...)          one ReadCacheIndexEntry per slot
+ *   [data_offset, ...) one cluster per slot, data_offset is cluster aligned
+ *
+ * While the cache file is in use, the header is marked dirty and the index
+ * on disk is stale.  It is only written back, and the dirty flag cleared,
+ * when the node is closed or inactivated.  After a crash the cache file is
+ * thus found dirty and starts empty again.
+ *
+ * The child must not be modified other than through this node while the
+ * cache file is in use, nor between two uses of the same cache file.
+ * Writes through the node invalidate the clusters they touch.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qobject/qdict.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "trace.h"
+
+#define READ_CACHE_MAGIC        0x51524346 /* "QRCF" */
+#define READ_CACHE_VERSION      1
+#define READ_CACHE_HEADER_SIZE  4096
+
+#define READ_CACHE_FLAG_DIRTY   (1 << 0)
+
+#define READ_CACHE_DEFAULT_CLUSTER_SIZE (64 * KiB)
+#define READ_CACHE_MIN_CLUSTER_SIZE     (4 * KiB)
+#define READ_CACHE_MAX_CLUSTER_SIZE     (2 * MiB)
+#define READ_CACHE_MAX_SLOTS            (16 * MiB)
+
+/* Maximum number of bytes read from the child for one run of misses */
+#define READ_CACHE_MAX_FILL     (1 * MiB)
+
+/* Cluster index of a slot that does not cache anything */
+#define READ_CACHE_FREE         UINT64_MAX
+
+typedef struct ReadCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t flags;
+    uint64_t cluster_size;
+    uint64_t nb_slots;
+    uint64_t source_size;
+} QEMU_PACKED ReadCacheHeader;
+
+typedef struct ReadCacheIndexEntry {
+    uint64_t cluster;
+    uint64_t seq; /* higher values were used more recently */
+} QEMU_PACKED ReadCacheIndexEntry;
+
+typedef enum ReadCacheSlotState {
+    SLOT_FREE,
+    SLOT_FILLING,
+    SLOT_VALID,
+} ReadCacheSlotState;
+
+typedef struct ReadCacheSlot {
+    /* Key in BDRVReadCacheState.map, READ_CACHE_FREE if not in the map */
+    uint64_t cluster;
+    ReadCacheSlotState state;
+    /* Number of requests reading the slot; it must not be reused until 0 */
+    unsigned readers;
+    /* Linked into BDRVReadCacheState.lru unless SLOT_FILLING */
+    QTAILQ_ENTRY(ReadCacheSlot) next;
+} ReadCacheSlot;
+
+typedef struct BDRVReadCacheState {
+    BdrvChild *cache_file;
+    uint64_t cluster_size;
+    uint64_t nb_slots;
+    int64_t data_offset;
+
+    /* Protects the fields below */
+    QemuMutex lock;
+
+    /* false while the node is inactive, reads then bypass the cache */
+    bool active;
+    ReadCacheSlot *slots;
+    GHashTable *map;
+    /* Most recently used first, free slots at the end */
+    QTAILQ_HEAD(, ReadCacheSlot) lru;
+    /* Incremented by each write, so that stale reads are not cached */
+    uint64_t write_gen;
+    int64_t source_size;
+} BDRVReadCacheState;
+
+static QemuOptsList runtime_opts = {
+    .name = "read-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = "size",
+            .type = QEMU_OPT_SIZE,
+            .help = "Maximum size of the cached data",
+        },
+        {
+            .name = "cluster-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "Granularity of caching and eviction",
+        },
+        { /* end of list */ }
+    },
+};
+
+static int64_t read_cache_slot_offset(BDRVReadCacheState *s,
+                                      ReadCacheSlot *slot)
+{
+    return s->data_offset + (slot - s->slots) * s->cluster_size;
+}
+
+/* Called with s->lock held */
+static void read_cache_drop_slot(BDRVReadCacheState *s, ReadCacheSlot *slot)
+{
+    g_hash_table_remove(s->map, &slot->cluster);
+    slot->cluster = READ_CACHE_FREE;
+
+    /* A slot that is being filled is freed when the write completes */
+    if (slot->state == SLOT_VALID) {
+        slot->state = SLOT_FREE;
+        QTAILQ_REMOVE(&s->lru, slot, next);
+        QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+    }
+}
+
+/*
+ * Forget the clusters that intersect [@offset, @offset + @bytes) and make
+ * sure that data read from the child before this call is not inserted.
+ */
+static void read_cache_invalidate(BDRVReadCacheState *s, uint64_t offset,
+                                  uint64_t bytes)
+{
+    uint64_t first, last, c;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    s->write_gen++;
+    if (!bytes) {
+        return;
+    }
+
+    first = offset / s->cluster_size;
+    last = (offset + bytes - 1) / s->cluster_size;
+
+    if (last - first >= s->nb_slots) {
+        for (c = 0; c < s->nb_slots; c++) {
+            ReadCacheSlot *slot = &s->slots[c];
+
+            if (slot->cluster >= first && slot->cluster <= last) {
+                read_cache_drop_slot(s, slot);
+            }
+        }
+        return;
+    }
+
+    for (c = first; c <= last; c++) {
+        ReadCacheSlot *slot = g_hash_table_lookup(s->map, &c);
+
+        if (slot) {
+            read_cache_drop_slot(s, slot);
+        }
+    }
+}
+
+/*
+ * Returns the slot caching @cluster, with a reference that must be dropped
+ * with read_cache_put(), or NULL on a miss.
+ */
+static ReadCacheSlot *read_cache_get(BDRVReadCacheState *s, uint64_t cluster)
+{
+    ReadCacheSlot *slot;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    slot = g_hash_table_lookup(s->map, &cluster);
+    if (!slot || slot->state != SLOT_VALID) {
+        return NULL;
+    }
+
+    slot->readers++;
+    QTAILQ_REMOVE(&s->lru, slot, next);
+    QTAILQ_INSERT_HEAD(&s->lru, slot, next);
+    return slot;
+}
+
+static void read_cache_put(BDRVReadCacheState *s, ReadCacheSlot *slot)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+
+    assert(slot->readers > 0);
+    slot->readers--;
+}
+
+static bool read_cache_contains(BDRVReadCacheState *s, uint64_t cluster)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+
+    return g_hash_table_contains(s->map, &cluster);
+}
+
+/*
+ * Write @buf to a free or the least recently used slot and make it cache
+ * @cluster, unless the cluster was written since @gen was sampled.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+read_cache_co_insert(BlockDriverState *bs, uint64_t cluster, const void *buf,
+                     uint64_t gen)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheSlot *slot;
+    int ret;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (!s->active || s->write_gen != gen ||
+            g_hash_table_contains(s->map, &cluster))
+        {
+            return;
+        }
+
+        slot = QTAILQ_LAST(&s->lru);
+        while (slot && slot->readers) {
+            slot = QTAILQ_PREV(slot, next);
+        }
+        if (!slot) {
+            return;
+        }
+
+        if (slot->state == SLOT_VALID) {
+            trace_read_cache_evict(bs, slot->cluster * s->cluster_size);
+            g_hash_table_remove(s->map, &slot->cluster);
+        }
+        QTAILQ_REMOVE(&s->lru, slot, next);
+        slot->cluster = cluster;
+        slot->state = SLOT_FILLING;
+        g_hash_table_insert(s->map, &slot->cluster, slot);
+    }
+
+    ret = bdrv_co_pwrite(s->cache_file, read_cache_slot_offset(s, slot),
+                         s->cluster_size, buf, 0);
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (ret < 0 || slot->cluster != cluster) {
+            /* Failed or invalidated in the meantime */
+            if (slot->cluster == cluster) {
+                g_hash_table_remove(s->map, &slot->cluster);
+                slot->cluster = READ_CACHE_FREE;
+            }
+            slot->state = SLOT_FREE;
+            QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+        } else {
+            slot->state = SLOT_VALID;
+            QTAILQ_INSERT_HEAD(&s->lru, slot, next);
+        }
+    }
+}
+
+/*
+ * Read the clusters [@cluster, @end) from the child, copy the requested
+ * part into @qiov and insert them into the cache.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_fill(BlockDriverState *bs, uint64_t cluster, uint64_t end,
+                   int64_t offset, int64_t bytes, QEMUIOVector *qiov,
+                   size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int64_t start = cluster * s->cluster_size;
+    int64_t buf_size = (end - cluster) * s->cluster_size;
+    int64_t len;
+    uint64_t gen;
+    uint64_t c;
+    uint8_t *buf;
+    int ret;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        gen = s->write_gen;
+        len = MIN(start + buf_size, s->source_size) - start;
+    }
+
+    buf = qemu_try_blockalign(bs->file->bs, buf_size);
+    if (len <= 0 || !buf) {
+        qemu_vfree(buf);
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    trace_read_cache_miss(bs, start, len);
+
+    /* buf is a bounce buffer, not the caller's registered one */
+    ret = bdrv_co_pread(bs->file, start, len, buf,
+                        flags & ~BDRV_REQ_REGISTERED_BUF);
+    if (ret < 0) {
+        goto out;
+    }
+    memset(buf + len, 0, buf_size - len);
+
+    qemu_iovec_from_buf(qiov, qiov_offset, buf + offset - start, bytes);
+
+    for (c = cluster; c < end; c++) {
+        read_cache_co_insert(bs, c, buf + (c - cluster) * s->cluster_size,
+                             gen);
+    }
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t max_fill = MAX(READ_CACHE_MAX_FILL / s->cluster_size, 1);
+    int ret;
+
+    if (!qatomic_read(&s->active)) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    while (bytes) {
+        uint64_t cluster = offset / s->cluster_size;
+        ReadCacheSlot *slot;
+        int64_t n;
+
+        slot = read_cache_get(s, cluster);
+        if (slot) {
+            n = MIN(bytes, (cluster + 1) * s->cluster_size - offset);
+
+            trace_read_cache_hit(bs, offset, n);
+            ret = bdrv_co_preadv_part(s->cache_file,
+                                      read_cache_slot_offset(s, slot) +
+                                      offset - cluster * s->cluster_size,
+                                      n, qiov, qiov_offset, 0);
+            read_cache_put(s, slot);
+
+            if (ret < 0) {
+                /* The child still has the data */
+                ret = bdrv_co_preadv_part(bs->file, offset, n, qiov,
+                                          qiov_offset, flags);
+            }
+        } else {
+            /* Read following misses together, the child is slow */
+            uint64_t end = cluster + 1;
+
+            while (end - cluster < max_fill &&
+                   end * s->cluster_size < offset + bytes &&
+                   !read_cache_contains(s, end))
+            {
+                end++;
+            }
+            n = MIN(bytes, end * s->cluster_size - offset);
+
+            ret = read_cache_co_fill(bs, cluster, end, offset, n, qiov,
+                                     qiov_offset, flags);
+        }
+
+        if (ret < 0) {
+            return ret;
+        }
+
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * Writes invalidate the cached clusters both before and after they are
+ * passed to the child, so that neither cached data nor concurrent misses
+ * can leave the old content in the cache.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pwritev_part(BlockDriverState *bs, int64_t offset,
+                           int64_t bytes, QEMUIOVector *qiov,
+                           size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_invalidate(s, offset, bytes);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    read_cache_invalidate(s, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_invalidate(s, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    read_cache_invalidate(s, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_invalidate(s, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    read_cache_invalidate(s, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                       PreallocMode prealloc, BdrvRequestFlags flags,
+                       Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t start;
+    int64_t len;
+    int ret;
+
+    /* The last cluster may be partial, drop everything from there on */
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        start = MIN(s->source_size, offset);
+    }
+    read_cache_invalidate(s, start, UINT64_MAX - start);
+
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+
+    len = bdrv_co_getlength(bs->file->bs);
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (len >= 0) {
+            s->source_size = len;
+        }
+        start = MIN(s->source_size, start);
+    }
+    read_cache_invalidate(s, start, UINT64_MAX - start);
+
+    return ret;
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+read_cache_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+typedef struct ReadCacheLoadEntry {
+    uint64_t seq;
+    uint64_t slot;
+} ReadCacheLoadEntry;
+
+static int read_cache_load_entry_cmp(const void *a, const void *b)
+{
+    const ReadCacheLoadEntry *ea = a;
+    const ReadCacheLoadEntry *eb = b;
+
+    /* Most recently used first */
+    return ea->seq < eb->seq ? 1 : ea->seq > eb->seq ? -1 : 0;
+}
+
+static void read_cache_write_header(BDRVReadCacheState *s,
+                                    ReadCacheHeader *header, uint64_t flags)
+{
+    *header = (ReadCacheHeader) {
+        .magic          = cpu_to_be32(READ_CACHE_MAGIC),
+        .version        = cpu_to_be32(READ_CACHE_VERSION),
+        .flags          = cpu_to_be64(flags),
+        .cluster_size   = cpu_to_be64(s->cluster_size),
+        .nb_slots       = cpu_to_be64(s->nb_slots),
+        .source_size    = cpu_to_be64(s->source_size),
+    };
+}
+
+/*
+ * Start using the cache file: read its index if it is valid for the current
+ * configuration and child, and mark it dirty.
+ */
+static int coroutine_mixed_fn GRAPH_RDLOCK
+read_cache_load(BlockDriverState *bs, Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    g_autofree ReadCacheIndexEntry *index = NULL;
+    g_autofree ReadCacheLoadEntry *entries = NULL;
+    uint64_t index_size = s->nb_slots * sizeof(ReadCacheIndexEntry);
+    uint64_t nb_entries = 0;
+    ReadCacheHeader header;
+    int64_t source_size, file_size, required_size;
+    bool valid = false;
+    uint64_t i;
+    int ret;
+
+    if (bdrv_is_read_only(s->cache_file->bs)) {
+        error_setg(errp, "The cache file must be writable");
+        return -EACCES;
+    }
+
+    source_size = bdrv_getlength(bs->file->bs);
+    if (source_size < 0) {
+        error_setg_errno(errp, -source_size, "Could not get the image size");
+        return source_size;
+    }
+
+    file_size = bdrv_getlength(s->cache_file->bs);
+    if (file_size < 0) {
+        error_setg_errno(errp, -file_size, "Could not get the cache file size");
+        return file_size;
+    }
+
+    index = g_try_malloc(index_size);
+    if (!index) {
+        error_setg(errp, "Could not allocate the cache index");
+        return -ENOMEM;
+    }
+
+    if (file_size >= s->data_offset) {
+        ret = bdrv_pread(s->cache_file, 0, sizeof(header), &header, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the cache header");
+            return ret;
+        }
+
+        valid = be32_to_cpu(header.magic) == READ_CACHE_MAGIC &&
+                be32_to_cpu(header.version) == READ_CACHE_VERSION &&
+                !(be64_to_cpu(header.flags) & READ_CACHE_FLAG_DIRTY) &&
+                be64_to_cpu(header.cluster_size) == s->cluster_size &&
+                be64_to_cpu(header.nb_slots) == s->nb_slots &&
+                be64_to_cpu(header.source_size) == source_size;
+    }
+
+    if (valid) {
+        ret = bdrv_pread(s->cache_file, READ_CACHE_HEADER_SIZE, index_size,
+                         index, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the cache index");
+            return ret;
+        }
+    }
+
+    required_size = s->data_offset + s->nb_slots * s->cluster_size;
+    if (file_size < required_size) {
+        ret = bdrv_truncate(s->cache_file, required_size, false,
+                            PREALLOC_MODE_OFF, 0, errp);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    qemu_mutex_lock(&s->lock);
+
+    s->source_size = source_size;
+    g_hash_table_remove_all(s->map);
+    QTAILQ_INIT(&s->lru);
+    entries = g_new(ReadCacheLoadEntry, s->nb_slots);
+
+    for (i = 0; i < s->nb_slots; i++) {
+        ReadCacheSlot *slot = &s->slots[i];
+        uint64_t cluster = valid ? be64_to_cpu(index[i].cluster) :
+                                   READ_CACHE_FREE;
+
+        *slot = (ReadCacheSlot) {
+            .cluster = READ_CACHE_FREE,
+            .state = SLOT_FREE,
+        };
+
+        if (cluster != READ_CACHE_FREE &&
+            cluster < DIV_ROUND_UP(source_size, s->cluster_size) &&
+            !g_hash_table_contains(s->map, &cluster))
+        {
+            slot->cluster = cluster;
+            slot->state = SLOT_VALID;
+            g_hash_table_insert(s->map, &slot->cluster, slot);
+            entries[nb_entries++] = (ReadCacheLoadEntry) {
+                .seq = be64_to_cpu(index[i].seq),
+                .slot = i,
+            };
+        } else {
+            QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+        }
+    }
+
+    qsort(entries, nb_entries, sizeof(entries[0]), read_cache_load_entry_cmp);
+    for (i = nb_entries; i > 0; i--) {
+        QTAILQ_INSERT_HEAD(&s->lru, &s->slots[entries[i - 1].slot], next);
+    }
+
+    read_cache_write_header(s, &header, READ_CACHE_FLAG_DIRTY);
+    qemu_mutex_unlock(&s->lock);
+
+    ret = bdrv_pwrite_sync(s->cache_file, 0, sizeof(header), &header, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write the cache header");
+        return ret;
+    }
+
+    trace_read_cache_load(bs, nb_entries, s->nb_slots);
+
+    qatomic_set(&s->active, true);
+    return 0;
+}
+
+/* Stop using the cache file and write back its index */
+static int coroutine_mixed_fn GRAPH_RDLOCK
+read_cache_store(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t index_size = s->nb_slots * sizeof(ReadCacheIndexEntry);
+    g_autofree ReadCacheIndexEntry *index = NULL;
+    ReadCacheHeader header;
+    ReadCacheSlot *slot;
+    uint64_t i, seq = 0;
+    int ret;
+
+    index = g_try_malloc(index_size);
+
+    qemu_mutex_lock(&s->lock);
+    qatomic_set(&s->active, false);
+
+    if (index) {
+        for (i = 0; i < s->nb_slots; i++) {
+            index[i] = (ReadCacheIndexEntry) {
+                .cluster = cpu_to_be64(READ_CACHE_FREE),
+            };
+        }
+        QTAILQ_FOREACH_REVERSE(slot, &s->lru, next) {
+            if (slot->state == SLOT_VALID) {
+                index[slot - s->slots] = (ReadCacheIndexEntry) {
+                    .cluster = cpu_to_be64(slot->cluster),
+                    .seq = cpu_to_be64(++seq),
+                };
+            }
+        }
+    }
+    read_cache_write_header(s, &header, 0);
+    qemu_mutex_unlock(&s->lock);
+
+    if (!index) {
+        /* Leave the cache file dirty, it will start empty next time */
+        error_report("Could not allocate the index of cache file '%s'",
+                     bdrv_get_node_name(s->cache_file->bs));
+        return -ENOMEM;
+    }
+
+    ret = bdrv_pwrite_sync(s->cache_file, READ_CACHE_HEADER_SIZE, index_size,
+                           index, 0);
+    if (ret < 0) {
+        error_report("Failed to write the index of cache file '%s': %s",
+                     bdrv_get_node_name(s->cache_file->bs), strerror(-ret));
+        return ret;
+    }
+
+    ret = bdrv_pwrite_sync(s->cache_file, 0, sizeof(header), &header, 0);
+    if (ret < 0) {
+        error_report("Failed to write the header of cache file '%s': %s",
+                     bdrv_get_node_name(s->cache_file->bs), strerror(-ret));
+        return ret;
+    }
+
+    trace_read_cache_store(bs, seq, s->nb_slots);
+    return 0;
+}
+
+static int read_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                           Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    const QDictEntry *e;
+    QemuOpts *opts;
+    uint64_t size;
+    int ret;
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    size = qemu_opt_get_size(opts, "size", 0);
+    s->cluster_size = qemu_opt_get_size(opts, "cluster-size",
+                                        READ_CACHE_DEFAULT_CLUSTER_SIZE);
+
+    if (!is_power_of_2(s->cluster_size) ||
+        s->cluster_size < READ_CACHE_MIN_CLUSTER_SIZE ||
+        s->cluster_size > READ_CACHE_MAX_CLUSTER_SIZE)
+    {
+        error_setg(errp, "Cluster size must be a power of two between 4k "
+                   "and 2M");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    s->nb_slots = size / s->cluster_size;
+    if (!s->nb_slots || s->nb_slots > READ_CACHE_MAX_SLOTS) {
+        error_setg(errp, "Cache size must be between one and %" PRIu64
+                   " clusters", (uint64_t)READ_CACHE_MAX_SLOTS);
+        ret = -EINVAL;
+        goto out;
+    }
+    s->data_offset = ROUND_UP(READ_CACHE_HEADER_SIZE +
+                              s->nb_slots * sizeof(ReadCacheIndexEntry),
+                              s->cluster_size);
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        goto out;
+    }
+
+    /*
+     * The cache file is written even if the node is read-only, which is the
+     * common case for base images.
+     */
+    for (e = qdict_first(options); e; e = qdict_next(options, e)) {
+        if (strstart(qdict_entry_key(e), "cache-file.", NULL)) {
+            qdict_set_default_str(options, "cache-file." BDRV_OPT_READ_ONLY,
+                                  "off");
+            break;
+        }
+    }
+    s->cache_file = bdrv_open_child(NULL, options, "cache-file", bs,
+                                    &child_of_bds, BDRV_CHILD_METADATA,
+                                    false, errp);
+    if (!s->cache_file) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    qemu_mutex_init(&s->lock);
+    s->slots = g_new0(ReadCacheSlot, s->nb_slots);
+    s->map = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+            (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+            ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+             bs->file->bs->supported_zero_flags);
+
+    if (!(flags & BDRV_O_INACTIVE)) {
+        bdrv_graph_rdlock_main_loop();
+        ret = read_cache_load(bs, errp);
+        bdrv_graph_rdunlock_main_loop();
+    }
+
+    if (ret < 0) {
+        g_hash_table_destroy(s->map);
+        g_free(s->slots);
+        qemu_mutex_destroy(&s->lock);
+
+        bdrv_graph_wrlock();
+        bdrv_unref_child(bs, s->cache_file);
+        s->cache_file = NULL;
+        bdrv_graph_wrunlock();
+    }
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void read_cache_close(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    if (s->active) {
+        GRAPH_RDLOCK_GUARD_MAINLOOP();
+        read_cache_store(bs);
+    }
+
+    g_hash_table_destroy(s->map);
+    g_free(s->slots);
+    qemu_mutex_destroy(&s->lock);
+}
+
+static int GRAPH_RDLOCK read_cache_inactivate(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    if (!s->active) {
+        return 0;
+    }
+    return read_cache_store(bs);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+read_cache_co_invalidate_cache(BlockDriverState *bs, Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    if (!s->active) {
+        read_cache_load(bs, errp);
+    }
+}
+
+static void read_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                  BdrvChildRole role,
+                                  BlockReopenQueue *reopen_queue,
+                                  uint64_t perm, uint64_t shared,
+                                  uint64_t *nperm, uint64_t *nshared)
+{
+    if (role & BDRV_CHILD_FILTERED) {
+        bdrv_default_perms(bs, c, role, reopen_queue,
+                           perm, shared, nperm, nshared);
+        return;
+    }
+
+    /* The cache file belongs to this node alone */
+    *nperm = BLK_PERM_CONSISTENT_READ;
+    *nshared = BLK_PERM_CONSISTENT_READ;
+
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        *nperm |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+    }
+}
+
+static BlockDriver bdrv_read_cache = {
+    .format_name                = "read-cache",
+    .instance_size              = sizeof(BDRVReadCacheState),
+
+    .bdrv_open                  = read_cache_open,
+    .bdrv_close                 = read_cache_close,
+    .bdrv_child_perm            = read_cache_child_perm,
+    .bdrv_inactivate            = read_cache_inactivate,
+    .bdrv_co_invalidate_cache   = read_cache_co_invalidate_cache,
+
+    .bdrv_co_getlength          = read_cache_co_getlength,
+    .bdrv_co_truncate           = read_cache_co_truncate,
+
+    .bdrv_co_preadv_part        = read_cache_co_preadv_part,
+    .bdrv_co_pwritev_part       = read_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes      = read_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard           = read_cache_co_pdiscard,
+
+    .is_filter                  = true,
+};
+
+static void bdrv_read_cache_init(void)
+{
+    bdrv_register(&bdrv_read_cache);
+}
+
+block_init(bdrv_read_cache_init);
@@ -29,11 +29,21 @@
 #include "qemu/main-loop.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/units.h"
 #include "system/qtest.h"
 #include "qapi/error.h"
 #include "qapi/qapi-visit-block-core.h"
 #include "qom/object.h"
 #include "qom/object_interfaces.h"
+#include "trace.h"
+
+/* How often the cap on best-effort members is reconsidered; the latency
+ * of protected members is sampled over twice this period */
+#define THROTTLE_QOS_INTERVAL_NS  (500 * SCALE_MS)
+
+/* Best-effort members are never slowed down below these rates */
+#define THROTTLE_QOS_MIN_IOPS     10
+#define THROTTLE_QOS_MIN_BPS      (1 * MiB)
 
 static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
@@ -62,6 +72,14 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
  * blk_set_aio_context()). Therefore in this file a thread will
  * access some other ThrottleGroupMember's timers only after verifying that
  * that ThrottleGroupMember has throttled requests in the queue.
+ *
+ * Members with a latency target are protected.  While any of them
+ * misses its target, the remaining (best-effort) members are subject
+ * to an additional limit, be_ts, that is lowered multiplicatively and
+ * raised again once the protected members are back under their
+ * targets.  A best-effort member waiting for be_ts has its timer armed
+ * like any other throttled member, but it is tracked in be_tokens and
+ * be_timer_armed so that it doesn't hold back the protected members.
  */
 struct ThrottleGroup {
     Object parent_obj;
@@ -70,13 +88,22 @@ struct ThrottleGroup {
     bool is_initialized;
     char *name; /* This is constant during the lifetime of the group */
 
-    QemuMutex lock; /* This lock protects the following four fields */
+    QemuMutex lock; /* This lock protects the following fields */
     ThrottleState ts;
     QLIST_HEAD(, ThrottleGroupMember) head;
     ThrottleGroupMember *tokens[THROTTLE_MAX];
     bool any_timer_armed[THROTTLE_MAX];
     QEMUClockType clock_type;
 
+    /* Latency QoS state, see above */
+    ThrottleState be_ts;
+    bool be_limited;
+    ThrottleGroupMember *be_tokens[THROTTLE_MAX];
+    bool be_timer_armed[THROTTLE_MAX];
+    uint64_t be_ops;    /* best-effort requests since qos_last_update */
+    uint64_t be_bytes;  /* best-effort bytes since qos_last_update */
+    int64_t qos_last_update;
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 };
@@ -206,18 +233,47 @@ static inline bool tgm_has_pending_reqs(ThrottleGroupMember *tgm,
     return tgm->pending_reqs[direction];
 }
 
+/*
+ * Return whether a ThrottleGroupMember has a latency target.
+ *
+ * This assumes that tg->lock is held.
+ */
+static inline bool tgm_is_protected(ThrottleGroupMember *tgm)
+{
+    return tgm->latency_target != 0;
+}
+
+/*
+ * Return whether a ThrottleGroupMember can be given the token.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:            the ThrottleGroupMember
+ * @direction:      the ThrottleDirection
+ * @protected_only: whether best-effort members must be skipped
+ */
+static inline bool tgm_can_take_token(ThrottleGroupMember *tgm,
+                                      ThrottleDirection direction,
+                                      bool protected_only)
+{
+    return tgm_has_pending_reqs(tgm, direction) &&
+           (!protected_only || tgm_is_protected(tgm));
+}
+
 /* Return the next ThrottleGroupMember in the round-robin sequence with pending
  * I/O requests.
  *
  * This assumes that tg->lock is held.
  *
- * @tgm:       the current ThrottleGroupMember
- * @direction: the ThrottleDirection
- * @ret:       the next ThrottleGroupMember with pending requests, or tgm if
- *             there is none.
+ * @tgm:            the current ThrottleGroupMember
+ * @direction:      the ThrottleDirection
+ * @protected_only: whether to skip members without a latency target
+ * @ret:            the next ThrottleGroupMember with pending requests, or
+ *                  tgm if there is none.
  */
 static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
-                                                ThrottleDirection direction)
+                                                ThrottleDirection direction,
+                                                bool protected_only)
 {
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
@@ -236,7 +292,8 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
 
     /* get next bs round in round robin style */
     token = throttle_group_next_tgm(token);
-    while (token != start && !tgm_has_pending_reqs(token, direction)) {
+    while (token != start &&
+           !tgm_can_take_token(token, direction, protected_only)) {
         token = throttle_group_next_tgm(token);
     }
 
@@ -244,7 +301,8 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
      * then decide the token is the current tgm because chances are
      * the current tgm got the current request queued.
      */
-    if (token == start && !tgm_has_pending_reqs(token, direction)) {
+    if (token == start &&
+        !tgm_can_take_token(token, direction, protected_only)) {
         token = tgm;
     }
 
@@ -270,6 +328,7 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     ThrottleTimers *tt = &tgm->throttle_timers;
+    bool best_effort = !tgm_is_protected(tgm);
     bool must_wait;
 
     if (qatomic_read(&tgm->io_limits_disabled)) {
@@ -277,7 +336,8 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     }
 
     /* Check if any of the timers in this group is already armed */
-    if (tg->any_timer_armed[direction]) {
+    if (tg->any_timer_armed[direction] ||
+        (best_effort && tg->be_timer_armed[direction])) {
         return true;
     }
 
@@ -287,11 +347,40 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     if (must_wait) {
         tg->tokens[direction] = tgm;
         tg->any_timer_armed[direction] = true;
+    } else if (best_effort && tg->be_limited) {
+        must_wait = throttle_schedule_timer(&tg->be_ts, tt, direction);
+        if (must_wait) {
+            tg->be_tokens[direction] = tgm;
+            tg->be_timer_armed[direction] = true;
+        }
     }
 
     return must_wait;
 }
 
+/* Clear the flag for the timer that a ThrottleGroupMember has armed.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the ThrottleGroupMember whose timer has fired
+ * @direction: the ThrottleDirection
+ * @ret:       whether the timer was armed for the best-effort limit
+ */
+static bool throttle_group_clear_timer(ThrottleGroupMember *tgm,
+                                       ThrottleDirection direction)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+
+    if (tg->be_timer_armed[direction] && tg->be_tokens[direction] == tgm) {
+        tg->be_timer_armed[direction] = false;
+        return true;
+    }
+
+    tg->any_timer_armed[direction] = false;
+    return false;
+}
+
 /* Start the next pending I/O request for a ThrottleGroupMember. Return whether
  * any request was actually pending.
  *
@@ -326,7 +415,7 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
     ThrottleGroupMember *token;
 
     /* Check if there's any pending request to schedule next */
-    token = next_throttle_token(tgm, direction);
+    token = next_throttle_token(tgm, direction, false);
     if (!tgm_has_pending_reqs(token, direction)) {
         return;
     }
@@ -334,10 +423,22 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
     /* Set a timer for the request if it needs to be throttled */
     must_wait = throttle_group_schedule_timer(token, direction);
 
+    /* A best-effort member that is over its limit must not hold back
+     * the protected ones */
+    if (must_wait && !tg->any_timer_armed[direction]) {
+        token = next_throttle_token(tgm, direction, true);
+        if (!tgm_can_take_token(token, direction, true)) {
+            return;
+        }
+        must_wait = throttle_group_schedule_timer(token, direction);
+    }
+
     /* If it doesn't have to wait, queue it for immediate execution */
     if (!must_wait) {
-        /* Give preference to requests from the current tgm */
+        /* Give preference to requests from the current tgm, unless
+         * that would let it skip the turn of a protected member */
         if (qemu_in_coroutine() &&
+            (tgm_is_protected(tgm) || !tgm_is_protected(token)) &&
             throttle_group_co_restart_queue(tgm, direction)) {
             token = tgm;
         } else {
@@ -350,6 +451,101 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
     }
 }
 
+/* Lift the limit on best-effort members.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_lift_qos_limit(ThrottleGroup *tg)
+{
+    if (tg->be_limited) {
+        tg->be_limited = false;
+        trace_throttle_group_qos_limit(tg->name, 0, 0);
+    }
+}
+
+/* Adapt the limit on best-effort members to the latency of the protected
+ * members.  This is done at most once per THROTTLE_QOS_INTERVAL_NS: if
+ * any protected member missed its target, the best-effort members are
+ * limited to 3/4 of the rate that they achieved in the last interval.
+ * Otherwise the limit is raised by 1/8, and lifted once the best-effort
+ * members use less than half of it.
+ *
+ * The worst latency over the sampling window is compared to the target,
+ * which is a conservative approximation of a percentile target.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_update_qos(ThrottleGroup *tg)
+{
+    int64_t now = qemu_clock_get_ns(tg->clock_type);
+    int64_t elapsed = now - tg->qos_last_update;
+    ThrottleGroupMember *tgm;
+    bool has_protected = false;
+    bool over_target = false;
+    uint64_t iops, bps, ops;
+    ThrottleConfig cfg;
+    LeakyBucket *iops_bkt, *bps_bkt;
+
+    if (elapsed < THROTTLE_QOS_INTERVAL_NS) {
+        return;
+    }
+
+    QLIST_FOREACH(tgm, &tg->head, round_robin) {
+        if (tgm_is_protected(tgm)) {
+            has_protected = true;
+            if (timed_average_max(&tgm->latency) > tgm->latency_target) {
+                over_target = true;
+            }
+        }
+    }
+
+    /* Best-effort throughput during the last interval */
+    ops = tg->be_ops;
+    iops = (double) tg->be_ops * NANOSECONDS_PER_SECOND / elapsed;
+    bps = (double) tg->be_bytes * NANOSECONDS_PER_SECOND / elapsed;
+    tg->be_ops = 0;
+    tg->be_bytes = 0;
+    tg->qos_last_update = now;
+
+    if (!has_protected) {
+        throttle_group_lift_qos_limit(tg);
+        return;
+    }
+
+    throttle_get_config(&tg->be_ts, &cfg);
+    iops_bkt = &cfg.buckets[THROTTLE_OPS_TOTAL];
+    bps_bkt = &cfg.buckets[THROTTLE_BPS_TOTAL];
+
+    if (over_target) {
+        if (!ops) {
+            /* Best-effort members are idle, there is nothing to take */
+            return;
+        }
+        if (tg->be_limited) {
+            iops = MIN(iops, iops_bkt->avg);
+            bps = MIN(bps, bps_bkt->avg);
+        }
+        iops = MAX(iops - iops / 4, THROTTLE_QOS_MIN_IOPS);
+        bps = MAX(bps - bps / 4, THROTTLE_QOS_MIN_BPS);
+    } else if (tg->be_limited) {
+        if (iops < iops_bkt->avg / 2 && bps < bps_bkt->avg / 2) {
+            throttle_group_lift_qos_limit(tg);
+            return;
+        }
+        iops = iops_bkt->avg + iops_bkt->avg / 8;
+        bps = bps_bkt->avg + bps_bkt->avg / 8;
+    } else {
+        return;
+    }
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_OPS_TOTAL].avg = iops;
+    cfg.buckets[THROTTLE_BPS_TOTAL].avg = bps;
+    throttle_config(&tg->be_ts, tg->clock_type, &cfg);
+    tg->be_limited = true;
+    trace_throttle_group_qos_limit(tg->name, iops, bps);
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
@@ -371,8 +567,11 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     qemu_mutex_lock(&tg->lock);
 
-    /* First we check if this I/O has to be throttled. */
-    token = next_throttle_token(tgm, direction);
+    /* First we check if this I/O has to be throttled.  Protected
+     * members don't wait for their turn behind best-effort members
+     * while these are being slowed down. */
+    token = next_throttle_token(tgm, direction,
+                                tg->be_limited && tgm_is_protected(tgm));
     must_wait = throttle_group_schedule_timer(token, direction);
 
     /* Wait if there's a timer set or queued requests of this type */
@@ -389,6 +588,14 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     /* The I/O will be executed, so do the accounting */
     throttle_account(tgm->throttle_state, direction, bytes);
+    if (!tgm_is_protected(tgm)) {
+        if (tg->be_limited) {
+            throttle_account(&tg->be_ts, direction, bytes);
+        }
+        tg->be_ops++;
+        tg->be_bytes += bytes;
+    }
+    throttle_group_update_qos(tg);
 
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
@@ -499,6 +706,62 @@ void throttle_group_get_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     qemu_mutex_unlock(&tg->lock);
 }
 
+/* Set the completion latency target of a ThrottleGroupMember. While a
+ * member with a target misses it, the members of its group that don't
+ * have one are slowed down.
+ *
+ * The member must not have requests in flight.
+ *
+ * @tgm:            a ThrottleGroupMember that is a member of the group
+ * @latency_target: the target in nanoseconds, or 0 to remove it
+ */
+void throttle_group_set_latency_target(ThrottleGroupMember *tgm,
+                                       uint64_t latency_target)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+
+    QEMU_LOCK_GUARD(&tg->lock);
+    tgm->latency_target = latency_target;
+    timed_average_init(&tgm->latency, tg->clock_type,
+                       2 * THROTTLE_QOS_INTERVAL_NS);
+}
+
+/* Return the current time on the clock used by a ThrottleGroupMember's
+ * group, to be passed later to throttle_group_account_latency().
+ *
+ * @tgm: a ThrottleGroupMember that is a member of the group
+ */
+int64_t throttle_group_clock_ns(ThrottleGroupMember *tgm)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    return qemu_clock_get_ns(tg->clock_type);
+}
+
+/* Account the completion of a request from a ThrottleGroupMember. This
+ * only has an effect if the member has a latency target.
+ *
+ * @tgm:      a ThrottleGroupMember that is a member of the group
+ * @start_ns: the time at which the request was submitted, as returned
+ *            by throttle_group_clock_ns()
+ */
+void throttle_group_account_latency(ThrottleGroupMember *tgm,
+                                    int64_t start_ns)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    int64_t now;
+
+    if (!tgm->latency_target) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tg->lock);
+    now = qemu_clock_get_ns(tg->clock_type);
+    timed_average_account(&tgm->latency, MAX(now - start_ns, 0));
+    throttle_group_update_qos(tg);
+}
+
 /* ThrottleTimers callback. This wakes up a request that was waiting
  * because it had been throttled.
  *
@@ -509,14 +772,22 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction)
 {
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    bool restart = true;
 
     /* The timer has just been fired, so we can update the flag */
     qemu_mutex_lock(&tg->lock);
-    tg->any_timer_armed[direction] = false;
+    if (throttle_group_clear_timer(tgm, direction)) {
+        /* If the group limits are being waited for, the request stays
+         * queued until the round robin reaches this member again */
+        restart = !tg->any_timer_armed[direction] ||
+                  qatomic_read(&tgm->io_limits_disabled);
+    }
     qemu_mutex_unlock(&tg->lock);
 
     /* Run the request that was waiting for this timer */
-    throttle_group_restart_queue(tgm, direction);
+    if (restart) {
+        throttle_group_restart_queue(tgm, direction);
+    }
 }
 
 static void read_timer_cb(void *opaque)
@@ -551,6 +822,8 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
     tgm->throttle_state = ts;
     tgm->aio_context = ctx;
     qatomic_set(&tgm->restart_pending, 0);
+    timed_average_init(&tgm->latency, tg->clock_type,
+                       2 * THROTTLE_QOS_INTERVAL_NS);
 
     QEMU_LOCK_GUARD(&tg->lock);
     /* If the ThrottleGroup is new set this ThrottleGroupMember as the token */
@@ -610,6 +883,9 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
                 }
                 tg->tokens[dir] = token;
             }
+            if (tg->be_tokens[dir] == tgm) {
+                tg->be_tokens[dir] = NULL;
+            }
         }
 
         /* remove the current tgm from the list */
@@ -645,7 +921,7 @@ void throttle_group_detach_aio_context(ThrottleGroupMember *tgm)
     WITH_QEMU_LOCK_GUARD(&tg->lock) {
         for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
             if (timer_pending(tt->timers[dir])) {
-                tg->any_timer_armed[dir] = false;
+                throttle_group_clear_timer(tgm, dir);
                 schedule_next_request(tgm, dir);
             }
         }
@@ -763,6 +1039,7 @@ static void throttle_group_obj_init(Object *obj)
     tg->is_initialized = false;
     qemu_mutex_init(&tg->lock);
     throttle_init(&tg->ts);
+    throttle_init(&tg->be_ts);
     QLIST_INIT(&tg->head);
 }
 
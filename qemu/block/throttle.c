@@ -35,16 +35,28 @@ static QemuOptsList throttle_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Name of the throttle group",
         },
+        {
+            .name = QEMU_OPT_LATENCY_TARGET_NS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Completion latency target in nanoseconds",
+        },
         { /* end of list */ }
     },
 };
 
+typedef struct ThrottleReopenState {
+    char *group;
+    uint64_t latency_target;
+} ThrottleReopenState;
+
 /*
  * If this function succeeds then the throttle group name is stored in
- * @group and must be freed by the caller.
- * If there's an error then @group remains unmodified.
+ * @group and must be freed by the caller, and the latency target is
+ * stored in @latency_target.
+ * If there's an error then @group and @latency_target remain unmodified.
  */
-static int throttle_parse_options(QDict *options, char **group, Error **errp)
+static int throttle_parse_options(QDict *options, char **group,
+                                  uint64_t *latency_target, Error **errp)
 {
     int ret;
     const char *group_name;
@@ -67,6 +79,7 @@ static int throttle_parse_options(QDict *options, char **group, Error **errp)
     }
 
     *group = g_strdup(group_name);
+    *latency_target = qemu_opt_get_number(opts, QEMU_OPT_LATENCY_TARGET_NS, 0);
     ret = 0;
 fin:
     qemu_opts_del(opts);
@@ -77,6 +90,7 @@ static int throttle_open(BlockDriverState *bs, QDict *options,
                          int flags, Error **errp)
 {
     ThrottleGroupMember *tgm = bs->opaque;
+    uint64_t latency_target;
     char *group;
     int ret;
 
@@ -92,10 +106,11 @@ static int throttle_open(BlockDriverState *bs, QDict *options,
     bs->supported_zero_flags = bs->file->bs->supported_zero_flags |
                                BDRV_REQ_WRITE_UNCHANGED;
 
-    ret = throttle_parse_options(options, &group, errp);
+    ret = throttle_parse_options(options, &group, &latency_target, errp);
     if (ret == 0) {
         /* Register membership to group with name group_name */
         throttle_group_register_tgm(tgm, group, bdrv_get_aio_context(bs));
+        throttle_group_set_latency_target(tgm, latency_target);
         g_free(group);
     }
 
@@ -121,9 +136,14 @@ throttle_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
 {
 
     ThrottleGroupMember *tgm = bs->opaque;
+    int64_t start = throttle_group_clock_ns(tgm);
+    int ret;
+
     throttle_group_co_io_limits_intercept(tgm, bytes, THROTTLE_READ);
 
-    return bdrv_co_preadv(bs->file, offset, bytes, qiov, flags);
+    ret = bdrv_co_preadv(bs->file, offset, bytes, qiov, flags);
+    throttle_group_account_latency(tgm, start);
+    return ret;
 }
 
 static int coroutine_fn GRAPH_RDLOCK
@@ -131,9 +151,14 @@ throttle_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
                     QEMUIOVector *qiov, BdrvRequestFlags flags)
 {
     ThrottleGroupMember *tgm = bs->opaque;
+    int64_t start = throttle_group_clock_ns(tgm);
+    int ret;
+
     throttle_group_co_io_limits_intercept(tgm, bytes, THROTTLE_WRITE);
 
-    return bdrv_co_pwritev(bs->file, offset, bytes, qiov, flags);
+    ret = bdrv_co_pwritev(bs->file, offset, bytes, qiov, flags);
+    throttle_group_account_latency(tgm, start);
+    return ret;
 }
 
 static int coroutine_fn GRAPH_RDLOCK
@@ -184,37 +209,45 @@ static void throttle_attach_aio_context(BlockDriverState *bs,
 static int throttle_reopen_prepare(BDRVReopenState *reopen_state,
                                    BlockReopenQueue *queue, Error **errp)
 {
+    ThrottleReopenState *s;
     int ret;
-    char *group = NULL;
 
     assert(reopen_state != NULL);
     assert(reopen_state->bs != NULL);
 
-    ret = throttle_parse_options(reopen_state->options, &group, errp);
-    reopen_state->opaque = group;
+    s = g_new0(ThrottleReopenState, 1);
+    ret = throttle_parse_options(reopen_state->options, &s->group,
+                                 &s->latency_target, errp);
+    reopen_state->opaque = s;
     return ret;
 }
 
+static void throttle_reopen_abort(BDRVReopenState *reopen_state)
+{
+    ThrottleReopenState *s = reopen_state->opaque;
+
+    if (s) {
+        g_free(s->group);
+        g_free(s);
+    }
+    reopen_state->opaque = NULL;
+}
+
 static void throttle_reopen_commit(BDRVReopenState *reopen_state)
 {
     BlockDriverState *bs = reopen_state->bs;
     ThrottleGroupMember *tgm = bs->opaque;
-    char *group = reopen_state->opaque;
+    ThrottleReopenState *s = reopen_state->opaque;
 
-    assert(group);
+    assert(s->group);
 
-    if (strcmp(group, throttle_group_get_name(tgm))) {
+    if (strcmp(s->group, throttle_group_get_name(tgm))) {
         throttle_group_unregister_tgm(tgm);
-        throttle_group_register_tgm(tgm, group, bdrv_get_aio_context(bs));
+        throttle_group_register_tgm(tgm, s->group, bdrv_get_aio_context(bs));
     }
-    g_free(reopen_state->opaque);
-    reopen_state->opaque = NULL;
-}
+    throttle_group_set_latency_target(tgm, s->latency_target);
 
-static void throttle_reopen_abort(BDRVReopenState *reopen_state)
-{
-    g_free(reopen_state->opaque);
-    reopen_state->opaque = NULL;
+    throttle_reopen_abort(reopen_state);
 }
 
 static void throttle_drain_begin(BlockDriverState *bs)
@@ -364,7 +364,8 @@ static int symfind(const void *s0, const void *s1)
     return result;
 }
 
-static const char *lookup_symbolxx(struct syminfo *s, uint64_t orig_addr)
+static const char *lookup_symbolxx(struct syminfo *s, uint64_t orig_addr,
+                                   uint64_t *offset)
 {
 #if ELF_CLASS == ELFCLASS32
     struct elf_sym *syms = s->disas_symtab.elf32;
@@ -377,6 +378,9 @@ static const char *lookup_symbolxx(struct syminfo *s, uint64_t orig_addr)
 
     sym = bsearch(&orig_addr, syms, s->disas_num_syms, sizeof(*syms), symfind);
     if (sym != NULL) {
+        if (offset) {
+            *offset = orig_addr - sym->st_value;
+        }
         return s->disas_strtab + sym->st_name;
     }
 
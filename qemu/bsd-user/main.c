@@ -36,6 +36,7 @@
 #include "qemu/help_option.h"
 #include "qemu/module.h"
 #include "qemu/plugin.h"
+#include "accel/tcg/tb-pretranslate.h"
 #include "exec/exec-all.h"
 #include "user/guest-base.h"
 #include "user/page-protection.h"
@@ -107,6 +108,7 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
+    tb_pretranslate_fork_start();
     cpu_list_lock();
     qemu_plugin_user_prefork_lock();
     gdbserver_fork_start();
@@ -118,6 +120,7 @@ void fork_end(pid_t pid)
 
     qemu_plugin_user_postfork(child);
     mmap_fork_end(child);
+    tb_pretranslate_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
         /*
@@ -113,6 +113,17 @@ static uint64_t l1_dmisses;
 static uint64_t l2_mem_accesses;
 static uint64_t l2_misses;
 
+/*
+ * With buffer=on, data accesses are recorded in a per-vCPU buffer and
+ * simulated in batches, using virtual addresses.  Instructions are then
+ * also keyed by their virtual address, since that is what the records
+ * hold.
+ */
+#define DMEM_BUFFER_RECORDS 4096
+
+static bool use_buffer;
+static struct qemu_plugin_mem_buffer *dmem_buffer;
+
 static int pow_of_two(int num)
 {
     g_assert((num & (num - 1)) == 0);
@@ -427,6 +438,59 @@ static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
     g_mutex_unlock(&l2_ucache_locks[cache_idx]);
 }
 
+static void vcpu_mem_buffer_flush(unsigned int vcpu_index,
+                                  const struct qemu_plugin_mem_record *records,
+                                  size_t n, void *userdata)
+{
+    g_autofree bool *l1_hit = g_new(bool, n);
+    g_autofree bool *l2_hit = use_l2 ? g_new0(bool, n) : NULL;
+    int cache_idx = vcpu_index % cores;
+    InsnData *insn;
+    size_t i;
+
+    g_mutex_lock(&l1_dcache_locks[cache_idx]);
+    for (i = 0; i < n; i++) {
+        l1_hit[i] = access_cache(l1_dcaches[cache_idx], records[i].vaddr);
+        if (!l1_hit[i]) {
+            l1_dcaches[cache_idx]->misses++;
+        }
+    }
+    l1_dcaches[cache_idx]->accesses += n;
+    g_mutex_unlock(&l1_dcache_locks[cache_idx]);
+
+    if (use_l2) {
+        g_mutex_lock(&l2_ucache_locks[cache_idx]);
+        for (i = 0; i < n; i++) {
+            if (l1_hit[i]) {
+                l2_hit[i] = true;
+                continue;
+            }
+            l2_hit[i] = access_cache(l2_ucaches[cache_idx], records[i].vaddr);
+            if (!l2_hit[i]) {
+                l2_ucaches[cache_idx]->misses++;
+            }
+            l2_ucaches[cache_idx]->accesses++;
+        }
+        g_mutex_unlock(&l2_ucache_locks[cache_idx]);
+    }
+
+    g_mutex_lock(&hashtable_lock);
+    for (i = 0; i < n; i++) {
+        if (l1_hit[i]) {
+            continue;
+        }
+        insn = g_hash_table_lookup(miss_ht, &records[i].pc);
+        if (insn == NULL) {
+            continue;
+        }
+        __atomic_fetch_add(&insn->l1_dmisses, 1, __ATOMIC_SEQ_CST);
+        if (use_l2 && !l2_hit[i]) {
+            __atomic_fetch_add(&insn->l2_misses, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    g_mutex_unlock(&hashtable_lock);
+}
+
 static void vcpu_insn_exec(unsigned int vcpu_index, void *userdata)
 {
     uint64_t insn_addr;
@@ -471,8 +535,9 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
     n_insns = qemu_plugin_tb_n_insns(tb);
     for (i = 0; i < n_insns; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
-        uint64_t effective_addr = sys ? (uintptr_t) qemu_plugin_insn_haddr(insn) :
-                                        qemu_plugin_insn_vaddr(insn);
+        uint64_t effective_addr = sys && !use_buffer ?
+                                  (uintptr_t) qemu_plugin_insn_haddr(insn) :
+                                  qemu_plugin_insn_vaddr(insn);
 
         /*
          * Instructions might get translated multiple times, we do not create
@@ -490,9 +555,13 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         }
         g_mutex_unlock(&hashtable_lock);
 
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, data);
+        if (use_buffer) {
+            qemu_plugin_register_vcpu_mem_buffer(insn, rw, dmem_buffer);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, data);
+        }
 
         qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
                                                QEMU_PLUGIN_CB_NO_REGS, data);
@@ -696,6 +765,13 @@ finish:
 
 static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
+    if (dmem_buffer) {
+        for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+            qemu_plugin_mem_buffer_flush(dmem_buffer, i);
+        }
+        qemu_plugin_mem_buffer_free(dmem_buffer);
+    }
+
     log_stats();
     log_top_insns();
 
@@ -797,6 +873,11 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "buffer") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &use_buffer)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else if (g_strcmp0(tokens[0], "evict") == 0) {
             if (g_strcmp0(tokens[1], "rand") == 0) {
                 policy = RAND;
@@ -844,6 +925,11 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     l1_icache_locks = g_new0(GMutex, cores);
     l2_ucache_locks = use_l2 ? g_new0(GMutex, cores) : NULL;
 
+    if (use_buffer) {
+        dmem_buffer = qemu_plugin_mem_buffer_new(DMEM_BUFFER_RECORDS,
+                                                 vcpu_mem_buffer_flush, NULL);
+    }
+
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
 
@@ -0,0 +1,161 @@
+/*
+ * PC sampling profiler
+ *
+ * Unlike hotblocks this plugin does not instrument translated code at
+ * all. Each vCPU is periodically asked for its current PC; samples are
+ * counted per vCPU without locking and symbolized once at exit. The
+ * report uses the "folded stacks" format consumed by flamegraph.pl:
+ *
+ *   [vcpuN;]symbol count
+ *
+ * Only the sampled function is known, guest stacks are not unwound.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t pc;
+    uint64_t count;
+} PCSample;
+
+/* samples of one vCPU, keyed by PC; only touched by that vCPU */
+typedef struct {
+    GHashTable *samples;
+} VCPUSamples;
+
+static struct qemu_plugin_scoreboard *vcpus;
+static unsigned int freq_hz = 1000;
+static bool per_vcpu;
+
+static void vcpu_sample(unsigned int vcpu_index, uint64_t pc, void *udata)
+{
+    VCPUSamples *vs = qemu_plugin_scoreboard_find(vcpus, vcpu_index);
+    PCSample *s;
+
+    if (!vs->samples) {
+        vs->samples = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                            NULL, g_free);
+    }
+    s = g_hash_table_lookup(vs->samples, &pc);
+    if (!s) {
+        s = g_new0(PCSample, 1);
+        s->pc = pc;
+        g_hash_table_insert(vs->samples, &s->pc, s);
+    }
+    s->count++;
+}
+
+static void fold_samples(GHashTable *folded, GHashTable *samples,
+                         unsigned int vcpu_index)
+{
+    GHashTableIter iter;
+    PCSample *s;
+
+    g_hash_table_iter_init(&iter, samples);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &s)) {
+        const char *sym = qemu_plugin_vaddr_symbol(s->pc);
+        g_autofree char *frame = NULL;
+        uint64_t *count;
+
+        if (sym) {
+            frame = per_vcpu ? g_strdup_printf("vcpu%u;%s", vcpu_index, sym)
+                             : g_strdup(sym);
+        } else {
+            frame = per_vcpu ?
+                g_strdup_printf("vcpu%u;0x%" PRIx64, vcpu_index, s->pc) :
+                g_strdup_printf("0x%" PRIx64, s->pc);
+        }
+
+        count = g_hash_table_lookup(folded, frame);
+        if (!count) {
+            count = g_new0(uint64_t, 1);
+            g_hash_table_insert(folded, g_steal_pointer(&frame), count);
+        }
+        *count += s->count;
+    }
+}
+
+static gint cmp_folded(gconstpointer a, gconstpointer b, gpointer d)
+{
+    GHashTable *folded = d;
+    uint64_t ca = *(uint64_t *) g_hash_table_lookup(folded, a);
+    uint64_t cb = *(uint64_t *) g_hash_table_lookup(folded, b);
+
+    return ca > cb ? -1 : ca < cb ? 1 : g_strcmp0(a, b);
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new(NULL);
+    GHashTable *folded = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, g_free);
+    GList *frames, *it;
+    int n = qemu_plugin_num_vcpus();
+
+    /* sampling is stopped by now, vCPU tables can be read safely */
+    for (int i = 0; i < n; i++) {
+        VCPUSamples *vs = qemu_plugin_scoreboard_find(vcpus, i);
+
+        if (vs->samples) {
+            fold_samples(folded, vs->samples, i);
+            g_hash_table_destroy(vs->samples);
+            vs->samples = NULL;
+        }
+    }
+
+    frames = g_list_sort_with_data(g_hash_table_get_keys(folded),
+                                   cmp_folded, folded);
+    for (it = frames; it; it = it->next) {
+        g_string_append_printf(report, "%s %" PRIu64 "\n", (char *) it->data,
+                               *(uint64_t *) g_hash_table_lookup(folded,
+                                                                 it->data));
+    }
+    g_list_free(frames);
+
+    qemu_plugin_outs(report->str);
+
+    g_hash_table_destroy(folded);
+    qemu_plugin_scoreboard_free(vcpus);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    for (int i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_auto(GStrv) tokens = g_strsplit(opt, "=", 2);
+        if (g_strcmp0(tokens[0], "freq") == 0) {
+            char *end;
+            unsigned long v = g_ascii_strtoull(tokens[1] ? tokens[1] : "",
+                                               &end, 10);
+            if (*end || v == 0 || v > 1000000) {
+                fprintf(stderr, "invalid sampling frequency: %s\n", opt);
+                return -1;
+            }
+            freq_hz = v;
+        } else if (g_strcmp0(tokens[0], "vcpu") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &per_vcpu)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    vcpus = qemu_plugin_scoreboard_new(sizeof(VCPUSamples));
+
+    qemu_plugin_register_vcpu_sample_cb(id, freq_hz, vcpu_sample, NULL);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
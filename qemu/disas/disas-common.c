@@ -82,14 +82,13 @@ int disas_gstring_printf(FILE *stream, const char *fmt, ...)
     return s->len - initial_len;
 }
 
-/* Look up symbol for debugging purpose.  Returns "" if unknown. */
-const char *lookup_symbol(uint64_t orig_addr)
+const char *lookup_symbol_offset(uint64_t orig_addr, uint64_t *offset)
 {
     const char *symbol = "";
     struct syminfo *s;
 
     for (s = syminfos; s; s = s->next) {
-        symbol = s->lookup_symbol(s, orig_addr);
+        symbol = s->lookup_symbol(s, orig_addr, offset);
         if (symbol[0] != '\0') {
             break;
         }
@@ -97,3 +96,9 @@ const char *lookup_symbol(uint64_t orig_addr)
 
     return symbol;
 }
+
+/* Look up symbol for debugging purpose.  Returns "" if unknown. */
+const char *lookup_symbol(uint64_t orig_addr)
+{
+    return lookup_symbol_offset(orig_addr, NULL);
+}
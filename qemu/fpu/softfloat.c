@@ -122,6 +122,14 @@ this code that are retained.
  * detection might get hairy. Two examples: (1) when at least one operand is
  * denormal/inf/NaN; (2) when operands are not guaranteed to lead to a 0 result
  * and the result is < the minimum normal.
+ *
+ * Some targets (e.g. Arm M-profile firmware) clear the flags often enough that
+ * relying on a pre-set inexact flag would leave hardfloat mostly unused. When
+ * the inexact flag is clear we therefore check the host result for exactness
+ * ourselves, without touching the host flags: additions use an error-free
+ * transformation (TwoSum), while products, quotients and square roots are
+ * checked by multiplying back the significands as integers. Since the result
+ * is then known to be normal or zero, these checks are exact.
  */
 #define GEN_INPUT_FLUSH__NOCHECK(name, soft_t)                          \
     static inline void name(soft_t *a, float_status *s)                 \
@@ -213,9 +221,9 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 #endif
 
 /*
- * Some targets clear the FP flags before most FP operations. This prevents
- * the use of hardfloat, since hardfloat relies on the inexact flag being
- * already set.
+ * Some targets clear the FP flags before most FP operations. Without a way
+ * to detect inexact results this would prevent the use of hardfloat, since
+ * hardfloat would then have to rely on the inexact flag being already set.
  */
 # if defined(__FAST_MATH__)
 #  warning disabling hardfloat due to -ffast-math: hardfloat requires an exact \
@@ -227,15 +235,38 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_SOFTFLOAT_ATTR QEMU_FLATTEN __attribute__((noinline))
 #endif
 
+/*
+ * The error-free transformations used to detect inexact results require
+ * float and double expressions to be evaluated in their own precision,
+ * which rules out e.g. the x87 FPU.
+ */
+#if FLT_EVAL_METHOD == 0
+# define QEMU_HARDFLOAT_DETECT_INEXACT 1
+#else
+# define QEMU_HARDFLOAT_DETECT_INEXACT 0
+#endif
+
 static inline bool can_use_fpu(const float_status *s)
 {
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
+    if (QEMU_HARDFLOAT_DETECT_INEXACT) {
+        return likely(s->float_rounding_mode == float_round_nearest_even);
+    }
     return likely(s->float_exception_flags & float_flag_inexact &&
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Return true if the inexact flag is not yet set, i.e. if a hardfloat
+ * operation has to find out whether its result was rounded.
+ */
+static inline bool need_inexact(const float_status *s)
+{
+    return unlikely(!(s->float_exception_flags & float_flag_inexact));
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -260,6 +291,10 @@ typedef union {
 
 typedef bool (*f32_check_fn)(union_float32 a, union_float32 b);
 typedef bool (*f64_check_fn)(union_float64 a, union_float64 b);
+typedef bool (*f32_exact_fn)(union_float32 a, union_float32 b,
+                             union_float32 r);
+typedef bool (*f64_exact_fn)(union_float64 a, union_float64 b,
+                             union_float64 r);
 
 typedef float32 (*soft_f32_op2_fn)(float32 a, float32 b, float_status *s);
 typedef float64 (*soft_f64_op2_fn)(float64 a, float64 b, float_status *s);
@@ -334,10 +369,80 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+/*
+ * Inexact detection helpers. All of them expect zero or normal inputs, and a
+ * result that is either zero or normal, i.e. that has neither overflowed nor
+ * gone through the tiny-result check of the callers.
+ */
+
+static inline uint32_t f32_sig(float32 a)
+{
+    return (float32_val(a) & 0x007fffff) | 0x00800000;
+}
+
+static inline uint64_t f64_sig(float64 a)
+{
+    return (float64_val(a) & 0x000fffffffffffffull) | 0x0010000000000000ull;
+}
+
+/*
+ * Return true if x * y == z exactly, where z is within an ulp of x * y.
+ * The significand product, stripped of trailing zeros, must then match
+ * the significand of z: the exponents cannot differ by a power of two.
+ */
+static bool f32_mul_is_exact(float32 x, float32 y, float32 z)
+{
+    uint64_t m, mz;
+
+    if (float32_is_zero(x) || float32_is_zero(y)) {
+        return true;
+    }
+    m = (uint64_t)f32_sig(x) * f32_sig(y);
+    mz = f32_sig(z);
+    return m >> ctz64(m) == mz >> ctz64(mz);
+}
+
+static bool f64_mul_is_exact(float64 x, float64 y, float64 z)
+{
+    uint64_t lo, hi, mz;
+    int shift;
+
+    if (float64_is_zero(x) || float64_is_zero(y)) {
+        return true;
+    }
+    mulu64(&lo, &hi, f64_sig(x), f64_sig(y));
+    mz = f64_sig(z);
+    mz >>= ctz64(mz);
+    if (lo == 0) {
+        return hi >> ctz64(hi) == mz;
+    }
+    shift = ctz64(lo);
+    if (shift) {
+        lo = (lo >> shift) | (hi << (64 - shift));
+        hi >>= shift;
+    }
+    return hi == 0 && lo == mz;
+}
+
+/* Knuth's TwoSum: the rounding error of a + b is recovered exactly. */
+static bool f32_twosum_is_exact(float a, float b, float r)
+{
+    float bb = r - a;
+
+    return (a - (r - bb)) + (b - bb) == 0;
+}
+
+static bool f64_twosum_is_exact(double a, double b, double r)
+{
+    double bb = r - a;
+
+    return (a - (r - bb)) + (b - bb) == 0;
+}
+
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
-             f32_check_fn pre, f32_check_fn post)
+             f32_check_fn pre, f32_check_fn post, f32_exact_fn exact)
 {
     union_float32 ua, ub, ur;
 
@@ -355,9 +460,11 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 
     ur.h = hard(ua.h, ub.h);
     if (unlikely(f32_is_inf(ur))) {
-        float_raise(float_flag_overflow, s);
+        float_raise(float_flag_overflow | float_flag_inexact, s);
     } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (need_inexact(s) && !exact(ua, ub, ur)) {
+        float_raise(float_flag_inexact, s);
     }
     return ur.s;
 
@@ -368,7 +475,7 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 static inline float64
 float64_gen2(float64 xa, float64 xb, float_status *s,
              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
-             f64_check_fn pre, f64_check_fn post)
+             f64_check_fn pre, f64_check_fn post, f64_exact_fn exact)
 {
     union_float64 ua, ub, ur;
 
@@ -386,9 +493,11 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
 
     ur.h = hard(ua.h, ub.h);
     if (unlikely(f64_is_inf(ur))) {
-        float_raise(float_flag_overflow, s);
+        float_raise(float_flag_overflow | float_flag_inexact, s);
     } else if (unlikely(fabs(ur.h) <= DBL_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (need_inexact(s) && !exact(ua, ub, ur)) {
+        float_raise(float_flag_inexact, s);
     }
     return ur.s;
 
@@ -1985,42 +2094,68 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
     }
 }
 
+static bool f32_add_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return f32_twosum_is_exact(a.h, b.h, r.h);
+}
+
+static bool f32_sub_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return f32_twosum_is_exact(a.h, -b.h, r.h);
+}
+
+static bool f64_add_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    return f64_twosum_is_exact(a.h, b.h, r.h);
+}
+
+static bool f64_sub_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    return f64_twosum_is_exact(a.h, -b.h, r.h);
+}
+
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
-                              hard_f32_op2_fn hard, soft_f32_op2_fn soft)
+                              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+                              f32_exact_fn exact)
 {
     return float32_gen2(a, b, s, hard, soft,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, exact);
 }
 
 static float64 float64_addsub(float64 a, float64 b, float_status *s,
-                              hard_f64_op2_fn hard, soft_f64_op2_fn soft)
+                              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+                              f64_exact_fn exact)
 {
     return float64_gen2(a, b, s, hard, soft,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post, exact);
 }
 
 float32 QEMU_FLATTEN
 float32_add(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add);
+    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add,
+                          f32_add_exact);
 }
 
 float32 QEMU_FLATTEN
 float32_sub(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub);
+    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub,
+                          f32_sub_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_add(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add);
+    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add,
+                          f64_add_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_sub(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub);
+    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub,
+                          f64_sub_exact);
 }
 
 static float64 float64r32_addsub(float64 a, float64 b, float_status *status,
@@ -2162,18 +2297,28 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+static bool f32_mul_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return f32_mul_is_exact(a.s, b.s, r.s);
+}
+
+static bool f64_mul_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    return f64_mul_is_exact(a.s, b.s, r.s);
+}
+
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_mul, soft_f32_mul,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, f32_mul_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_mul(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_mul, soft_f64_mul,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post, f64_mul_exact);
 }
 
 float64 float64r32_mul(float64 a, float64 b, float_status *status)
@@ -2279,6 +2424,54 @@ float64_muladd_scalbn(float64 a, float64 b, float64 c,
 
 static bool force_soft_fma;
 
+/*
+ * The product of two float32 is exact in double precision, so the rounding
+ * error of the fused operation is that of a double addition.
+ */
+static bool f32_muladd_is_exact(union_float32 a, union_float32 b,
+                                union_float32 c, union_float32 r)
+{
+    double p = (double)a.h * b.h;
+    double sum = p + c.h;
+
+    return f64_twosum_is_exact(p, c.h, sum) && sum == r.h;
+}
+
+/*
+ * Boldo and Muller's ErrFma: a * b + c - r is recovered exactly as the sum
+ * of two doubles, provided the intermediate terms neither overflow nor
+ * underflow. Return false if that cannot be guaranteed, and otherwise set
+ * @exact according to whether that sum is zero.
+ */
+static bool f64_muladd_is_exact(union_float64 a, union_float64 b,
+                                union_float64 c, union_float64 r, bool *exact)
+{
+    double u1, u2, a1, z, b1, b2, bb, g;
+
+    u1 = a.h * b.h;
+    if (unlikely(isinf(u1) || fabs(u1) < 0x1p-960)) {
+        return false;
+    }
+    u2 = fma(a.h, b.h, -u1);
+
+    /* (a1, z) = TwoSum(c, u2) */
+    a1 = c.h + u2;
+    bb = a1 - c.h;
+    z = (c.h - (a1 - bb)) + (u2 - bb);
+
+    /* (b1, b2) = TwoSum(u1, a1) */
+    b1 = u1 + a1;
+    if (unlikely(isinf(b1))) {
+        return false;
+    }
+    bb = b1 - u1;
+    b2 = (u1 - (b1 - bb)) + (a1 - bb);
+
+    g = (b1 - r.h) + b2;
+    *exact = g + z == 0;
+    return true;
+}
+
 float32 QEMU_FLATTEN
 float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
 {
@@ -2334,11 +2527,13 @@ float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
         ur.h = fmaf(ua.h, ub.h, uc.h);
 
         if (unlikely(f32_is_inf(ur))) {
-            float_raise(float_flag_overflow, s);
+            float_raise(float_flag_overflow | float_flag_inexact, s);
         } else if (unlikely(fabsf(ur.h) <= FLT_MIN)) {
             ua = ua_orig;
             uc = uc_orig;
             goto soft;
+        } else if (need_inexact(s) && !f32_muladd_is_exact(ua, ub, uc, ur)) {
+            float_raise(float_flag_inexact, s);
         }
     }
     if (flags & float_muladd_negate_result) {
@@ -2402,11 +2597,22 @@ float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
         ur.h = fma(ua.h, ub.h, uc.h);
 
         if (unlikely(f64_is_inf(ur))) {
-            float_raise(float_flag_overflow, s);
+            float_raise(float_flag_overflow | float_flag_inexact, s);
         } else if (unlikely(fabs(ur.h) <= FLT_MIN)) {
             ua = ua_orig;
             uc = uc_orig;
             goto soft;
+        } else if (need_inexact(s)) {
+            bool exact;
+
+            if (unlikely(!f64_muladd_is_exact(ua, ub, uc, ur, &exact))) {
+                ua = ua_orig;
+                uc = uc_orig;
+                goto soft;
+            }
+            if (!exact) {
+                float_raise(float_flag_inexact, s);
+            }
         }
     }
     if (flags & float_muladd_negate_result) {
@@ -2540,18 +2746,29 @@ static bool f64_div_post(union_float64 a, union_float64 b)
     return !float64_is_zero(a.s);
 }
 
+/* a / b is exact if and only if the quotient times b gives back a. */
+static bool f32_div_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return f32_mul_is_exact(r.s, b.s, a.s);
+}
+
+static bool f64_div_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    return f64_mul_is_exact(r.s, b.s, a.s);
+}
+
 float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_div, soft_f32_div,
-                        f32_div_pre, f32_div_post);
+                        f32_div_pre, f32_div_post, f32_div_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_div(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_div, soft_f64_div,
-                        f64_div_pre, f64_div_post);
+                        f64_div_pre, f64_div_post, f64_div_exact);
 }
 
 float64 float64r32_div(float64 a, float64 b, float_status *status)
@@ -3130,11 +3347,55 @@ int16_t float32_to_int16_scalbn(float32 a, FloatRoundMode rmode, int scale,
     return parts_float_to_sint(&p, rmode, scale, INT16_MIN, INT16_MAX, s);
 }
 
+/*
+ * Convert a zero or normal double to int32 with the host FPU, for the two
+ * rounding modes that guests use almost exclusively. Return false if the
+ * result is out of range, leaving saturation and the invalid flag to
+ * softfloat.
+ */
+static bool hard_to_int32(double x, FloatRoundMode rmode, int32_t *ret,
+                          float_status *s)
+{
+    double r;
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        r = rint(x);
+        break;
+    case float_round_to_zero:
+        r = trunc(x);
+        break;
+    default:
+        return false;
+    }
+    if (unlikely(!(r >= INT32_MIN && r <= INT32_MAX))) {
+        return false;
+    }
+    if (r != x) {
+        float_raise(float_flag_inexact, s);
+    }
+    *ret = r;
+    return true;
+}
+
 int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu(s)) {
+        union_float32 ua;
+        int32_t r;
+
+        ua.s = a;
+        float32_input_flush1(&ua.s, s);
+        if (likely(float32_is_zero_or_normal(ua.s)) &&
+            hard_to_int32(ua.h, rmode, &r, s)) {
+            return r;
+        }
+        a = ua.s;
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3162,6 +3423,19 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu(s)) {
+        union_float64 ua;
+        int32_t r;
+
+        ua.s = a;
+        float64_input_flush1(&ua.s, s);
+        if (likely(float64_is_zero_or_normal(ua.s)) &&
+            hard_to_int32(ua.h, rmode, &r, s)) {
+            return r;
+        }
+        a = ua.s;
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3882,6 +4156,15 @@ uint64_t bfloat16_to_uint64_round_to_zero(bfloat16 a, float_status *s)
  * Signed integer to floating-point conversions
  */
 
+/*
+ * Return true if @a can be represented exactly with a @bits-bit significand,
+ * i.e. if converting it to floating point does not round.
+ */
+static inline bool uint64_fits_sig(uint64_t a, int bits)
+{
+    return a == 0 || 64 - clz64(a) - ctz64(a) <= bits;
+}
+
 float16 int64_to_float16_scalbn(int64_t a, int scale, float_status *status)
 {
     FloatParts64 p;
@@ -3926,8 +4209,13 @@ float32 int64_to_float32_scalbn(int64_t a, int scale, float_status *status)
 
     /* Without scaling, there are no overflow concerns. */
     if (likely(scale == 0) && can_use_fpu(status)) {
+        uint64_t abs_a = a < 0 ? -(uint64_t)a : a;
         union_float32 ur;
+
         ur.h = a;
+        if (need_inexact(status) && !uint64_fits_sig(abs_a, 24)) {
+            float_raise(float_flag_inexact, status);
+        }
         return ur.s;
     }
 
@@ -3966,8 +4254,13 @@ float64 int64_to_float64_scalbn(int64_t a, int scale, float_status *status)
 
     /* Without scaling, there are no overflow concerns. */
     if (likely(scale == 0) && can_use_fpu(status)) {
+        uint64_t abs_a = a < 0 ? -(uint64_t)a : a;
         union_float64 ur;
+
         ur.h = a;
+        if (need_inexact(status) && !uint64_fits_sig(abs_a, 53)) {
+            float_raise(float_flag_inexact, status);
+        }
         return ur.s;
     }
 
@@ -4148,6 +4441,9 @@ float32 uint64_to_float32_scalbn(uint64_t a, int scale, float_status *status)
     if (likely(scale == 0) && can_use_fpu(status)) {
         union_float32 ur;
         ur.h = a;
+        if (need_inexact(status) && !uint64_fits_sig(a, 24)) {
+            float_raise(float_flag_inexact, status);
+        }
         return ur.s;
     }
 
@@ -4188,6 +4484,9 @@ float64 uint64_to_float64_scalbn(uint64_t a, int scale, float_status *status)
     if (likely(scale == 0) && can_use_fpu(status)) {
         union_float64 ur;
         ur.h = a;
+        if (need_inexact(status) && !uint64_fits_sig(a, 53)) {
+            float_raise(float_flag_inexact, status);
+        }
         return ur.s;
     }
 
@@ -4688,6 +4987,9 @@ float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
         goto soft;
     }
     ur.h = sqrtf(ua.h);
+    if (need_inexact(s) && !f32_mul_is_exact(ur.s, ur.s, ua.s)) {
+        float_raise(float_flag_inexact, s);
+    }
     return ur.s;
 
  soft:
@@ -4715,6 +5017,9 @@ float64 QEMU_FLATTEN float64_sqrt(float64 xa, float_status *s)
         goto soft;
     }
     ur.h = sqrt(ua.h);
+    if (need_inexact(s) && !f64_mul_is_exact(ur.s, ur.s, ua.s)) {
+        float_raise(float_flag_inexact, s);
+    }
     return ur.s;
 
  soft:
@@ -16,6 +16,7 @@
 #include "qapi/error.h"
 #include "exec/hwaddr.h"
 #include "exec/tb-flush.h"
+#include "accel/tcg/tb-pretranslate.h"
 #include "exec/gdbstub.h"
 #include "gdbstub/commands.h"
 #include "gdbstub/syscalls.h"
@@ -795,6 +796,8 @@ int gdb_breakpoint_insert(CPUState *cs, int type, vaddr addr, vaddr len)
                 break;
             }
         }
+        /* Blocks translated in advance were not checked for it */
+        tb_pretranslate_flush(cs);
         return err;
     default:
         /* user-mode doesn't support watchpoints */
@@ -310,6 +310,42 @@ static const struct {
     },
 };
 
+static const UnimplementedDeviceInfo npcm7xx_unimp_devices[] = {
+    { "npcm7xx.shm",          0xc0001000,   4 * KiB },
+    { "npcm7xx.vdmx",         0xe0800000,   4 * KiB },
+    { "npcm7xx.pcierc",       0xe1000000,  64 * KiB },
+    { "npcm7xx.kcs",          0xf0007000,   4 * KiB },
+    { "npcm7xx.gfxi",         0xf000e000,   4 * KiB },
+    { "npcm7xx.espi",         0xf009f000,   4 * KiB },
+    { "npcm7xx.peci",         0xf0100000,   4 * KiB },
+    { "npcm7xx.siox[1]",      0xf0101000,   4 * KiB },
+    { "npcm7xx.siox[2]",      0xf0102000,   4 * KiB },
+    { "npcm7xx.ahbpci",       0xf0400000,   1 * MiB },
+    { "npcm7xx.mcphy",        0xf05f0000,  64 * KiB },
+    { "npcm7xx.vcd",          0xf0810000,  64 * KiB },
+    { "npcm7xx.ece",          0xf0820000,   8 * KiB },
+    { "npcm7xx.vdma",         0xf0822000,   8 * KiB },
+    { "npcm7xx.usbd[0]",      0xf0830000,   4 * KiB },
+    { "npcm7xx.usbd[1]",      0xf0831000,   4 * KiB },
+    { "npcm7xx.usbd[2]",      0xf0832000,   4 * KiB },
+    { "npcm7xx.usbd[3]",      0xf0833000,   4 * KiB },
+    { "npcm7xx.usbd[4]",      0xf0834000,   4 * KiB },
+    { "npcm7xx.usbd[5]",      0xf0835000,   4 * KiB },
+    { "npcm7xx.usbd[6]",      0xf0836000,   4 * KiB },
+    { "npcm7xx.usbd[7]",      0xf0837000,   4 * KiB },
+    { "npcm7xx.usbd[8]",      0xf0838000,   4 * KiB },
+    { "npcm7xx.usbd[9]",      0xf0839000,   4 * KiB },
+    { "npcm7xx.sd",           0xf0840000,   8 * KiB },
+    { "npcm7xx.pcimbx",       0xf0848000, 512 * KiB },
+    { "npcm7xx.aes",          0xf0858000,   4 * KiB },
+    { "npcm7xx.des",          0xf0859000,   4 * KiB },
+    { "npcm7xx.sha",          0xf085a000,   4 * KiB },
+    { "npcm7xx.secacc",       0xf085b000,   4 * KiB },
+    { "npcm7xx.spixcs0",      0xf8000000,  16 * MiB },
+    { "npcm7xx.spixcs1",      0xf9000000,  16 * MiB },
+    { "npcm7xx.spix",         0xfb001000,   4 * KiB },
+};
+
 static void npcm7xx_write_board_setup(ARMCPU *cpu,
                                       const struct arm_boot_info *info)
 {
@@ -781,39 +817,8 @@ static void npcm7xx_realize(DeviceState *dev, Error **errp)
         sysbus_connect_irq(sbd, 0, npcm7xx_irq(s, irq));
     }
 
-    create_unimplemented_device("npcm7xx.shm",          0xc0001000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.vdmx",         0xe0800000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.pcierc",       0xe1000000,  64 * KiB);
-    create_unimplemented_device("npcm7xx.kcs",          0xf0007000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.gfxi",         0xf000e000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.espi",         0xf009f000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.peci",         0xf0100000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.siox[1]",      0xf0101000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.siox[2]",      0xf0102000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.ahbpci",       0xf0400000,   1 * MiB);
-    create_unimplemented_device("npcm7xx.mcphy",        0xf05f0000,  64 * KiB);
-    create_unimplemented_device("npcm7xx.vcd",          0xf0810000,  64 * KiB);
-    create_unimplemented_device("npcm7xx.ece",          0xf0820000,   8 * KiB);
-    create_unimplemented_device("npcm7xx.vdma",         0xf0822000,   8 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[0]",      0xf0830000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[1]",      0xf0831000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[2]",      0xf0832000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[3]",      0xf0833000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[4]",      0xf0834000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[5]",      0xf0835000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[6]",      0xf0836000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[7]",      0xf0837000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[8]",      0xf0838000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.usbd[9]",      0xf0839000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.sd",           0xf0840000,   8 * KiB);
-    create_unimplemented_device("npcm7xx.pcimbx",       0xf0848000, 512 * KiB);
-    create_unimplemented_device("npcm7xx.aes",          0xf0858000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.des",          0xf0859000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.sha",          0xf085a000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.secacc",       0xf085b000,   4 * KiB);
-    create_unimplemented_device("npcm7xx.spixcs0",      0xf8000000,  16 * MiB);
-    create_unimplemented_device("npcm7xx.spixcs1",      0xf9000000,  16 * MiB);
-    create_unimplemented_device("npcm7xx.spix",         0xfb001000,   4 * KiB);
+    create_unimplemented_devices(npcm7xx_unimp_devices,
+                                 ARRAY_SIZE(npcm7xx_unimp_devices));
 }
 
 static const Property npcm7xx_properties[] = {
@@ -55,10 +55,24 @@ static void nxps32k358_lpuart_update_params(NXPS32K358LPUARTState *s) {
     qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_SET_PARAMS, &ssp);
 }
 
+/*
+ * Publish the registers whose reads have no side effects, so that status
+ * polling loops do not need to call nxps32k358_lpuart_read().
+ */
+static void nxps32k358_lpuart_update_shadow(NXPS32K358LPUARTState *s)
+{
+    qatomic_set(&s->read_shadow[LPUART_GLOBAL / 4], s->lpuart_gb);
+    qatomic_set(&s->read_shadow[LPUART_BAUD / 4], s->baud_rate_config);
+    qatomic_set(&s->read_shadow[LPUART_STAT / 4], s->lpuart_sr);
+    qatomic_set(&s->read_shadow[LPUART_CTRL / 4], s->lpuart_cr);
+}
+
 static void nxps32k358_lpuart_update_irq(NXPS32K358LPUARTState *s)
 {
     uint32_t mask = s->lpuart_sr & s->lpuart_cr;
 
+    nxps32k358_lpuart_update_shadow(s);
+
     if (mask &
         (LPUART_CTRL_TIE | LPUART_CTRL_TCIE | LPUART_CTRL_RIE)) {
         qemu_set_irq(s->irq, 1);
@@ -165,10 +179,12 @@ static void nxps32k358_lpuart_write(void *opaque, hwaddr offset, uint64_t val64,
             if (value & LPUART_GLOBAL_RST_MASK) {
                 nxps32k358_lpuart_reset(DEVICE(s));
             }
+            nxps32k358_lpuart_update_shadow(s);
             return;
     case LPUART_BAUD:
         s->baud_rate_config = value;
         nxps32k358_lpuart_update_params(s);
+        nxps32k358_lpuart_update_shadow(s);
         return;
     case LPUART_STAT:
         if (value <= 0x3FF)
@@ -178,6 +194,7 @@ static void nxps32k358_lpuart_write(void *opaque, hwaddr offset, uint64_t val64,
             s->lpuart_sr = value | LPUART_STAT_TDRE;
         }
         else s->lpuart_sr &= value;
+        nxps32k358_lpuart_update_shadow(s);
         return;
     case LPUART_CTRL:
         s->lpuart_cr = value;
@@ -213,6 +230,9 @@ static const MemoryRegionOps nxps32k358_lpuart_ops = {
     .read = nxps32k358_lpuart_read,
     .write = nxps32k358_lpuart_write,
     .endianness = DEVICE_NATIVE_ENDIAN, // Verifica l'endianness delle periferiche S32K3
+    /* Reading DATA pops the received character, everything else is plain */
+    .read_shadow_regs = BIT_ULL(LPUART_GLOBAL / 4) | BIT_ULL(LPUART_BAUD / 4) |
+                        BIT_ULL(LPUART_STAT / 4) | BIT_ULL(LPUART_CTRL / 4),
 };
 
 static const Property nxps32k358_lpuart_properties[] = {
@@ -230,6 +250,7 @@ static void nxps32k358_lpuart_init(Object *obj)
     // La dimensione (es. 0x1000 o 4KB) deve coprire tutti i registri LPUART
     memory_region_init_io(&s->iomem, obj, &nxps32k358_lpuart_ops, s,
                           "nxps32k358-lpuart", 0x4000); // Dimensione esempio
+    memory_region_set_read_shadow(&s->iomem, s->read_shadow);
 
 
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
@@ -14,6 +14,7 @@
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
 #include "hw/misc/unimp.h"
+#include "system/memory.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "qapi/error.h"
@@ -90,6 +91,18 @@ static const TypeInfo unimp_info = {
     .class_init = unimp_class_init,
 };
 
+void create_unimplemented_devices(const UnimplementedDeviceInfo *devs,
+                                  size_t n)
+{
+    size_t i;
+
+    memory_region_transaction_begin();
+    for (i = 0; i < n; i++) {
+        create_unimplemented_device(devs[i].name, devs[i].base, devs[i].size);
+    }
+    memory_region_transaction_commit();
+}
+
 static void unimp_register_types(void)
 {
     type_register_static(&unimp_info);
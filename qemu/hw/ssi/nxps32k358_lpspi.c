@@ -89,6 +89,30 @@ static void lpspi_update_status(NXPS32K358LPSPIState *s)
     }
 }
 
+/*
+ * Publish the registers whose reads have no side effects, as
+ * nxps32k358_lpspi_read() would return them, so that status polling
+ * loops do not need to call it.
+ */
+static void lpspi_update_shadow(NXPS32K358LPSPIState *s)
+{
+    lpspi_update_status(s);
+
+    qatomic_set(&s->read_shadow[S32K_LPSPI_VERID / 4], s->lpspi_verid);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_PARAM / 4], s->lpspi_param);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_CR / 4], s->lpspi_cr);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_SR / 4], s->lpspi_sr);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_IER / 4], s->lpspi_ier);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_DER / 4], s->lpspi_der);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_CFGR0 / 4], s->lpspi_cfgr0);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_CFGR1 / 4], s->lpspi_cfgr1);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_CCR / 4], s->lpspi_ccr);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_FCR / 4], s->lpspi_fcr);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_FSR / 4], s->lpspi_fsr);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_TCR / 4], s->lpspi_tcr);
+    qatomic_set(&s->read_shadow[S32K_LPSPI_RSR / 4], s->lpspi_rsr);
+}
+
 /**
  *
  * This function checks the status and interrupt enable registers of the LPSPI
@@ -262,6 +286,7 @@ static void nxps32k358_lpspi_do_reset(NXPS32K358LPSPIState *s)
     }
 
     lpspi_update_irq(s);
+    lpspi_update_shadow(s);
 }
 
 static void nxps32k358_lpspi_reset(DeviceState *dev)
@@ -269,9 +294,8 @@ static void nxps32k358_lpspi_reset(DeviceState *dev)
     nxps32k358_lpspi_do_reset(NXPS32K358_LPSPI(dev));
 }
 
-static uint64_t nxps32k358_lpspi_read(void *opaque, hwaddr addr, unsigned int size)
+static uint64_t nxps32k358_lpspi_do_read(NXPS32K358LPSPIState *s, hwaddr addr)
 {
-    NXPS32K358LPSPIState *s = opaque;
     lpspi_update_status(s);
 
     switch (addr)
@@ -323,11 +347,19 @@ static uint64_t nxps32k358_lpspi_read(void *opaque, hwaddr addr, unsigned int si
     }
 }
 
-static void nxps32k358_lpspi_write(void *opaque, hwaddr addr, uint64_t val64, unsigned int size)
+static uint64_t nxps32k358_lpspi_read(void *opaque, hwaddr addr,
+                                      unsigned int size)
 {
     NXPS32K358LPSPIState *s = opaque;
-    uint32_t value = val64;
+    uint64_t value = nxps32k358_lpspi_do_read(s, addr);
+
+    lpspi_update_shadow(s);
+    return value;
+}
 
+static void nxps32k358_lpspi_do_write(NXPS32K358LPSPIState *s, hwaddr addr,
+                                      uint32_t value)
+{
     switch (addr)
     {
     case S32K_LPSPI_VERID:
@@ -423,18 +455,48 @@ static void nxps32k358_lpspi_write(void *opaque, hwaddr addr, uint64_t val64, un
     lpspi_update_irq(s);
 }
 
+static void nxps32k358_lpspi_write(void *opaque, hwaddr addr, uint64_t val64,
+                                   unsigned int size)
+{
+    NXPS32K358LPSPIState *s = opaque;
+
+    nxps32k358_lpspi_do_write(s, addr, val64);
+    lpspi_update_shadow(s);
+}
+
 static const MemoryRegionOps nxps32k358_lpspi_ops = {
     .read = nxps32k358_lpspi_read,
     .write = nxps32k358_lpspi_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .impl.min_access_size = 4,
     .impl.max_access_size = 4,
+    /* Reading RDR pops the RX FIFO, and TDR is write-only */
+    .read_shadow_regs = BIT_ULL(S32K_LPSPI_VERID / 4) |
+                        BIT_ULL(S32K_LPSPI_PARAM / 4) |
+                        BIT_ULL(S32K_LPSPI_CR / 4) |
+                        BIT_ULL(S32K_LPSPI_SR / 4) |
+                        BIT_ULL(S32K_LPSPI_IER / 4) |
+                        BIT_ULL(S32K_LPSPI_DER / 4) |
+                        BIT_ULL(S32K_LPSPI_CFGR0 / 4) |
+                        BIT_ULL(S32K_LPSPI_CFGR1 / 4) |
+                        BIT_ULL(S32K_LPSPI_CCR / 4) |
+                        BIT_ULL(S32K_LPSPI_FCR / 4) |
+                        BIT_ULL(S32K_LPSPI_FSR / 4) |
+                        BIT_ULL(S32K_LPSPI_TCR / 4) |
+                        BIT_ULL(S32K_LPSPI_RSR / 4),
 };
 
+static int nxps32k358_lpspi_post_load(void *opaque, int version_id)
+{
+    lpspi_update_shadow(opaque);
+    return 0;
+}
+
 static const VMStateDescription vmstate_nxps32k358_lpspi = {
     .name = TYPE_NXPS32K358_LPSPI,
     .version_id = 7,
     .minimum_version_id = 7,
+    .post_load = nxps32k358_lpspi_post_load,
     .fields = (const VMStateField[]){
         VMSTATE_FIFO8(tx_fifo, NXPS32K358LPSPIState),
         VMSTATE_FIFO8(rx_fifo, NXPS32K358LPSPIState),
@@ -466,6 +528,7 @@ static void nxps32k358_lpspi_realize(DeviceState *dev, Error **errp)
 
     memory_region_init_io(&s->mmio, OBJECT(s), &nxps32k358_lpspi_ops, s,
                           TYPE_NXPS32K358_LPSPI, S32K_LPSPI_REG_MAX_OFFSET);
+    memory_region_set_read_shadow(&s->mmio, s->read_shadow);
     sysbus_init_mmio(sbd, &s->mmio);
 
     s->ssi = ssi_create_bus(dev, "spi");
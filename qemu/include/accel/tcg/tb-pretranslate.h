@@ -0,0 +1,21 @@
+/*
+ * Speculative translation of translation block successors (user-mode)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_PRETRANSLATE_H
+#define ACCEL_TCG_TB_PRETRANSLATE_H
+
+#ifndef CONFIG_USER_ONLY
+#error Cannot include accel/tcg/tb-pretranslate.h from system emulation
+#endif
+
+/* Keep the background translation worker consistent across fork(). */
+void tb_pretranslate_fork_start(void);
+void tb_pretranslate_fork_end(bool child);
+
+/* Forget all speculative translations, e.g. when a breakpoint is set. */
+void tb_pretranslate_flush(CPUState *cpu);
+
+#endif /* ACCEL_TCG_TB_PRETRANSLATE_H */
@@ -239,6 +239,7 @@ struct AioContext {
 
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
+    int64_t io_uring_sqpoll_idle_ms; /* SQPOLL thread idle time, 0 = off */
 
     /*
      * List of handlers participating in userspace polling.  Protected by
@@ -713,8 +714,12 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
  * @ctx: the aio context
  * @max_batch: maximum number of requests in a batch, 0 means that the
  *             engine will use its default
+ * @sqpoll_idle_ms: idle time of the io_uring SQPOLL kernel thread in
+ *                  milliseconds, 0 means that SQPOLL is not used.  Only
+ *                  takes effect if the io_uring ring is created afterwards.
  */
-void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch);
+void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
+                                int64_t sqpoll_idle_ms);
 
 /**
  * aio_context_set_thread_pool_params:
@@ -319,6 +319,11 @@ bdrv_can_store_new_dirty_bitmap(BlockDriverState *bs, const char *name,
  *                               recursion.
  *         BDRV_REQ_NO_SERIALISING - do not serialize with other overlapping
  *                                   requests currently in flight.
+ *         BDRV_REQ_NO_FALLBACK - only share the extents of @src with @dst
+ *                                (e.g. with FICLONERANGE), and fail with
+ *                                -ENOTSUP where the data would have to be
+ *                                copied.  This can work for some parts of
+ *                                an image and not for others.
  *
  * Returns: 0 if succeeded; negative error code if failed.
  **/
@@ -32,6 +32,12 @@ typedef struct BlockExportDriver {
     /* True if the export type supports running on an inactive node */
     bool supports_inactive;
 
+    /*
+     * True if the export type can spread its I/O across several iothreads,
+     * see blk_exp_get_queue_aio_context()
+     */
+    bool supports_multithread;
+
     /* Creates and starts a new block export */
     int (*create)(BlockExport *, BlockExportOptions *, Error **);
 
@@ -48,6 +54,9 @@ typedef struct BlockExportDriver {
      * shutting down.
      */
     void (*request_shutdown)(BlockExport *);
+
+    /* Fills in the driver-specific part of query-block-exports' result */
+    void (*query)(BlockExport *, BlockExportInfo *);
 } BlockExportDriver;
 
 struct BlockExport {
@@ -79,6 +88,13 @@ struct BlockExport {
     /* The block device to export */
     BlockBackend *blk;
 
+    /*
+     * The iothreads that the export spreads its I/O across if a list of them
+     * was given, the first one running @ctx.  NULL if all I/O runs in @ctx.
+     */
+    struct IOThread **iothreads;
+    unsigned nb_iothreads;
+
     /* List entry for block_exports */
     QLIST_ENTRY(BlockExport) next;
 };
@@ -90,5 +106,6 @@ void blk_exp_unref(BlockExport *exp);
 void blk_exp_request_shutdown(BlockExport *exp);
 void blk_exp_close_all(void);
 void blk_exp_close_all_type(BlockExportType type);
+AioContext *blk_exp_get_queue_aio_context(BlockExport *exp, unsigned n);
 
 #endif
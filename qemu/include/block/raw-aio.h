@@ -74,13 +74,22 @@ static inline bool laio_has_fua(void)
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(unsigned sqpoll_idle, Error **errp);
 void luring_cleanup(LuringState *s);
 
-/* luring_co_submit: submit I/O requests in the thread's current AioContext. */
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type,
-                                  BdrvRequestFlags flags);
+/*
+ * luring_co_submit: submit I/O requests in the thread's current AioContext.
+ * @fixed_file is the index of @fd in the registered file table of that
+ * AioContext's ring, or -1 if it is not registered there.
+ */
+int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, int fixed_file,
+                                  uint64_t offset, QEMUIOVector *qiov,
+                                  int type, BdrvRequestFlags flags);
+int luring_register_file(LuringState *s, int fd, Error **errp);
+void luring_unregister_file(LuringState *s, int index);
+bool luring_register_buf(LuringState *s, void *host, size_t size,
+                         Error **errp);
+void luring_unregister_buf(LuringState *s, void *host, size_t size);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 bool luring_has_fua(void);
@@ -27,6 +27,7 @@
 
 #include "qemu/coroutine.h"
 #include "qemu/throttle.h"
+#include "qemu/timed-average.h"
 #include "qom/object.h"
 
 /* The ThrottleGroupMember structure indicates membership in a ThrottleGroup
@@ -57,6 +58,14 @@ typedef struct ThrottleGroupMember {
     unsigned       pending_reqs[THROTTLE_MAX];
     QLIST_ENTRY(ThrottleGroupMember) round_robin;
 
+    /* Completion latency target in nanoseconds.  Members that have one
+     * are protected: while they miss it, the other members of the group
+     * are slowed down.  Zero means that the member is best-effort.
+     * It only changes while the member has no requests in flight, so
+     * the I/O path may read it without holding the lock. */
+    uint64_t       latency_target;
+    TimedAverage   latency;
+
 } ThrottleGroupMember;
 
 #define TYPE_THROTTLE_GROUP "throttle-group"
@@ -79,6 +88,12 @@ void throttle_group_restart_tgm(ThrottleGroupMember *tgm);
 void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm,
                                                         int64_t bytes,
                                                         ThrottleDirection direction);
+void throttle_group_set_latency_target(ThrottleGroupMember *tgm,
+                                       uint64_t latency_target);
+void throttle_group_account_latency(ThrottleGroupMember *tgm,
+                                    int64_t start_ns);
+int64_t throttle_group_clock_ns(ThrottleGroupMember *tgm);
+
 void throttle_group_attach_aio_context(ThrottleGroupMember *tgm,
                                        AioContext *new_context);
 void throttle_group_detach_aio_context(ThrottleGroupMember *tgm);
@@ -18,11 +18,19 @@ char *plugin_disas(CPUState *cpu, const DisasContextBase *db,
 /* Look up symbol for debugging purpose.  Returns "" if unknown. */
 const char *lookup_symbol(uint64_t orig_addr);
 
+/*
+ * Like lookup_symbol(), but also return the distance of @orig_addr
+ * from the start of the symbol in @offset.
+ */
+const char *lookup_symbol_offset(uint64_t orig_addr, uint64_t *offset);
+
 struct syminfo;
 struct elf32_sym;
 struct elf64_sym;
 
-typedef const char *(*lookup_symbol_t)(struct syminfo *s, uint64_t orig_addr);
+/* Returns "" if unknown, otherwise sets *@offset if it is not NULL. */
+typedef const char *(*lookup_symbol_t)(struct syminfo *s, uint64_t orig_addr,
+                                       uint64_t *offset);
 
 struct syminfo {
     lookup_symbol_t lookup_symbol;
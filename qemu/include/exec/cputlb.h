@@ -33,6 +33,16 @@ void tlb_unprotect_code(ram_addr_t ram_addr);
 #ifndef CONFIG_USER_ONLY
 void tlb_reset_dirty(CPUState *cpu, uintptr_t start, uintptr_t length);
 void tlb_reset_dirty_range_all(ram_addr_t start, ram_addr_t length);
+
+/**
+ * tlb_dirty_ring_enabled:
+ *
+ * Return true if the pages written by vCPUs are recorded in per-vCPU
+ * dirty rings rather than in the migration dirty bitmap.  TLB entries
+ * are then write protected again as the rings are reaped, and need not
+ * be reset when the migration bitmap is cleared.
+ */
+bool tlb_dirty_ring_enabled(void);
 #endif
 
 /**
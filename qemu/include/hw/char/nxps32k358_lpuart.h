@@ -81,6 +81,9 @@ struct NXPS32K358LPUARTState {
     uint32_t lpuart_dr;
     uint32_t lpuart_gb;
 
+    /* Registers read without calling the device, see update_shadow */
+    uint32_t read_shadow[LPUART_CTRL / 4 + 1];
+
 
 };
 
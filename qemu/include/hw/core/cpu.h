@@ -31,6 +31,7 @@
 #include "qapi/qapi-types-machine.h"
 #include "qapi/qapi-types-run-state.h"
 #include "qemu/bitmap.h"
+#include "qemu/interval-tree.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/queue.h"
 #include "qemu/lockcnt.h"
@@ -206,6 +207,9 @@ struct CPUClass {
 /* Use a fully associative victim tlb of 8 entries. */
 #define CPU_VTLB_SIZE 8
 
+/* Behind the victim tlb, use a second level tlb with 4 ways per set. */
+#define CPU_L2TLB_WAYS 4
+
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
  * so the layout is not as critical as that of CPUTLBEntry. This is
@@ -274,11 +278,18 @@ struct CPUTLBEntryFull {
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
+    /*
+     * The large pages allocated into the tlb, up to CPU_TLB_LARGE_PAGES
+     * of them.  When any page within one of them is flushed, we must
+     * flush all entries within that large page.
+     */
+    IntervalTreeRoot large_pages;
+    size_t n_large_pages;
     /*
      * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * into the tlb beyond CPU_TLB_LARGE_PAGES.  When any page within
+     * this region is flushed, we must flush the entire tlb.  The region
+     * is matched if (addr & large_page_mask) == large_page_addr.
      */
     vaddr large_page_addr;
     vaddr large_page_mask;
@@ -293,11 +304,30 @@ typedef struct CPUTLBDesc {
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
     CPUTLBEntryFull *fulltlb;
+    /*
+     * The second level tlb, caching the results of tlb_fill in
+     * (l2_mask + 1) sets of CPU_L2TLB_WAYS entries, most recently
+     * used first.  The set of a page is selected by the same address
+     * bits as its entry in the main tlb.  Unused entries of l2_page
+     * are -1.  May be NULL if the allocation failed.
+     */
+    size_t l2_mask;
+    vaddr *l2_page;
+    CPUTLBEntryFull *l2_full;
 } CPUTLBDesc;
 
 /*
  * Data elements that are shared between all MMU modes.
  */
+/*
+ * A page written by a vCPU while the TCG dirty ring is enabled: @addr
+ * is the guest virtual page, @ram_addr the ram_addr_t it maps.
+ */
+typedef struct CPUTLBDirtyRingEntry {
+    vaddr addr;
+    hwaddr ram_addr;
+} CPUTLBDirtyRingEntry;
+
 typedef struct CPUTLBCommon {
     /* Serialize updates to f.table and d.vtable, and others as noted. */
     QemuSpin lock;
@@ -307,6 +337,12 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Pages this vCPU made writable in its TLB since the dirty ring was
+     * last reaped.  Protected by tlb_c.lock.
+     */
+    CPUTLBDirtyRingEntry *dirty_ring;
+    uint32_t dirty_ring_count;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -315,6 +351,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t l2_hit_count;
+    size_t l2_miss_count;
 } CPUTLBCommon;
 
 /*
@@ -51,4 +51,23 @@ static inline void create_unimplemented_device(const char *name,
     sysbus_mmio_map_overlap(SYS_BUS_DEVICE(dev), 0, base, -1000);
 }
 
+typedef struct UnimplementedDeviceInfo {
+    const char *name;
+    hwaddr base;
+    hwaddr size;
+} UnimplementedDeviceInfo;
+
+/**
+ * create_unimplemented_devices: create and map many dummy devices
+ * @devs: array of devices to create
+ * @n: number of elements in @devs
+ *
+ * Equivalent to calling create_unimplemented_device() for each element
+ * of @devs, but the memory map is only updated once, after all of them
+ * have been mapped.  SoCs stubbing out hundreds of devices should use
+ * this rather than paying for a memory topology update per device.
+ */
+void create_unimplemented_devices(const UnimplementedDeviceInfo *devs,
+                                  size_t n);
+
 #endif
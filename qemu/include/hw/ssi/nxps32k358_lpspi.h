@@ -112,6 +112,9 @@ struct NXPS32K358LPSPIState
     uint32_t lpspi_tdr;
     uint32_t lpspi_rsr;
     uint32_t lpspi_rdr;
+
+    /* Registers read without calling the device, see lpspi_update_shadow */
+    uint32_t read_shadow[S32K_LPSPI_RSR / 4 + 1];
 };
 
 #endif // HW_NXP_S32K358_LPSPI_H
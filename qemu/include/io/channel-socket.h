@@ -261,5 +261,38 @@ QIOChannelSocket *
 qio_channel_socket_accept(QIOChannelSocket *ioc,
                           Error **errp);
 
+/**
+ * qio_channel_socket_enable_zero_copy:
+ * @ioc: the socket channel object
+ *
+ * Try to enable zero copy writes on the connected socket @ioc.
+ * Sockets connected with qio_channel_socket_connect_sync() have
+ * it enabled already.
+ *
+ * Returns: true if QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY is now
+ * supported by @ioc, false otherwise
+ */
+bool qio_channel_socket_enable_zero_copy(QIOChannelSocket *ioc);
+
+/**
+ * qio_channel_socket_zero_copy_completed:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Process the completion notifications that the kernel queued for
+ * zero copy writes on @ioc, without waiting for more to arrive.
+ * The buffers of the first N zero copy writes, where N is the return
+ * value, may be reused.  Unlike qio_channel_flush(), this never
+ * blocks.
+ *
+ * Pending notifications make the socket report an error condition
+ * to poll(), so callers that keep polling the socket should process
+ * them promptly.
+ *
+ * Returns: the number of completed zero copy writes, or -1 on error
+ */
+ssize_t qio_channel_socket_zero_copy_completed(QIOChannelSocket *ioc,
+                                               Error **errp);
+
 
 #endif /* QIO_CHANNEL_SOCKET_H */
@@ -72,6 +72,7 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_MEM_REGULAR,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
+    PLUGIN_CB_MEM_BUFFER,
 };
 
 struct qemu_plugin_regular_cb {
@@ -87,6 +88,18 @@ struct qemu_plugin_inline_cb {
     enum qemu_plugin_mem_rw rw;
 };
 
+/*
+ * @f and @info describe the helper draining the buffer, which generated
+ * code calls before an instruction whose accesses might not fit in it.
+ */
+struct qemu_plugin_mem_buffer_cb {
+    union qemu_plugin_cb_sig f;
+    TCGHelperInfo *info;
+    struct qemu_plugin_mem_buffer *buf;
+    uint64_t pc;
+    enum qemu_plugin_mem_rw rw;
+};
+
 struct qemu_plugin_conditional_cb {
     union qemu_plugin_cb_sig f;
     TCGHelperInfo *info;
@@ -107,6 +120,7 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_mem_buffer_cb mem_buffer;
     };
 };
 
@@ -128,6 +142,29 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * A memory buffer keeps one entry per vcpu in a scoreboard, made of the
+ * number of records followed by the records themselves.
+ */
+struct qemu_plugin_mem_buffer_vcpu {
+    uint64_t n;
+    struct qemu_plugin_mem_record records[];
+};
+
+/*
+ * Generated code drains a buffer before each instruction that could
+ * overflow it, so it must be able to hold all the accesses of any one
+ * instruction.
+ */
+#define QEMU_PLUGIN_MEM_BUFFER_MIN_RECORDS 256
+
+struct qemu_plugin_mem_buffer {
+    struct qemu_plugin_scoreboard *score;
+    size_t capacity;
+    qemu_plugin_vcpu_mem_buffer_cb_t cb;
+    void *userp;
+};
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
@@ -196,7 +233,8 @@ void qemu_plugin_user_exit(void);
  * qemu_plugin_user_prefork_lock(): take plugin lock before forking
  *
  * This is a user-mode only helper to take the internal plugin lock
- * before a fork event. This is ensure a consistent lock state
+ * before a fork event. This is ensure a consistent lock state. The
+ * locks of the PC samplers are taken as well.
  */
 void qemu_plugin_user_prefork_lock(void);
 
@@ -205,7 +243,8 @@ void qemu_plugin_user_prefork_lock(void);
  * @is_child: is this thread the child
  *
  * This user-mode only helper resets the lock state after a fork so we
- * can continue using the plugin interface.
+ * can continue using the plugin interface. In the child, the PC
+ * samplers are given new threads.
  */
 void qemu_plugin_user_postfork(bool is_child);
 
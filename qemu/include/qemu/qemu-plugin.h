@@ -65,11 +65,16 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * version 4:
  * - added qemu_plugin_read_memory_vaddr
+ *
+ * version 5:
+ * - added qemu_plugin_mem_buffer_{new,free,flush} and
+ *   qemu_plugin_register_vcpu_mem_buffer
+ * - added qemu_plugin_register_vcpu_sample_cb and qemu_plugin_vaddr_symbol
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 4
+#define QEMU_PLUGIN_VERSION 5
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -701,6 +706,143 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/**
+ * struct qemu_plugin_mem_record - memory access recorded in a buffer
+ * @vaddr: the virtual address of the access
+ * @pc: the virtual address of the instruction performing the access
+ * @info: an opaque handle for further queries about the memory. As the
+ *        access is reported after the fact, it cannot be passed to
+ *        qemu_plugin_get_hwaddr().
+ */
+struct qemu_plugin_mem_record {
+    uint64_t vaddr;
+    uint64_t pc;
+    qemu_plugin_meminfo_t info;
+};
+
+/** struct qemu_plugin_mem_buffer - Opaque handle for a memory buffer */
+struct qemu_plugin_mem_buffer;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_buffer_cb_t - memory buffer callback type
+ * @vcpu_index: the vCPU whose buffer is being drained
+ * @records: the recorded accesses, oldest first
+ * @n: number of entries in @records
+ * @userdata: user data passed to qemu_plugin_mem_buffer_new()
+ *
+ * @records is only valid for the duration of the callback.
+ */
+typedef void (*qemu_plugin_vcpu_mem_buffer_cb_t)(
+    unsigned int vcpu_index,
+    const struct qemu_plugin_mem_record *records,
+    size_t n,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_new() - alloc a per-vCPU memory access buffer
+ * @n_records: number of records each vCPU can hold before @cb is called
+ * @cb: callback draining the records of one vCPU
+ * @userdata: any user data to pass to @cb
+ *
+ * Accesses registered with qemu_plugin_register_vcpu_mem_buffer() are
+ * appended inline by the generated code to a buffer owned by the
+ * executing vCPU. @cb is called from that vCPU once its buffer is about
+ * to fill up, or when qemu_plugin_mem_buffer_flush() is called. Since
+ * buffers are per-vCPU, no locking is needed to fill or drain them.
+ *
+ * Returns a pointer to a new buffer. It must be freed using
+ * qemu_plugin_mem_buffer_free.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records,
+                           qemu_plugin_vcpu_mem_buffer_cb_t cb,
+                           void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_free() - free a memory buffer
+ * @buf: buffer to free
+ *
+ * Records still held in @buf are dropped, see qemu_plugin_mem_buffer_flush.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+/**
+ * qemu_plugin_mem_buffer_flush() - drain a vCPU's memory buffer
+ * @buf: buffer to drain
+ * @vcpu_index: vCPU whose records are passed to the buffer callback
+ *
+ * This must be called from the vCPU itself (e.g. from its exit callback)
+ * or once all vCPUs are stopped, typically from the atexit callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_register_vcpu_mem_buffer() - record memory accesses in a buffer
+ * @insn: handle for instruction to instrument
+ * @rw: record reads, writes or both
+ * @buf: buffer to record the accesses in
+ *
+ * This records every memory access generated by the instruction in @buf,
+ * without calling into the plugin for each of them. It is a cheaper
+ * alternative to qemu_plugin_register_vcpu_mem_cb() for plugins that can
+ * process accesses in batches.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_buffer(struct qemu_plugin_insn *insn,
+                                          enum qemu_plugin_mem_rw rw,
+                                          struct qemu_plugin_mem_buffer *buf);
+
+/**
+ * typedef qemu_plugin_vcpu_sample_cb_t - PC sampling callback type
+ * @vcpu_index: the sampled vCPU
+ * @pc: the guest virtual address the vCPU is about to execute
+ * @userdata: user data passed to qemu_plugin_register_vcpu_sample_cb()
+ */
+typedef void (*qemu_plugin_vcpu_sample_cb_t)(unsigned int vcpu_index,
+                                             uint64_t pc, void *userdata);
+
+/**
+ * qemu_plugin_register_vcpu_sample_cb() - periodically sample vCPU PCs
+ * @id: plugin ID
+ * @freq_hz: number of samples per second and per vCPU
+ * @cb: callback receiving the samples
+ * @userdata: any user data to pass to @cb
+ *
+ * A host thread wakes up @freq_hz times per second and asks every vCPU
+ * for its current PC. @cb is called from the sampled vCPU itself,
+ * between two translation blocks, so per-vCPU data can be updated
+ * without locking. Unlike TB or instruction callbacks this does not
+ * instrument the generated code, which makes the overhead independent
+ * of the guest workload. A vCPU blocked for longer than a period (e.g.
+ * in a syscall) only reports one sample once it resumes.
+ *
+ * Registering again replaces the previous sampler of the plugin, a
+ * @freq_hz of 0 stops sampling. Either waits for the samples being
+ * reported, so it must not be called from @cb. Sampling stops before
+ * atexit callbacks are called.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         unsigned int freq_hz,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         void *userdata);
+
+/**
+ * qemu_plugin_vaddr_symbol() - return the symbol covering an address
+ * @vaddr: guest virtual address
+ *
+ * Looks @vaddr up in the symbols of the ELF files loaded by QEMU (the
+ * user-mode binary or the ELF passed to -kernel).
+ *
+ * Returns a static string or NULL if no symbol covers @vaddr.
+ */
+QEMU_PLUGIN_API
+const char *qemu_plugin_vaddr_symbol(uint64_t vaddr);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
@@ -15,6 +15,7 @@
 #include "io/channel-socket.h"
 #include "io/channel-file.h"
 #include "io/net-listener.h"
+#include "qemu/thread.h"
 #include "qapi/error.h"
 #include "standard-headers/linux/virtio_blk.h"
 
@@ -27,11 +28,29 @@ typedef struct VuFdWatch {
     QTAILQ_ENTRY(VuFdWatch) next;
 } VuFdWatch;
 
+/* A virtqueue that is processed in an AioContext of its own */
+typedef struct VuQueue {
+    VuDev *vu_dev;
+    AioContext *ctx;
+
+    /*
+     * Serializes processing of the virtqueue against vhost-user message
+     * handling, which runs in another thread.  Recursive because requests
+     * may complete before the kick handler returns.
+     */
+    QemuRecMutex lock;
+
+    /* Protected by lock */
+    int kick_fd; /* -1 if libvhost-user does not monitor the virtqueue */
+    bool enabled; /* kick fd handler is installed in ctx */
+} VuQueue;
+
 /**
  * VuServer:
  * A vhost-user server instance with user-defined VuDevIface callbacks.
  * Vhost-user device backends can be implemented using VuServer. VuDevIface
- * callbacks and virtqueue kicks run in the given AioContext.
+ * callbacks and virtqueue kicks run in the given AioContext, unless each
+ * virtqueue was given an AioContext of its own.
  */
 typedef struct {
     QIONetListener *listener;
@@ -51,6 +70,13 @@ typedef struct {
     QIOChannelSocket *sioc; /* The underlying data channel with the client */
     QTAILQ_HEAD(, VuFdWatch) vu_fd_watches;
 
+    /*
+     * max_queues elements if virtqueues run in their own AioContext, NULL
+     * if they are monitored through vu_fd_watches in ctx
+     */
+    VuQueue *queues;
+    bool queues_locked; /* message handling holds all queues' locks */
+
     Coroutine *co_trip; /* coroutine for processing VhostUserMsg */
 } VuServer;
 
@@ -58,6 +84,7 @@ bool vhost_user_server_start(VuServer *server,
                              SocketAddress *unix_socket,
                              AioContext *ctx,
                              uint16_t max_queues,
+                             AioContext *const *queue_ctx,
                              const VuDevIface *vu_iface,
                              Error **errp);
 
@@ -67,6 +94,9 @@ void vhost_user_server_inc_in_flight(VuServer *server);
 void vhost_user_server_dec_in_flight(VuServer *server);
 bool vhost_user_server_has_in_flight(VuServer *server);
 
+void vhost_user_server_lock_queue(VuServer *server, VuVirtq *vq);
+void vhost_user_server_unlock_queue(VuServer *server, VuVirtq *vq);
+
 void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx);
 void vhost_user_server_detach_aio_context(VuServer *server);
 
@@ -330,6 +330,14 @@ struct MemoryRegionOps {
          */
         bool unaligned;
     } impl;
+    /*
+     * Registers that can be read without side effects, one bit per 32-bit
+     * word from the start of the region.  Once the device publishes their
+     * values with memory_region_set_read_shadow(), aligned 32-bit reads
+     * of these words may be served from the shadow, without calling @read
+     * and without taking the BQL.
+     */
+    uint64_t read_shadow_regs;
 };
 
 typedef struct MemoryRegionClass {
@@ -807,6 +815,9 @@ struct MemoryRegion {
 
     /* For devices designed to perform re-entrant IO into their own IO MRs */
     bool disable_reentrancy_guard;
+
+    /* Values of ops->read_shadow_regs, see memory_region_set_read_shadow() */
+    uint32_t *read_shadow;
 };
 
 struct IOMMUMemoryRegion {
@@ -1142,6 +1153,12 @@ struct FlatView {
     unsigned nr_allocated;
     struct AddressSpaceDispatch *dispatch;
     MemoryRegion *root;
+    /*
+     * Topmost containers of the regions rendered into this view, through
+     * @root or through aliases.  The view is only rendered again if one
+     * of them changed.
+     */
+    GPtrArray *deps;
 };
 
 static inline FlatView *address_space_to_flatview(AddressSpace *as)
@@ -2252,6 +2269,22 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_set_read_shadow: Publish the values of side effect free
+ *                                registers.
+ *
+ * Let aligned 32-bit reads of the registers in the read_shadow_regs of the
+ * region's #MemoryRegionOps be served from @shadow, without calling the
+ * read callback.  The device must keep @shadow up to date, updating it
+ * with qatomic_set() whenever the value its read callback would return
+ * for one of these registers changes.
+ *
+ * @mr: the memory region to be updated.
+ * @shadow: the values of the registers, indexed by offset / 4, up to the
+ *          last one in read_shadow_regs; or NULL to stop using the shadow.
+ */
+void memory_region_set_read_shadow(MemoryRegion *mr, uint32_t *shadow);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -2582,6 +2615,23 @@ bool memory_region_access_valid(MemoryRegion *mr, hwaddr addr,
                                 unsigned size, bool is_write,
                                 MemTxAttrs attrs);
 
+/**
+ * memory_region_read_shadow: try to perform a read from the register
+ * shadow of the specified MemoryRegion.
+ *
+ * Return true if the read was served from the shadow published with
+ * memory_region_set_read_shadow(), false if it must be dispatched to the
+ * device.  This does not need the BQL.
+ *
+ * @mr: #MemoryRegion to access
+ * @addr: address within that region
+ * @pval: pointer to uint64_t which the data is written to
+ * @op: size, sign, and endianness of the memory operation
+ * @attrs: memory transaction attributes to use for the access
+ */
+bool memory_region_read_shadow(MemoryRegion *mr, hwaddr addr,
+                               uint64_t *pval, MemOp op, MemTxAttrs attrs);
+
 /**
  * memory_region_dispatch_read: perform a read directly to the specified
  * MemoryRegion.
@@ -456,12 +456,15 @@ uint64_t cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
 #endif /* not _WIN32 */
 
 static inline void cpu_physical_memory_dirty_bits_cleared(ram_addr_t start,
-                                                          ram_addr_t length)
+                                                          ram_addr_t length,
+                                                          unsigned client)
 {
     if (tcg_enabled()) {
+        if (client == DIRTY_MEMORY_MIGRATION && tlb_dirty_ring_enabled()) {
+            return;
+        }
         tlb_reset_dirty_range_all(start, length);
     }
-
 }
 bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
                                               ram_addr_t length,
@@ -525,7 +528,8 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
             }
         }
         if (num_dirty) {
-            cpu_physical_memory_dirty_bits_cleared(start, length);
+            cpu_physical_memory_dirty_bits_cleared(start, length,
+                                                   DIRTY_MEMORY_MIGRATION);
         }
 
         if (rb->clear_bmap) {
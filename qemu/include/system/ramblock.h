@@ -57,6 +57,21 @@ struct RAMBlock {
      */
     off_t bitmap_offset;
     uint64_t pages_offset;
+    /*
+     * With compression, the pages are stored in extents allocated from
+     * the pages_size bytes at pages_offset, pages_used bytes so far.
+     * file_index has the offset of the extent of each page relative to
+     * pages_offset, it is saved at index_offset.
+     */
+    off_t index_offset;
+    uint64_t pages_size;
+    uint64_t pages_used;
+    uint64_t *file_index;
+    /*
+     * set once pages were mapped from the migration file on load, see
+     * qemu_ram_map_file_private()
+     */
+    bool file_mapped;
 
     /* Bitmap of already received pages.  Only used on destination side. */
     unsigned long *receivedmap;
@@ -369,6 +369,13 @@ struct TCGContext {
     TCGTemp *frame_temp;
 
     TranslationBlock *gen_tb;     /* tb for which code is being generated */
+    /*
+     * user-mode only: direct branch targets of gen_tb, recorded by
+     * translator_use_goto_tb() if record_tb_succ
+     */
+    bool record_tb_succ;
+    uint64_t gen_tb_succ[2];
+    int nb_gen_tb_succ;
     tcg_insn_unit *code_buf;      /* pointer for start of tb */
     tcg_insn_unit *code_ptr;      /* pointer for running end of tb */
 
@@ -164,15 +164,7 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
         return -1;
     }
 
-#ifdef QEMU_MSG_ZEROCOPY
-    int ret, v = 1;
-    ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v));
-    if (ret == 0) {
-        /* Zero copy available on host */
-        qio_channel_set_feature(QIO_CHANNEL(ioc),
-                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
-    }
-#endif
+    qio_channel_socket_enable_zero_copy(ioc);
 
     qio_channel_set_feature(QIO_CHANNEL(ioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
@@ -725,10 +717,18 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
 
 
 #ifdef QEMU_MSG_ZEROCOPY
-static int qio_channel_socket_flush(QIOChannel *ioc,
-                                    Error **errp)
+/*
+ * Process zero copy notifications from the socket error queue.  With @wait,
+ * wait until every queued write has been reported; otherwise stop as soon
+ * as the error queue is empty.
+ *
+ * Returns -1 on error, 0 if any of the reported writes used zero copy,
+ * 1 otherwise.
+ */
+static int qio_channel_socket_reap_zero_copy(QIOChannelSocket *sioc,
+                                             bool wait, Error **errp)
 {
-    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    QIOChannel *ioc = QIO_CHANNEL(sioc);
     struct msghdr msg = {};
     struct sock_extended_err *serr;
     struct cmsghdr *cm;
@@ -736,10 +736,6 @@ static int qio_channel_socket_flush(QIOChannel *ioc,
     int received;
     int ret;
 
-    if (sioc->zero_copy_queued == sioc->zero_copy_sent) {
-        return 0;
-    }
-
     msg.msg_control = control;
     msg.msg_controllen = sizeof(control);
     memset(control, 0, sizeof(control));
@@ -751,6 +747,9 @@ static int qio_channel_socket_flush(QIOChannel *ioc,
         if (received < 0) {
             switch (errno) {
             case EAGAIN:
+                if (!wait) {
+                    return ret;
+                }
                 /* Nothing on errqueue, wait until something is available */
                 qio_channel_wait(ioc, G_IO_ERR);
                 continue;
@@ -800,8 +799,47 @@ static int qio_channel_socket_flush(QIOChannel *ioc,
     return ret;
 }
 
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp)
+{
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+
+    if (sioc->zero_copy_queued == sioc->zero_copy_sent) {
+        return 0;
+    }
+
+    return qio_channel_socket_reap_zero_copy(sioc, true, errp);
+}
+
 #endif /* QEMU_MSG_ZEROCOPY */
 
+bool qio_channel_socket_enable_zero_copy(QIOChannelSocket *ioc)
+{
+#ifdef QEMU_MSG_ZEROCOPY
+    int v = 1;
+
+    if (setsockopt(ioc->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0) {
+        /* Zero copy available on host */
+        qio_channel_set_feature(QIO_CHANNEL(ioc),
+                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+        return true;
+    }
+#endif
+    return false;
+}
+
+ssize_t qio_channel_socket_zero_copy_completed(QIOChannelSocket *ioc,
+                                               Error **errp)
+{
+#ifdef QEMU_MSG_ZEROCOPY
+    if (ioc->zero_copy_sent < ioc->zero_copy_queued &&
+        qio_channel_socket_reap_zero_copy(ioc, false, errp) < 0) {
+        return -1;
+    }
+#endif
+    return ioc->zero_copy_sent;
+}
+
 static int
 qio_channel_socket_set_blocking(QIOChannel *ioc,
                                 bool enabled,
@@ -57,6 +57,7 @@
 #include "loader.h"
 #include "user-mmap.h"
 #include "tcg/perf.h"
+#include "accel/tcg/tb-pretranslate.h"
 #include "exec/page-vary.h"
 
 #ifdef CONFIG_SEMIHOSTING
@@ -72,6 +73,7 @@ char *exec_path;
 char real_exec_path[PATH_MAX];
 
 static bool opt_one_insn_per_tb;
+static bool opt_pretranslate;
 static unsigned long opt_tb_size;
 static const char *argv0;
 static const char *gdbstub;
@@ -146,6 +148,7 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
+    tb_pretranslate_fork_start();
     cpu_list_lock();
     qemu_plugin_user_prefork_lock();
     gdbserver_fork_start();
@@ -157,6 +160,7 @@ void fork_end(pid_t pid)
 
     qemu_plugin_user_postfork(child);
     mmap_fork_end(child);
+    tb_pretranslate_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
         /* Child processes created by fork() only have a single thread.
@@ -426,6 +430,11 @@ static void handle_arg_one_insn_per_tb(const char *arg)
     opt_one_insn_per_tb = true;
 }
 
+static void handle_arg_pretranslate(const char *arg)
+{
+    opt_pretranslate = true;
+}
+
 static void handle_arg_tb_size(const char *arg)
 {
     if (qemu_strtoul(arg, NULL, 0, &opt_tb_size)) {
@@ -525,6 +534,8 @@ static const struct qemu_argument arg_table[] = {
     {"one-insn-per-tb",
                    "QEMU_ONE_INSN_PER_TB",  false, handle_arg_one_insn_per_tb,
      "",           "run with one guest instruction per emulated TB"},
+    {"pretranslate", "QEMU_PRETRANSLATE", false, handle_arg_pretranslate,
+     "",           "translate branch targets in a background thread"},
     {"tb-size",    "QEMU_TB_SIZE",     true,  handle_arg_tb_size,
      "size",       "TCG translation block cache size"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
@@ -818,6 +829,8 @@ int main(int argc, char **argv, char **envp)
         accel_init_interfaces(ac);
         object_property_set_bool(OBJECT(accel), "one-insn-per-tb",
                                  opt_one_insn_per_tb, &error_abort);
+        object_property_set_bool(OBJECT(accel), "pretranslate",
+                                 opt_pretranslate, &error_abort);
         object_property_set_int(OBJECT(accel), "tb-size",
                                 opt_tb_size, &error_abort);
         ac->init_machine(NULL);
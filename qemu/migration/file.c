@@ -7,8 +7,11 @@
 
 #include "qemu/osdep.h"
 #include "system/ramblock.h"
+#include "exec/target_page.h"
+#include "qemu/bswap.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qapi/error.h"
 #include "channel.h"
 #include "file.h"
@@ -266,3 +269,223 @@ int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp)
 
     return 0;
 }
+
+/*
+ * With compression, mapped-ram stores the pages of a multifd packet as
+ * an extent: this header, the offsets of the pages in their ramblock,
+ * then the compressed pages.  The index of the ramblock tells which
+ * extent has the current content of each page, extents are never
+ * overwritten.
+ */
+typedef struct {
+    /* size of the pages data */
+    uint32_t size;
+    /* number of pages */
+    uint32_t pages;
+    /* FILE_EXTENT_* flags */
+    uint32_t flags;
+    /* offset of each page in the ramblock */
+    uint64_t offset[];
+} QEMU_PACKED FileExtentHeader;
+
+/* The pages didn't compress and are stored as is */
+#define FILE_EXTENT_RAW (1 << 0)
+
+typedef struct {
+    FileExtentHeader *hdr;
+    /* uncompressed pages */
+    uint8_t *buf;
+    /* compressed pages */
+    uint8_t *zbuf;
+} FileExtentData;
+
+void *file_extent_data_new(void)
+{
+    FileExtentData *x = g_new0(FileExtentData, 1);
+
+    x->hdr = g_malloc0(sizeof(FileExtentHeader) +
+                       multifd_ram_page_count() * sizeof(uint64_t));
+    x->buf = g_malloc(MULTIFD_PACKET_SIZE);
+    x->zbuf = g_malloc(MULTIFD_PACKET_SIZE);
+    return x;
+}
+
+void file_extent_data_free(void *opaque)
+{
+    FileExtentData *x = opaque;
+
+    if (x) {
+        g_free(x->hdr);
+        g_free(x->buf);
+        g_free(x->zbuf);
+        g_free(x);
+    }
+}
+
+/*
+ * Compress the pages of @p with @ops into a new extent of the file, of
+ * p->next_packet_size bytes.  Returns 0 on success, -1 on error.
+ */
+int file_write_ramblock_extent(MultiFDSendParams *p,
+                               const MultiFDMethods *ops, Error **errp)
+{
+    FileExtentData *x = p->file_data;
+    MultiFDPages_t *pages = &p->data->u.ram;
+    RAMBlock *block = pages->block;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t len = pages->normal_num * page_size;
+    struct iovec iov[2];
+    uint64_t extent;
+    size_t hdr_len;
+    uint8_t *data;
+    int size;
+    int i;
+
+    multifd_send_zero_page_detect(p);
+    multifd_set_file_bitmap(p);
+
+    if (!pages->normal_num) {
+        p->next_packet_size = 0;
+        return 0;
+    }
+
+    for (i = 0; i < pages->normal_num; i++) {
+        memcpy(x->buf + i * page_size, block->host + pages->offset[i],
+               page_size);
+        x->hdr->offset[i] = cpu_to_be64(pages->offset[i]);
+    }
+
+    size = ops->file_compress(p, x->buf, len, x->zbuf, len, errp);
+    if (size < 0) {
+        return -1;
+    }
+
+    if (size) {
+        data = x->zbuf;
+        x->hdr->flags = 0;
+    } else {
+        data = x->buf;
+        size = len;
+        x->hdr->flags = cpu_to_be32(FILE_EXTENT_RAW);
+    }
+    x->hdr->size = cpu_to_be32(size);
+    x->hdr->pages = cpu_to_be32(pages->normal_num);
+    hdr_len = sizeof(FileExtentHeader) + pages->normal_num * sizeof(uint64_t);
+
+    extent = qatomic_fetch_add(&block->pages_used, hdr_len + size);
+    if (extent + hdr_len + size > block->pages_size) {
+        error_setg(errp, "no space left for the pages of ramblock %s in "
+                   "the migration file, too many pages were dirtied",
+                   block->idstr);
+        return -1;
+    }
+
+    iov[0].iov_base = x->hdr;
+    iov[0].iov_len = hdr_len;
+    iov[1].iov_base = data;
+    iov[1].iov_len = size;
+    if (qio_channel_pwritev(p->c, iov, 2, block->pages_offset + extent,
+                            errp) < 0) {
+        return -1;
+    }
+
+    /* The pages are now found in this extent */
+    for (i = 0; i < pages->normal_num; i++) {
+        block->file_index[pages->offset[i] >> qemu_target_page_bits()] =
+            extent;
+    }
+
+    trace_file_write_ramblock_extent(p->id, block->idstr, extent,
+                                     pages->normal_num, size);
+    p->next_packet_size = hdr_len + size;
+    return 0;
+}
+
+static int file_read_extent_iov(MultiFDRecvParams *p, struct iovec *iov,
+                                int niov, off_t offset, Error **errp)
+{
+    ssize_t ret = qio_channel_preadv(p->c, iov, niov, offset, errp);
+
+    if (ret < 0) {
+        error_prepend(errp, "multifd recv (%u): ", p->id);
+        return -1;
+    }
+    if (ret != iov_size(iov, niov)) {
+        error_setg(errp, "multifd recv (%u): partial read of extent at "
+                   "file offset 0x%" PRIx64, p->id, (uint64_t)offset);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Read the extent at p->data->file_offset and decompress it with @ops.
+ * Only the pages for which the index of the ramblock points to this
+ * extent are loaded, the others were saved again later.
+ */
+int file_read_ramblock_extent(MultiFDRecvParams *p,
+                              const MultiFDMethods *ops, Error **errp)
+{
+    FileExtentData *x = p->file_data;
+    RAMBlock *block = p->data->block;
+    uint64_t extent = p->data->file_offset - block->pages_offset;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t size, num, flags, len;
+    struct iovec iov[2];
+    uint8_t *data;
+    int i;
+
+    iov[0].iov_base = x->hdr;
+    iov[0].iov_len = sizeof(FileExtentHeader);
+    if (file_read_extent_iov(p, iov, 1, p->data->file_offset, errp)) {
+        return -1;
+    }
+
+    size = be32_to_cpu(x->hdr->size);
+    num = be32_to_cpu(x->hdr->pages);
+    flags = be32_to_cpu(x->hdr->flags);
+    len = num * page_size;
+
+    if (!num || num > multifd_ram_page_count() ||
+        (flags & ~FILE_EXTENT_RAW) ||
+        (flags & FILE_EXTENT_RAW ? size != len : size > len)) {
+        error_setg(errp, "multifd recv (%u): invalid extent at 0x%" PRIx64
+                   " of ramblock %s", p->id, extent, block->idstr);
+        return -1;
+    }
+
+    data = flags & FILE_EXTENT_RAW ? x->buf : x->zbuf;
+    iov[0].iov_base = x->hdr->offset;
+    iov[0].iov_len = num * sizeof(uint64_t);
+    iov[1].iov_base = data;
+    iov[1].iov_len = size;
+    if (file_read_extent_iov(p, iov, 2,
+                             p->data->file_offset + sizeof(FileExtentHeader),
+                             errp)) {
+        return -1;
+    }
+
+    if (!(flags & FILE_EXTENT_RAW) &&
+        ops->file_decompress(p, data, size, x->buf, len, errp)) {
+        return -1;
+    }
+
+    for (i = 0; i < num; i++) {
+        uint64_t offset = be64_to_cpu(x->hdr->offset[i]);
+
+        if (offset >= block->used_length ||
+            !QEMU_IS_ALIGNED(offset, page_size)) {
+            error_setg(errp, "multifd recv (%u): page offset 0x%" PRIx64
+                       " invalid for ramblock %s", p->id, offset,
+                       block->idstr);
+            return -1;
+        }
+
+        if (block->file_index[offset >> qemu_target_page_bits()] == extent) {
+            memcpy(block->host + offset, x->buf + i * page_size, page_size);
+        }
+    }
+
+    trace_file_read_ramblock_extent(p->id, block->idstr, extent, num, size);
+    return 0;
+}
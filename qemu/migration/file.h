@@ -23,4 +23,10 @@ bool file_send_channel_create(gpointer opaque, Error **errp);
 int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
                             int niov, MultiFDPages_t *pages, Error **errp);
 int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp);
+void *file_extent_data_new(void);
+void file_extent_data_free(void *opaque);
+int file_write_ramblock_extent(MultiFDSendParams *p,
+                               const MultiFDMethods *ops, Error **errp);
+int file_read_ramblock_extent(MultiFDRecvParams *p,
+                              const MultiFDMethods *ops, Error **errp);
 #endif
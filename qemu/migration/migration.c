@@ -2095,11 +2095,10 @@ static bool migrate_prepare(MigrationState *s, bool resume, Error **errp)
             error_setg(errp, "Cannot use TLS with mapped-ram");
             return false;
         }
+    }
 
-        if (migrate_multifd_compression()) {
-            error_setg(errp, "Cannot use compression with mapped-ram");
-            return false;
-        }
+    if (!multifd_mapped_ram_compression_check(errp)) {
+        return false;
     }
 
     if (migrate_mode_is_cpr(s)) {
@@ -24,6 +24,8 @@
 #include "qemu-file.h"
 
 static MultiFDSendData *multifd_ram_send;
+/* One queue per channel, if the compression method has page affinity */
+static MultiFDSendData **multifd_ram_send_channel;
 
 void multifd_ram_payload_alloc(MultiFDPages_t *pages)
 {
@@ -38,14 +40,33 @@ void multifd_ram_payload_free(MultiFDPages_t *pages)
 void multifd_ram_save_setup(void)
 {
     multifd_ram_send = multifd_send_data_alloc();
+
+    if (multifd_send_page_affinity()) {
+        int i;
+
+        multifd_ram_send_channel = g_new(MultiFDSendData *,
+                                         migrate_multifd_channels());
+        for (i = 0; i < migrate_multifd_channels(); i++) {
+            multifd_ram_send_channel[i] = multifd_send_data_alloc();
+        }
+    }
 }
 
 void multifd_ram_save_cleanup(void)
 {
     g_clear_pointer(&multifd_ram_send, multifd_send_data_free);
+
+    if (multifd_ram_send_channel) {
+        int i;
+
+        for (i = 0; i < migrate_multifd_channels(); i++) {
+            multifd_send_data_free(multifd_ram_send_channel[i]);
+        }
+        g_clear_pointer(&multifd_ram_send_channel, g_free);
+    }
 }
 
-static void multifd_set_file_bitmap(MultiFDSendParams *p)
+void multifd_set_file_bitmap(MultiFDSendParams *p)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
 
@@ -311,17 +332,33 @@ static inline void multifd_enqueue(MultiFDPages_t *pages, ram_addr_t offset)
     pages->offset[pages->num++] = offset;
 }
 
+/* Send the queue @send_data, through channel @channel unless it is -1 */
+static bool multifd_ram_send_queue(int channel, MultiFDSendData **send_data)
+{
+    if (channel < 0) {
+        return multifd_send(send_data);
+    }
+    return multifd_send_to(channel, send_data);
+}
+
 /* Returns true if enqueue successful, false otherwise */
 bool multifd_queue_page(RAMBlock *block, ram_addr_t offset)
 {
+    MultiFDSendData **send_data = &multifd_ram_send;
     MultiFDPages_t *pages;
+    int channel = -1;
+
+    if (multifd_ram_send_channel) {
+        channel = multifd_send_page_channel(block, offset);
+        send_data = &multifd_ram_send_channel[channel];
+    }
 
 retry:
-    pages = &multifd_ram_send->u.ram;
+    pages = &(*send_data)->u.ram;
 
-    if (multifd_payload_empty(multifd_ram_send)) {
+    if (multifd_payload_empty(*send_data)) {
         multifd_pages_reset(pages);
-        multifd_set_payload_type(multifd_ram_send, MULTIFD_PAYLOAD_RAM);
+        multifd_set_payload_type(*send_data, MULTIFD_PAYLOAD_RAM);
     }
 
     /* If the queue is empty, we can already enqueue now */
@@ -340,7 +377,7 @@ retry:
      * After flush, always retry.
      */
     if (pages->block != block || multifd_queue_full(pages)) {
-        if (!multifd_send(&multifd_ram_send)) {
+        if (!multifd_ram_send_queue(channel, send_data)) {
             return false;
         }
         goto retry;
@@ -409,6 +446,20 @@ int multifd_ram_flush_and_sync(QEMUFile *f)
         }
     }
 
+    if (multifd_ram_send_channel) {
+        int i;
+
+        for (i = 0; i < migrate_multifd_channels(); i++) {
+            if (multifd_payload_empty(multifd_ram_send_channel[i])) {
+                continue;
+            }
+            if (!multifd_send_to(i, &multifd_ram_send_channel[i])) {
+                error_report("%s: multifd_send fail", __func__);
+                return -1;
+            }
+        }
+    }
+
     /* File migrations only need to sync with threads */
     req = migrate_mapped_ram() ? MULTIFD_SYNC_LOCAL : MULTIFD_SYNC_ALL;
 
@@ -0,0 +1,300 @@
+/*
+ * Multifd XBZRLE delta encoding implementation
+ *
+ * Each channel keeps a cache with the last content it sent for a share
+ * of the guest pages.  Pages that are found in the cache are sent as the
+ * XBZRLE encoded difference to that content, which the destination
+ * applies to its copy of the page.  Pages are always queued to the same
+ * channel (see multifd_send_page_channel()), so that the cache of a
+ * channel matches the content of the pages it sends on the destination.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "system/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "migration-stats.h"
+#include "options.h"
+#include "page_cache.h"
+#include "xbzrle.h"
+#include "trace.h"
+#include "multifd.h"
+
+struct xbzrle_data {
+    /* last sent content of the pages of this channel */
+    PageCache *cache;
+    /* copy of the page being encoded, the guest may still be running */
+    uint8_t *page;
+    /* zero page, for the zero pages detected by multifd */
+    uint8_t *zero_page;
+    /* encoded length of each page, see below */
+    uint32_t *lengths;
+    /* encoded pages */
+    uint8_t *buf;
+    /* size of buf */
+    uint32_t buf_len;
+};
+
+/*
+ * The payload of a packet is an array with one big endian length for
+ * each normal page, followed by the data of the pages:
+ *
+ * - a length of 0 means that the page did not change,
+ * - a length of a full page means that the page is sent as is,
+ * - any other length is the size of the XBZRLE encoded difference.
+ */
+
+/*
+ * Key of a page in the cache of its channel.  The channels only see one
+ * in migrate_multifd_channels() pages, so the page numbers are divided
+ * by that to use all the entries of the cache.
+ */
+static uint64_t multifd_xbzrle_cache_key(RAMBlock *block, ram_addr_t offset)
+{
+    uint64_t page = (block->offset + offset) >> qemu_target_page_bits();
+
+    return (page / migrate_multifd_channels()) << qemu_target_page_bits();
+}
+
+/* Multifd XBZRLE delta encoding */
+
+static int multifd_xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x = g_new0(struct xbzrle_data, 1);
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t page_count = multifd_ram_page_count();
+    uint64_t cache_size;
+
+    /* The cache size is split between the channels */
+    cache_size = pow2floor(migrate_xbzrle_cache_size() /
+                           migrate_multifd_channels());
+    x->cache = cache_init(MAX(cache_size, page_size), page_size, errp);
+    if (!x->cache) {
+        error_prepend(errp, "multifd %u: ", p->id);
+        g_free(x);
+        return -1;
+    }
+
+    x->page = g_malloc(page_size);
+    x->zero_page = g_malloc0(page_size);
+    x->lengths = g_new(uint32_t, page_count);
+    x->buf_len = page_count * page_size;
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->buf) {
+        cache_fini(x->cache);
+        g_free(x->page);
+        g_free(x->zero_page);
+        g_free(x->lengths);
+        g_free(x);
+        error_setg(errp, "multifd %u: out of memory for buf", p->id);
+        return -1;
+    }
+    p->compress_data = x;
+
+    /* Needs 3 IOVs, for packet header, lengths and encoded pages */
+    p->iov = g_new0(struct iovec, 3);
+    return 0;
+}
+
+static void multifd_xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->compress_data;
+
+    cache_fini(x->cache);
+    g_free(x->page);
+    g_free(x->zero_page);
+    g_free(x->lengths);
+    g_free(x->buf);
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct xbzrle_data *x = p->compress_data;
+    uint32_t page_size = multifd_ram_page_size();
+    uint64_t age = stat64_get(&mig_stats.dirty_sync_count);
+    /* Like XBZRLE on the main channel, don't cache the first round */
+    bool use_cache = age > 1;
+    uint32_t out_size = 0;
+    uint32_t hits = 0;
+    bool has_normal;
+    uint32_t i;
+
+    has_normal = multifd_send_prepare_common(p);
+
+    if (use_cache) {
+        /* The destination zeroes these pages */
+        for (i = pages->normal_num; i < pages->num; i++) {
+            cache_insert(x->cache,
+                         multifd_xbzrle_cache_key(pages->block,
+                                                  pages->offset[i]),
+                         x->zero_page, age);
+        }
+    }
+
+    if (!has_normal) {
+        goto out;
+    }
+
+    for (i = 0; i < pages->normal_num; i++) {
+        uint64_t key = multifd_xbzrle_cache_key(pages->block,
+                                                pages->offset[i]);
+        uint8_t *out = x->buf + out_size;
+        int len = -1;
+
+        assert(multifd_send_page_channel(pages->block, pages->offset[i]) ==
+               p->id);
+
+        /* Work on a copy, the page may change while we encode it */
+        memcpy(x->page, pages->block->host + pages->offset[i], page_size);
+
+        if (use_cache && cache_is_cached(x->cache, key, age)) {
+            /* Anything as large as the page is sent as is */
+            len = xbzrle_encode_buffer(get_cached_data(x->cache, key),
+                                       x->page, page_size, out,
+                                       page_size - 1);
+            if (len >= 0) {
+                hits++;
+            }
+        }
+        if (len < 0) {
+            memcpy(out, x->page, page_size);
+            len = page_size;
+        }
+        if (use_cache && len) {
+            cache_insert(x->cache, key, x->page, age);
+        }
+
+        x->lengths[i] = cpu_to_be32(len);
+        out_size += len;
+    }
+
+    p->iov[p->iovs_num].iov_base = x->lengths;
+    p->iov[p->iovs_num].iov_len = pages->normal_num * sizeof(uint32_t);
+    p->iovs_num++;
+    p->iov[p->iovs_num].iov_base = x->buf;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = pages->normal_num * sizeof(uint32_t) + out_size;
+
+    trace_multifd_xbzrle_send(p->id, pages->normal_num, hits, out_size);
+
+out:
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *x = g_new0(struct xbzrle_data, 1);
+    uint32_t page_count = multifd_ram_page_count();
+
+    /* Lengths and pages as is at most */
+    x->buf_len = page_count * (sizeof(uint32_t) + multifd_ram_page_size());
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->buf) {
+        g_free(x);
+        error_setg(errp, "multifd %u: out of memory for buf", p->id);
+        return -1;
+    }
+    p->compress_data = x;
+    return 0;
+}
+
+static void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *x = p->compress_data;
+
+    g_free(x->buf);
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_xbzrle_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t lengths_size = p->normal_num * sizeof(uint32_t);
+    uint8_t *data;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    if (in_size < lengths_size || in_size > x->buf_len) {
+        error_setg(errp, "multifd %u: packet size %u invalid for %u pages",
+                   p->id, in_size, p->normal_num);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->buf, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    data = x->buf + lengths_size;
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t len = ldl_be_p(x->buf + i * sizeof(uint32_t));
+        uint8_t *page = p->host + p->normal[i];
+
+        if (len > x->buf + in_size - data) {
+            error_setg(errp, "multifd %u: page %d exceeds the packet",
+                       p->id, i);
+            return -1;
+        }
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        if (len == page_size) {
+            memcpy(page, data, page_size);
+        } else if (len &&
+                   xbzrle_decode_buffer(data, len, page, page_size) < 0) {
+            error_setg(errp, "multifd %u: failed to decode page %d",
+                       p->id, i);
+            return -1;
+        }
+        data += len;
+    }
+
+    return 0;
+}
+
+static const MultiFDMethods multifd_xbzrle_ops = {
+    .page_affinity = true,
+    .send_setup = multifd_xbzrle_send_setup,
+    .send_cleanup = multifd_xbzrle_send_cleanup,
+    .send_prepare = multifd_xbzrle_send_prepare,
+    .recv_setup = multifd_xbzrle_recv_setup,
+    .recv_cleanup = multifd_xbzrle_recv_cleanup,
+    .recv = multifd_xbzrle_recv
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
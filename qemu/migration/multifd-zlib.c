@@ -277,13 +277,87 @@ static int multifd_zlib_recv(MultiFDRecvParams *p, Error **errp)
     return 0;
 }
 
+static int multifd_zlib_file_compress(MultiFDSendParams *p,
+                                      const uint8_t *buf, uint32_t len,
+                                      uint8_t *out, uint32_t out_len,
+                                      Error **errp)
+{
+    struct zlib_data *z = p->compress_data;
+    z_stream *zs = &z->zs;
+    int ret;
+
+    /* Each extent is a complete zlib stream of its own */
+    ret = deflateReset(zs);
+    if (ret != Z_OK) {
+        error_setg(errp, "multifd %u: deflateReset returned %d",
+                   p->id, ret);
+        return -1;
+    }
+
+    zs->avail_in = len;
+    zs->next_in = (uint8_t *)buf;
+    zs->avail_out = out_len;
+    zs->next_out = out;
+
+    ret = deflate(zs, Z_FINISH);
+    if (ret == Z_OK || ret == Z_BUF_ERROR) {
+        /* Not enough space, the caller stores the data as is */
+        return 0;
+    }
+    if (ret != Z_STREAM_END) {
+        error_setg(errp, "multifd %u: deflate returned %d instead of "
+                   "Z_STREAM_END", p->id, ret);
+        return -1;
+    }
+
+    return out_len - zs->avail_out;
+}
+
+static int multifd_zlib_file_decompress(MultiFDRecvParams *p,
+                                        const uint8_t *in, uint32_t in_len,
+                                        uint8_t *buf, uint32_t len,
+                                        Error **errp)
+{
+    struct zlib_data *z = p->compress_data;
+    z_stream *zs = &z->zs;
+    int ret;
+
+    ret = inflateReset(zs);
+    if (ret != Z_OK) {
+        error_setg(errp, "multifd %u: inflateReset returned %d",
+                   p->id, ret);
+        return -1;
+    }
+
+    zs->avail_in = in_len;
+    zs->next_in = (uint8_t *)in;
+    zs->avail_out = len;
+    zs->next_out = buf;
+
+    ret = inflate(zs, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        error_setg(errp, "multifd %u: inflate returned %d instead of "
+                   "Z_STREAM_END", p->id, ret);
+        return -1;
+    }
+    if (zs->avail_out) {
+        error_setg(errp, "multifd %u: inflate generated %u bytes instead "
+                   "of %u", p->id, len - zs->avail_out, len);
+        return -1;
+    }
+
+    return 0;
+}
+
 static const MultiFDMethods multifd_zlib_ops = {
     .send_setup = multifd_zlib_send_setup,
     .send_cleanup = multifd_zlib_send_cleanup,
     .send_prepare = multifd_zlib_send_prepare,
     .recv_setup = multifd_zlib_recv_setup,
     .recv_cleanup = multifd_zlib_recv_cleanup,
-    .recv = multifd_zlib_recv
+    .recv = multifd_zlib_recv,
+    .file_compress = multifd_zlib_file_compress,
+    .file_decompress = multifd_zlib_file_decompress
 };
 
 static void multifd_zlib_register(void)
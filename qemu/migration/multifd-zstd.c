@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include <zstd.h>
+#include <zstd_errors.h>
 #include "qemu/rcu.h"
 #include "system/ramblock.h"
 #include "exec/target_page.h"
@@ -265,13 +266,61 @@ static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
     return 0;
 }
 
+static int multifd_zstd_file_compress(MultiFDSendParams *p,
+                                      const uint8_t *buf, uint32_t len,
+                                      uint8_t *out, uint32_t out_len,
+                                      Error **errp)
+{
+    struct zstd_data *z = p->compress_data;
+    size_t ret;
+
+    /* Each extent is a complete zstd frame of its own */
+    ret = ZSTD_compress2(z->zcs, out, out_len, buf, len);
+    if (ZSTD_isError(ret)) {
+        if (ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall) {
+            /* Not enough space, the caller stores the data as is */
+            return 0;
+        }
+        error_setg(errp, "multifd %u: compress2 error %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+
+    return ret;
+}
+
+static int multifd_zstd_file_decompress(MultiFDRecvParams *p,
+                                        const uint8_t *in, uint32_t in_len,
+                                        uint8_t *buf, uint32_t len,
+                                        Error **errp)
+{
+    struct zstd_data *z = p->compress_data;
+    size_t ret;
+
+    ret = ZSTD_decompressDCtx(z->zds, buf, len, in, in_len);
+    if (ZSTD_isError(ret)) {
+        error_setg(errp, "multifd %u: decompressDCtx returned %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    if (ret != len) {
+        error_setg(errp, "multifd %u: decompressDCtx generated %zu bytes "
+                   "instead of %u", p->id, ret, len);
+        return -1;
+    }
+
+    return 0;
+}
+
 static const MultiFDMethods multifd_zstd_ops = {
     .send_setup = multifd_zstd_send_setup,
     .send_cleanup = multifd_zstd_send_cleanup,
     .send_prepare = multifd_zstd_send_prepare,
     .recv_setup = multifd_zstd_recv_setup,
     .recv_cleanup = multifd_zstd_recv_cleanup,
-    .recv = multifd_zstd_recv
+    .recv = multifd_zstd_recv,
+    .file_compress = multifd_zstd_file_compress,
+    .file_decompress = multifd_zstd_file_decompress
 };
 
 static void multifd_zstd_register(void)
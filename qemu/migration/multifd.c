@@ -164,6 +164,39 @@ void multifd_register_ops(int method, const MultiFDMethods *ops)
     multifd_ops[method] = ops;
 }
 
+/*
+ * Check that the multifd compression method, if any, can be used with
+ * mapped-ram, which needs the file_compress and file_decompress hooks.
+ */
+bool multifd_mapped_ram_compression_check(Error **errp)
+{
+    MultiFDCompression method = migrate_multifd_compression();
+    const MultiFDMethods *ops = multifd_ops[method];
+
+    if (!migrate_mapped_ram() || method == MULTIFD_COMPRESSION_NONE) {
+        return true;
+    }
+
+    if (!migrate_multifd()) {
+        error_setg(errp, "Compression with mapped-ram requires multifd");
+        return false;
+    }
+
+    if (!ops || !ops->file_compress || !ops->file_decompress) {
+        error_setg(errp, "Cannot use %s compression with mapped-ram",
+                   MultiFDCompression_str(method));
+        return false;
+    }
+
+    if (migrate_direct_io()) {
+        error_setg(errp, "Cannot use compression with mapped-ram and "
+                   "direct-io");
+        return false;
+    }
+
+    return true;
+}
+
 static int multifd_send_initial_packet(MultiFDSendParams *p, Error **errp)
 {
     MultiFDInit_t msg = {};
@@ -341,6 +374,36 @@ static void multifd_send_kick_main(MultiFDSendParams *p)
     qemu_sem_post(&multifd_send_state->channels_ready);
 }
 
+/* Give @send_data to the idle channel @p, called with multifd_send_mutex */
+static void multifd_send_hand_over(MultiFDSendParams *p,
+                                   MultiFDSendData **send_data)
+{
+    MultiFDSendData *tmp;
+
+    /*
+     * Make sure we read p->pending_job before all the rest.  Pairs with
+     * qatomic_store_release() in multifd_send_thread().
+     */
+    smp_mb_acquire();
+
+    assert(multifd_payload_empty(p->data));
+
+    /*
+     * Swap the pointers. The channel gets the client data for
+     * transferring and the client gets back an unused data slot.
+     */
+    tmp = *send_data;
+    *send_data = p->data;
+    p->data = tmp;
+
+    /*
+     * Making sure p->data is setup before marking pending_job=true. Pairs
+     * with the qatomic_load_acquire() in multifd_send_thread().
+     */
+    qatomic_store_release(&p->pending_job, true);
+    qemu_sem_post(&p->sem);
+}
+
 /*
  * multifd_send() works by exchanging the MultiFDSendData object
  * provided by the caller with an unused MultiFDSendData object from
@@ -360,7 +423,6 @@ bool multifd_send(MultiFDSendData **send_data)
     int i;
     static int next_channel;
     MultiFDSendParams *p = NULL; /* make happy gcc */
-    MultiFDSendData *tmp;
 
     if (multifd_send_should_exit()) {
         return false;
@@ -392,32 +454,68 @@ bool multifd_send(MultiFDSendData **send_data)
         }
     }
 
-    /*
-     * Make sure we read p->pending_job before all the rest.  Pairs with
-     * qatomic_store_release() in multifd_send_thread().
-     */
-    smp_mb_acquire();
+    multifd_send_hand_over(p, send_data);
+    return true;
+}
 
-    assert(multifd_payload_empty(p->data));
+/*
+ * Like multifd_send(), but always uses channel @id and waits for it to
+ * become idle.  Used for the pages of compression methods with page
+ * affinity.
+ *
+ * Returns true if succeed, false otherwise.
+ */
+bool multifd_send_to(int id, MultiFDSendData **send_data)
+{
+    MultiFDSendParams *p = &multifd_send_state->params[id];
+    int borrowed = 0;
 
-    /*
-     * Swap the pointers. The channel gets the client data for
-     * transferring and the client gets back an unused data slot.
-     */
-    tmp = *send_data;
-    *send_data = p->data;
-    p->data = tmp;
+    if (multifd_send_should_exit()) {
+        return false;
+    }
+
+    QEMU_LOCK_GUARD(&multifd_send_state->multifd_send_mutex);
 
     /*
-     * Making sure p->data is setup before marking pending_job=true. Pairs
-     * with the qatomic_load_acquire() in multifd_send_thread().
+     * channels_ready counts idle channels, not a particular one.  Tokens
+     * of other channels consumed while waiting for this one are given
+     * back afterwards.
      */
-    qatomic_store_release(&p->pending_job, true);
-    qemu_sem_post(&p->sem);
+    while (true) {
+        qemu_sem_wait(&multifd_send_state->channels_ready);
+        if (multifd_send_should_exit()) {
+            return false;
+        }
+        if (qatomic_read(&p->pending_job) == false) {
+            break;
+        }
+        borrowed++;
+    }
+    while (borrowed--) {
+        qemu_sem_post(&multifd_send_state->channels_ready);
+    }
 
+    multifd_send_hand_over(p, send_data);
     return true;
 }
 
+bool multifd_send_page_affinity(void)
+{
+    return multifd_send_state->ops->page_affinity;
+}
+
+/*
+ * Returns the channel through which the page at @offset of @block is
+ * always sent when the compression method has page affinity.  Pages
+ * are interleaved over the channels.
+ */
+int multifd_send_page_channel(RAMBlock *block, ram_addr_t offset)
+{
+    ram_addr_t page = (block->offset + offset) >> qemu_target_page_bits();
+
+    return page % migrate_multifd_channels();
+}
+
 /* Multifd send side hit an error; remember it and prepare to quit */
 static void multifd_send_set_error(Error *err)
 {
@@ -526,6 +624,7 @@ static bool multifd_send_cleanup_channel(MultiFDSendParams *p, Error **errp)
     p->packet = NULL;
     multifd_send_state->ops->send_cleanup(p, errp);
     assert(!p->iov);
+    g_clear_pointer(&p->file_data, file_extent_data_free);
 
     return *errp == NULL;
 }
@@ -702,7 +801,7 @@ static void *multifd_send_thread(void *opaque)
 
             if (is_device_state) {
                 multifd_device_state_send_prepare(p);
-            } else {
+            } else if (!p->file_data) {
                 ret = multifd_send_state->ops->send_prepare(p, &local_err);
                 if (ret != 0) {
                     break;
@@ -716,7 +815,14 @@ static void *multifd_send_thread(void *opaque)
              */
             total_size = iov_size(p->iov, p->iovs_num);
 
-            if (migrate_mapped_ram()) {
+            if (p->file_data) {
+                /* Compressed mapped-ram, the pages go to a new extent */
+                assert(!is_device_state);
+
+                ret = file_write_ramblock_extent(p, multifd_send_state->ops,
+                                                 &local_err);
+                total_size = p->next_packet_size;
+            } else if (migrate_mapped_ram()) {
                 assert(!is_device_state);
 
                 ret = file_write_ramblock_iov(p->c, p->iov, p->iovs_num,
@@ -988,6 +1094,10 @@ bool multifd_send_setup(void)
             goto err;
         }
         assert(p->iov);
+
+        if (migrate_mapped_ram_compressed()) {
+            p->file_data = file_extent_data_new();
+        }
     }
 
     multifd_device_state_send_setup();
@@ -1137,6 +1247,7 @@ static void multifd_recv_cleanup_channel(MultiFDRecvParams *p)
     g_free(p->zero);
     p->zero = NULL;
     multifd_recv_state->ops->recv_cleanup(p);
+    g_clear_pointer(&p->file_data, file_extent_data_free);
 }
 
 static void multifd_recv_cleanup_state(void)
@@ -1380,13 +1491,16 @@ static void *multifd_recv_thread(void *opaque)
                 continue;
             }
 
-            has_data = !!p->data->size;
+            has_data = p->data->size || p->data->block;
         }
 
         if (has_data) {
             if (is_device_state) {
                 assert(use_packets);
                 ret = multifd_device_state_recv(p, &local_err);
+            } else if (!use_packets && p->data->block) {
+                ret = file_read_ramblock_extent(p, multifd_recv_state->ops,
+                                                &local_err);
             } else {
                 ret = multifd_recv_state->ops->recv(p, &local_err);
             }
@@ -1412,6 +1526,7 @@ static void *multifd_recv_thread(void *opaque)
             }
         } else {
             p->data->size = 0;
+            p->data->block = NULL;
             /*
              * Order data->size update before clearing
              * pending_job. Pairs with smp_mb_acquire() at
@@ -1447,6 +1562,10 @@ int multifd_recv_setup(Error **errp)
         return 0;
     }
 
+    if (!multifd_mapped_ram_compression_check(errp)) {
+        return -1;
+    }
+
     thread_count = migrate_multifd_channels();
     multifd_recv_state = g_malloc0(sizeof(*multifd_recv_state));
     multifd_recv_state->params = g_new0(MultiFDRecvParams, thread_count);
@@ -1490,6 +1609,10 @@ int multifd_recv_setup(Error **errp)
         if (ret) {
             return ret;
         }
+
+        if (migrate_mapped_ram_compressed()) {
+            p->file_data = file_extent_data_new();
+        }
     }
     return 0;
 }
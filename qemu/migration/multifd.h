@@ -52,8 +52,11 @@ MultiFDRecvData *multifd_get_recv_data(void);
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
 
-/* We reserve 5 bits for compression methods */
-#define MULTIFD_FLAG_COMPRESSION_MASK (0x1f << 1)
+/*
+ * We reserve 5 bits for compression methods, plus one more after
+ * MULTIFD_FLAG_DEVICE_STATE
+ */
+#define MULTIFD_FLAG_COMPRESSION_MASK ((0x1f << 1) | MULTIFD_FLAG_XBZRLE)
 /* we need to be compatible. Before compression value was 0 */
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
@@ -68,6 +71,9 @@ MultiFDRecvData *multifd_get_recv_data(void);
  */
 #define MULTIFD_FLAG_DEVICE_STATE (32 << 1)
 
+/* Compression method that didn't fit in the 5 bits above */
+#define MULTIFD_FLAG_XBZRLE (64 << 1)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -129,6 +135,11 @@ struct MultiFDRecvData {
     size_t size;
     /* for preadv */
     off_t file_offset;
+    /*
+     * If set, file_offset is an extent of compressed pages of this
+     * ramblock, see file_read_ramblock_extent()
+     */
+    RAMBlock *block;
 };
 
 typedef struct {
@@ -229,6 +240,8 @@ typedef struct {
     uint32_t iovs_num;
     /* used for compression methods */
     void *compress_data;
+    /* used for compressed mapped-ram, see file.c */
+    void *file_data;
 }  MultiFDSendParams;
 
 typedef struct {
@@ -288,11 +301,22 @@ typedef struct {
     uint32_t zero_num;
     /* used for de-compression methods */
     void *compress_data;
+    /* used for compressed mapped-ram, see file.c */
+    void *file_data;
     /* Flags for the QIOChannel */
     int read_flags;
 } MultiFDRecvParams;
 
 typedef struct {
+    /*
+     * Set if the method keeps state about the pages it sent, like the
+     * previous content of a page.  Each page is then always queued to
+     * the same channel, see multifd_send_page_channel(), so that the
+     * state of a page only lives in one channel and updates of a page
+     * reach the destination in order.
+     */
+    bool page_affinity;
+
     /*
      * The send_setup, send_cleanup, send_prepare are only called on
      * the QEMU instance at the migration source.
@@ -369,9 +393,37 @@ typedef struct {
      * Must read the data from the QIOChannel p->c.
      */
     int (*recv)(MultiFDRecvParams *p, Error **errp);
+
+    /*
+     * The file_compress and file_decompress hooks are needed for the
+     * method to be used with mapped-ram, which stores groups of pages
+     * as independent extents of the migration file.
+     */
+
+    /*
+     * Compress the @len bytes at @buf into @out, that can hold @out_len
+     * bytes, independently of any previous data.
+     *
+     * Returns the compressed size, 0 if it doesn't fit in @out, or -1
+     * on error.
+     */
+    int (*file_compress)(MultiFDSendParams *p, const uint8_t *buf,
+                         uint32_t len, uint8_t *out, uint32_t out_len,
+                         Error **errp);
+
+    /*
+     * Decompress the @in_len bytes at @in produced by file_compress, to
+     * exactly @len bytes at @buf.
+     *
+     * Returns 0 on success, -1 on error.
+     */
+    int (*file_decompress)(MultiFDRecvParams *p, const uint8_t *in,
+                           uint32_t in_len, uint8_t *buf, uint32_t len,
+                           Error **errp);
 } MultiFDMethods;
 
 void multifd_register_ops(int method, const MultiFDMethods *ops);
+bool multifd_mapped_ram_compression_check(Error **errp);
 void multifd_send_fill_packet(MultiFDSendParams *p);
 bool multifd_send_prepare_common(MultiFDSendParams *p);
 void multifd_send_zero_page_detect(MultiFDSendParams *p);
@@ -379,6 +431,9 @@ void multifd_recv_zero_page_process(MultiFDRecvParams *p);
 
 void multifd_channel_connect(MultiFDSendParams *p, QIOChannel *ioc);
 bool multifd_send(MultiFDSendData **send_data);
+bool multifd_send_to(int id, MultiFDSendData **send_data);
+bool multifd_send_page_affinity(void);
+int multifd_send_page_channel(RAMBlock *block, ram_addr_t offset);
 MultiFDSendData *multifd_send_data_alloc(void);
 void multifd_send_data_clear(MultiFDSendData *data);
 void multifd_send_data_free(MultiFDSendData *data);
@@ -401,6 +456,7 @@ bool multifd_ram_sync_per_section(void);
 void multifd_ram_payload_alloc(MultiFDPages_t *pages);
 void multifd_ram_payload_free(MultiFDPages_t *pages);
 void multifd_ram_fill_packet(MultiFDSendParams *p);
+void multifd_set_file_bitmap(MultiFDSendParams *p);
 int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp);
 
 void multifd_send_data_clear_device_state(MultiFDDeviceState_t *device_state);
@@ -201,6 +201,8 @@ const Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("mapped-ram-lazy-load",
+                        MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -260,6 +262,13 @@ bool migrate_mapped_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
 }
 
+bool migrate_mapped_ram_lazy_load(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD];
+}
+
 bool migrate_ignore_shared(void)
 {
     MigrationState *s = migrate_get_current();
@@ -360,6 +369,15 @@ bool migrate_zero_copy_send(void)
 
 /* pseudo capabilities */
 
+/*
+ * Mapped-ram files with compressed pages, see file_write_ramblock_extent().
+ */
+bool migrate_mapped_ram_compressed(void)
+{
+    return migrate_mapped_ram() && migrate_multifd() &&
+           migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE;
+}
+
 bool migrate_multifd_flush_after_each_section(void)
 {
     MigrationState *s = migrate_get_current();
@@ -611,6 +629,13 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        error_setg(errp, "Capability 'mapped-ram-lazy-load' requires "
+                   "capability 'mapped-ram'");
+        return false;
+    }
+
     return true;
 }
 
@@ -1129,10 +1154,18 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
     }
 #endif
 
-    if (migrate_mapped_ram() &&
-        (migrate_multifd_compression() || migrate_tls())) {
+    if (params->has_multifd_compression &&
+        params->multifd_compression == MULTIFD_COMPRESSION_XBZRLE &&
+        params->has_zero_page_detection &&
+        params->zero_page_detection == ZERO_PAGE_DETECTION_LEGACY) {
+        error_setg(errp,
+                   "Multifd xbzrle is not compatible with legacy zero page detection");
+        return false;
+    }
+
+    if (migrate_mapped_ram() && migrate_tls()) {
         error_setg(errp,
-                   "Mapped-ram only available for non-compressed non-TLS multifd migration");
+                   "Mapped-ram only available for non-TLS migration");
         return false;
     }
 
@@ -273,6 +273,18 @@ bool qemu_file_is_seekable(QEMUFile *f)
     return qio_channel_has_feature(f->ioc, QIO_CHANNEL_FEATURE_SEEKABLE);
 }
 
+/*
+ * Returns the file descriptor of a QEMUFile on top of a file channel,
+ * that can be mapped, or -1 for other channels.
+ */
+int qemu_file_get_channel_fd(QEMUFile *f)
+{
+    if (!object_dynamic_cast(OBJECT(f->ioc), TYPE_QIO_CHANNEL_FILE)) {
+        return -1;
+    }
+    return QIO_CHANNEL_FILE(f->ioc)->fd;
+}
+
 /**
  * Flushes QEMUFile buffer
  *
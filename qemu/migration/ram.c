@@ -89,6 +89,20 @@
  */
 #define MAPPED_RAM_LOAD_BUF_SIZE 0x100000
 
+/*
+ * With mapped-ram-lazy-load, runs of pages shorter than this are read
+ * instead of mapped, and at most that many mappings are made for a
+ * ramblock, to keep the number of host mappings reasonable.
+ */
+#define MAPPED_RAM_LAZY_MIN_SIZE 0x10000
+#define MAPPED_RAM_LAZY_MAX_MAPPINGS 4096
+
+/*
+ * Size of the area for the compressed pages of a ramblock, relative to
+ * the size of the ramblock.  See mapped_ram_setup_ramblock().
+ */
+#define MAPPED_RAM_COMPRESSED_SIZE_FACTOR 2
+
 XBZRLECacheStats xbzrle_counters;
 
 /* used by the search for pages to send */
@@ -2310,6 +2324,8 @@ static void ram_bitmaps_destroy(void)
         block->bmap = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
+        g_free(block->file_index);
+        block->file_index = NULL;
     }
 }
 
@@ -2697,6 +2713,9 @@ static void ram_list_init_bitmaps(void)
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
+            if (migrate_mapped_ram_compressed()) {
+                block->file_index = g_new0(uint64_t, pages);
+            }
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
         }
@@ -2847,7 +2866,11 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
     }
 }
 
-#define MAPPED_RAM_HDR_VERSION 1
+/*
+ * Version 2 adds the fields needed for compressed pages, uncompressed
+ * migrations keep writing version 1 headers so older QEMUs can load them.
+ */
+#define MAPPED_RAM_HDR_VERSION 2
 struct MappedRamHeader {
     uint32_t version;
     /*
@@ -2865,9 +2888,21 @@ struct MappedRamHeader {
      * are stored.
      */
     uint64_t pages_offset;
+    /* Version 2 */
+    /*
+     * The offset in the migration file where the index of the extent
+     * holding each page is stored, when the pages are compressed.
+     */
+    uint64_t index_offset;
+    /* The size of the area at pages_offset */
+    uint64_t pages_size;
+    /* The MultiFDCompression method of the pages */
+    uint32_t compression;
 } QEMU_PACKED;
 typedef struct MappedRamHeader MappedRamHeader;
 
+#define MAPPED_RAM_HDR_V1_SIZE offsetof(MappedRamHeader, index_offset)
+
 static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
 {
     g_autofree MappedRamHeader *header = NULL;
@@ -2875,7 +2910,8 @@ static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
     long num_pages;
 
     header = g_new0(MappedRamHeader, 1);
-    header_size = sizeof(MappedRamHeader);
+    header_size = migrate_mapped_ram_compressed() ? sizeof(MappedRamHeader) :
+                  MAPPED_RAM_HDR_V1_SIZE;
 
     num_pages = block->used_length >> TARGET_PAGE_BITS;
     bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
@@ -2889,8 +2925,31 @@ static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
     block->pages_offset = ROUND_UP(block->bitmap_offset +
                                    bitmap_size,
                                    MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+    block->pages_size = block->used_length;
+    block->index_offset = 0;
 
-    header->version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+    if (migrate_mapped_ram_compressed()) {
+        /*
+         * The index is also written at the end of migration.  Pages are
+         * appended to the extents area every time they are sent, leave
+         * room for each page to be sent twice.  The file is sparse, the
+         * space that is not used does not take any disk.
+         */
+        block->index_offset = block->pages_offset;
+        block->pages_offset = ROUND_UP(block->index_offset +
+                                       num_pages * sizeof(uint64_t),
+                                       MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+        block->pages_size = MAPPED_RAM_COMPRESSED_SIZE_FACTOR *
+                            block->used_length;
+        block->pages_used = 0;
+
+        header->version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+        header->index_offset = cpu_to_be64(block->index_offset);
+        header->pages_size = cpu_to_be64(block->pages_size);
+        header->compression = cpu_to_be32(migrate_multifd_compression());
+    } else {
+        header->version = cpu_to_be32(1);
+    }
     header->page_size = cpu_to_be64(TARGET_PAGE_SIZE);
     header->bitmap_offset = cpu_to_be64(block->bitmap_offset);
     header->pages_offset = cpu_to_be64(block->pages_offset);
@@ -2898,14 +2957,15 @@ static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
     qemu_put_buffer(file, (uint8_t *) header, header_size);
 
     /* prepare offset for next ramblock */
-    qemu_set_offset(file, block->pages_offset + block->used_length, SEEK_SET);
+    qemu_set_offset(file, block->pages_offset + block->pages_size, SEEK_SET);
 }
 
 static bool mapped_ram_read_header(QEMUFile *file, MappedRamHeader *header,
                                    Error **errp)
 {
-    size_t ret, header_size = sizeof(MappedRamHeader);
+    size_t ret, header_size = MAPPED_RAM_HDR_V1_SIZE;
 
+    memset(header, 0, sizeof(MappedRamHeader));
     ret = qemu_get_buffer(file, (uint8_t *)header, header_size);
     if (ret != header_size) {
         error_setg(errp, "Could not read whole mapped-ram migration header "
@@ -2927,6 +2987,23 @@ static bool mapped_ram_read_header(QEMUFile *file, MappedRamHeader *header,
     header->bitmap_offset = be64_to_cpu(header->bitmap_offset);
     header->pages_offset = be64_to_cpu(header->pages_offset);
 
+    if (header->version < 2) {
+        return true;
+    }
+
+    header_size = sizeof(MappedRamHeader) - MAPPED_RAM_HDR_V1_SIZE;
+    ret = qemu_get_buffer(file, (uint8_t *)header + MAPPED_RAM_HDR_V1_SIZE,
+                          header_size);
+    if (ret != header_size) {
+        error_setg(errp, "Could not read whole mapped-ram migration header "
+                   "(expected %zd, got %zd bytes)", header_size, ret);
+        return false;
+    }
+
+    header->index_offset = be64_to_cpu(header->index_offset);
+    header->pages_size = be64_to_cpu(header->pages_size);
+    header->compression = be32_to_cpu(header->compression);
+
     return true;
 }
 
@@ -3059,6 +3136,20 @@ static void ram_save_file_bmap(QEMUFile *f)
                            block->bitmap_offset);
         ram_transferred_add(bitmap_size);
 
+        if (block->file_index) {
+            long i;
+
+            for (i = 0; i < num_pages; i++) {
+                cpu_to_be64s(&block->file_index[i]);
+            }
+            qemu_put_buffer_at(f, (uint8_t *)block->file_index,
+                               num_pages * sizeof(uint64_t),
+                               block->index_offset);
+            ram_transferred_add(num_pages * sizeof(uint64_t));
+            g_free(block->file_index);
+            block->file_index = NULL;
+        }
+
         /*
          * Free the bitmap here to catch any synchronization issues
          * with multifd channels. No channels should be sending pages
@@ -3606,6 +3697,8 @@ static int ram_load_cleanup(void *opaque)
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         g_free(rb->receivedmap);
         rb->receivedmap = NULL;
+        g_free(rb->file_index);
+        rb->file_index = NULL;
     }
 
     return 0;
@@ -3865,15 +3958,145 @@ static size_t ram_load_multifd_pages(void *host_addr, size_t size,
     return size;
 }
 
+static bool ram_load_multifd_extent(RAMBlock *block, uint64_t extent)
+{
+    MultiFDRecvData *data = multifd_get_recv_data();
+
+    data->opaque = NULL;
+    data->block = block;
+    data->file_offset = block->pages_offset + extent;
+    data->size = 0;
+
+    return multifd_recv();
+}
+
+static bool read_ramblock_range(QEMUFile *f, RAMBlock *block,
+                                ram_addr_t offset, size_t unread,
+                                Error **errp)
+{
+    ERRP_GUARD();
+    void *host;
+    size_t read, size;
+
+    while (unread > 0) {
+        host = host_from_ram_block_offset(block, offset);
+        if (!host) {
+            error_setg(errp, "page outside of ramblock %s range",
+                       block->idstr);
+            return false;
+        }
+
+        size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
+
+        if (migrate_multifd()) {
+            read = ram_load_multifd_pages(host, size,
+                                          block->pages_offset + offset);
+        } else {
+            read = qemu_get_buffer_at(f, host, size,
+                                      block->pages_offset + offset);
+        }
+
+        if (!read) {
+            goto err;
+        }
+        offset += read;
+        unread -= read;
+    }
+
+    return true;
+
+err:
+    qemu_file_get_error_obj(f, errp);
+    error_prepend(errp, "(%s) failed to read page " RAM_ADDR_FMT
+                  "from file offset %" PRIx64 ": ", block->idstr, offset,
+                  block->pages_offset + offset);
+    return false;
+}
+
+/*
+ * Returns the file descriptor to map the pages of @block from with
+ * mapped-ram-lazy-load, or -1 if they have to be read.
+ */
+static int mapped_ram_lazy_load_fd(QEMUFile *f, RAMBlock *block,
+                                   ram_addr_t length)
+{
+    size_t host_page_size = qemu_real_host_page_size();
+    struct stat st;
+    int fd;
+
+    if (!migrate_mapped_ram_lazy_load()) {
+        return -1;
+    }
+
+    fd = qemu_file_get_channel_fd(f);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /*
+     * Only replace memory nobody else knows about: not shared or file
+     * backed memory, nor memory pinned for devices, which discarding
+     * is disabled for.
+     */
+    if (block->fd >= 0 || qemu_ram_is_shared(block) ||
+        block->flags & RAM_PREALLOC || block->guest_memfd >= 0 ||
+        block->page_size != host_page_size || ram_block_discard_is_disabled()) {
+        return -1;
+    }
+
+    if (!QEMU_IS_ALIGNED(block->pages_offset, host_page_size) ||
+        length != block->used_length) {
+        return -1;
+    }
+
+    /* Accessing a mapping past the end of the file would raise SIGBUS */
+    if (fstat(fd, &st) < 0 || st.st_size < block->pages_offset + length) {
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Maps the host pages fully inside the run of @size bytes at @offset of
+ * @block from @fd.  On success, returns true and the part of the run
+ * that was mapped in @start and @end; the rest must be read.
+ */
+static bool mapped_ram_lazy_map(RAMBlock *block, int fd, ram_addr_t offset,
+                                size_t size, ram_addr_t *start,
+                                ram_addr_t *end)
+{
+    size_t host_page_size = qemu_real_host_page_size();
+    int ret;
+
+    *start = ROUND_UP(offset, host_page_size);
+    *end = ROUND_DOWN(offset + size, host_page_size);
+    if (*end < *start + MAPPED_RAM_LAZY_MIN_SIZE) {
+        return false;
+    }
+
+    ret = qemu_ram_map_file_private(block, *start, *end - *start, fd,
+                                    block->pages_offset + *start);
+    if (ret) {
+        warn_report_once("(%s) failed to map pages from the migration "
+                         "file, reading them instead: %s", block->idstr,
+                         strerror(-ret));
+        return false;
+    }
+
+    trace_mapped_ram_lazy_map(block->idstr, *start, *end - *start);
+    return true;
+}
+
 static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                                      long num_pages, unsigned long *bitmap,
                                      Error **errp)
 {
-    ERRP_GUARD();
     unsigned long set_bit_idx, clear_bit_idx;
-    ram_addr_t offset;
-    void *host;
-    size_t read, unread, size;
+    int fd = mapped_ram_lazy_load_fd(f, block, num_pages << TARGET_PAGE_BITS);
+    unsigned int mappings = 0;
+    ram_addr_t offset, start, end;
+    size_t size;
 
     for (set_bit_idx = find_first_bit(bitmap, num_pages);
          set_bit_idx < num_pages;
@@ -3881,49 +4104,95 @@ static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
 
         clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
 
-        unread = TARGET_PAGE_SIZE * (clear_bit_idx - set_bit_idx);
+        size = TARGET_PAGE_SIZE * (clear_bit_idx - set_bit_idx);
         offset = set_bit_idx << TARGET_PAGE_BITS;
 
-        while (unread > 0) {
-            host = host_from_ram_block_offset(block, offset);
-            if (!host) {
-                error_setg(errp, "page outside of ramblock %s range",
-                           block->idstr);
+        /*
+         * Only the pages present in the file are mapped, the others keep
+         * their content as when they are read.
+         */
+        if (fd >= 0 && mappings < MAPPED_RAM_LAZY_MAX_MAPPINGS &&
+            mapped_ram_lazy_map(block, fd, offset, size, &start, &end)) {
+            mappings++;
+            if (!read_ramblock_range(f, block, offset, start - offset,
+                                     errp) ||
+                !read_ramblock_range(f, block, end, offset + size - end,
+                                     errp)) {
                 return false;
             }
+            continue;
+        }
 
-            size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
+        if (!read_ramblock_range(f, block, offset, size, errp)) {
+            return false;
+        }
+    }
 
-            if (migrate_multifd()) {
-                read = ram_load_multifd_pages(host, size,
-                                              block->pages_offset + offset);
-            } else {
-                read = qemu_get_buffer_at(f, host, size,
-                                          block->pages_offset + offset);
-            }
+    return true;
+}
 
-            if (!read) {
-                goto err;
-            }
-            offset += read;
-            unread -= read;
+/*
+ * With compression, the pages are loaded by the multifd channels one
+ * extent at a time, see file_read_ramblock_extent().
+ */
+static bool read_ramblock_mapped_ram_compressed(QEMUFile *f, RAMBlock *block,
+                                                long num_pages,
+                                                unsigned long *bitmap,
+                                                uint64_t index_offset,
+                                                Error **errp)
+{
+    g_autoptr(GHashTable) extents = NULL;
+    size_t index_size = num_pages * sizeof(uint64_t);
+    long i;
+
+    g_free(block->file_index);
+    block->file_index = g_malloc(index_size);
+    if (qemu_get_buffer_at(f, (uint8_t *)block->file_index, index_size,
+                           index_offset) != index_size) {
+        error_setg(errp, "Error reading index of ramblock %s", block->idstr);
+        return false;
+    }
+
+    /*
+     * The index must be complete before any extent is dispatched, the
+     * channels use it to skip the pages that were saved again later.
+     */
+    for (i = 0; i < num_pages; i++) {
+        if (!test_bit(i, bitmap)) {
+            block->file_index[i] = UINT64_MAX;
+            continue;
+        }
+
+        be64_to_cpus(&block->file_index[i]);
+        if (block->file_index[i] >= block->pages_size) {
+            error_setg(errp, "Error reading index of ramblock %s, page %ld "
+                       "is outside of the pages area", block->idstr, i);
+            return false;
         }
     }
 
-    return true;
+    extents = g_hash_table_new(g_int64_hash, g_int64_equal);
+    for (i = find_first_bit(bitmap, num_pages); i < num_pages;
+         i = find_next_bit(bitmap, num_pages, i + 1)) {
+        if (!g_hash_table_add(extents, &block->file_index[i])) {
+            continue;
+        }
 
-err:
-    qemu_file_get_error_obj(f, errp);
-    error_prepend(errp, "(%s) failed to read page " RAM_ADDR_FMT
-                  "from file offset %" PRIx64 ": ", block->idstr, offset,
-                  block->pages_offset + offset);
-    return false;
+        if (!ram_load_multifd_extent(block, block->file_index[i])) {
+            error_setg(errp, "Error loading extent of ramblock %s",
+                       block->idstr);
+            return false;
+        }
+    }
+
+    return true;
 }
 
 static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                                       ram_addr_t length, Error **errp)
 {
     g_autofree unsigned long *bitmap = NULL;
+    MultiFDCompression compression = MULTIFD_COMPRESSION_NONE;
     MappedRamHeader header;
     size_t bitmap_size;
     long num_pages;
@@ -3933,6 +4202,19 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
     }
 
     block->pages_offset = header.pages_offset;
+    block->pages_size = header.version < 2 ? length : header.pages_size;
+
+    if (migrate_mapped_ram_compressed()) {
+        compression = migrate_multifd_compression();
+    }
+    if (header.compression != compression) {
+        error_setg(errp, "Ramblock %s was saved with %s compression, "
+                   "but %s compression is configured", block->idstr,
+                   header.compression < MULTIFD_COMPRESSION__MAX ?
+                   MultiFDCompression_str(header.compression) : "unknown",
+                   MultiFDCompression_str(compression));
+        return;
+    }
 
     /*
      * Check the alignment of the file region that contains pages. We
@@ -3957,12 +4239,17 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
         return;
     }
 
-    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+    if (header.compression) {
+        if (!read_ramblock_mapped_ram_compressed(f, block, num_pages, bitmap,
+                                                 header.index_offset, errp)) {
+            return;
+        }
+    } else if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
         return;
     }
 
     /* Skip pages array */
-    qemu_set_offset(f, block->pages_offset + length, SEEK_SET);
+    qemu_set_offset(f, block->pages_offset + block->pages_size, SEEK_SET);
 }
 
 static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
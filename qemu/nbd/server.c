@@ -28,12 +28,26 @@
 #include "nbd-internal.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "qemu/stats64.h"
 
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_ALLOCATION_DEPTH 1
 /* Dirty bitmaps use 'NBD_META_ID_DIRTY_BITMAP + i', so keep this id last. */
 #define NBD_META_ID_DIRTY_BITMAP 2
 
+/*
+ * Read data below this size is copied into the socket buffers, because
+ * setting up zero copy and processing its completion costs more than the
+ * copy.
+ */
+#define NBD_ZERO_COPY_MIN_SIZE (64 * KiB)
+
+/*
+ * Limit on the data of finished requests that a client keeps around until
+ * the kernel has completed their zero copy sends
+ */
+#define NBD_ZERO_COPY_MAX_PENDING (64 * MiB)
+
 /*
  * NBD_MAX_BLOCK_STATUS_EXTENTS: 1 MiB of extents data. An empirical
  * constant. If an increase is needed, note that the NBD protocol
@@ -83,6 +97,15 @@ struct NBDRequestData {
     NBDClient *client;
     uint8_t *data;
     bool complete;
+
+    /*
+     * Number of zero copy writes on client->sioc, up to and including the
+     * last one that sent from data, or 0 if data was never sent with zero
+     * copy
+     */
+    ssize_t zero_copy_seq;
+    size_t zero_copy_bytes;
+    QSIMPLEQ_ENTRY(NBDRequestData) zero_copy_next;
 };
 
 struct NBDExport {
@@ -101,6 +124,12 @@ struct NBDExport {
     bool allocation_depth;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
+
+    unsigned next_client_ctx; /* round-robin index into common.iothreads */
+
+    bool zero_copy;
+    Stat64 read_bytes;
+    Stat64 zero_copy_bytes;
 };
 
 static QTAILQ_HEAD(, NBDExport) exports = QTAILQ_HEAD_INITIALIZER(exports);
@@ -129,6 +158,7 @@ struct NBDClient {
     QemuMutex lock;
 
     NBDExport *exp;
+    AioContext *ctx; /* non-NULL if requests run outside exp->common.ctx */
     QCryptoTLSCreds *tlscreds;
     char *tlsauthz;
     uint32_t handshake_max_secs;
@@ -143,6 +173,14 @@ struct NBDClient {
     bool read_yielding; /* protected by lock */
     bool quiescing; /* protected by lock */
 
+    bool zero_copy; /* send large read data with zero copy, protected by lock */
+    /*
+     * Finished requests whose data the kernel may still be sending, in the
+     * order of their zero copy writes. Protected by lock.
+     */
+    QSIMPLEQ_HEAD(, NBDRequestData) zero_copy_reqs;
+    size_t zero_copy_pending; /* sum of zero_copy_bytes in zero_copy_reqs */
+
     QTAILQ_ENTRY(NBDClient) next;
     int nb_requests; /* protected by lock */
     bool closing; /* protected by lock */
@@ -159,6 +197,34 @@ struct NBDClient {
 
 static void nbd_client_receive_next_request(NBDClient *client);
 
+/*
+ * Pick the AioContext in which the requests of @client are processed,
+ * spreading the clients of a multithreaded export across its iothreads
+ */
+static void nbd_client_set_aio_context(NBDClient *client)
+{
+    NBDExport *exp = client->exp;
+
+    if (exp->common.iothreads) {
+        client->ctx = blk_exp_get_queue_aio_context(&exp->common,
+                                                    exp->next_client_ctx++);
+    }
+}
+
+static AioContext *nbd_client_aio_context(NBDClient *client)
+{
+    return client->ctx ?: client->exp->common.ctx;
+}
+
+/* TLS encrypts into a buffer of its own, so only plain sockets benefit */
+static void nbd_client_set_zero_copy(NBDClient *client)
+{
+    if (client->exp->zero_copy && client->ioc == QIO_CHANNEL(client->sioc) &&
+        qio_channel_socket_enable_zero_copy(client->sioc)) {
+        client->zero_copy = true;
+    }
+}
+
 /* Basic flow for negotiation
 
    Server         Client
@@ -538,6 +604,8 @@ nbd_negotiate_handle_export_name(NBDClient *client, bool no_zeroes,
 
     QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
     blk_exp_ref(&client->exp->common);
+    nbd_client_set_aio_context(client);
+    nbd_client_set_zero_copy(client);
 
     return 0;
 }
@@ -754,6 +822,8 @@ nbd_negotiate_handle_info(NBDClient *client, Error **errp)
         client->check_align = check_align;
         QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
         blk_exp_ref(&client->exp->common);
+        nbd_client_set_aio_context(client);
+        nbd_client_set_zero_copy(client);
         rc = 1;
     }
     return rc;
@@ -1441,6 +1511,40 @@ static coroutine_fn int nbd_negotiate(NBDClient *client, Error **errp)
     return 0;
 }
 
+/*
+ * Free the data of finished requests once the kernel is done sending it.
+ *
+ * Completions are reported through the socket error queue, which makes the
+ * socket poll as readable and writable until it is emptied; so this must
+ * also be called before yielding on the socket.
+ *
+ * Runs in client AioContext with client->lock held.
+ */
+static void nbd_client_reap_zero_copy(NBDClient *client)
+{
+    NBDRequestData *req;
+    Error *local_err = NULL;
+    ssize_t completed;
+
+    completed = qio_channel_socket_zero_copy_completed(client->sioc,
+                                                       &local_err);
+    if (completed < 0) {
+        /* Keep the data around, it is freed together with the client */
+        trace_nbd_zero_copy_error(error_get_pretty(local_err));
+        error_free(local_err);
+        client->zero_copy = false;
+        return;
+    }
+
+    while ((req = QSIMPLEQ_FIRST(&client->zero_copy_reqs)) &&
+           req->zero_copy_seq <= completed) {
+        QSIMPLEQ_REMOVE_HEAD(&client->zero_copy_reqs, zero_copy_next);
+        client->zero_copy_pending -= req->zero_copy_bytes;
+        qemu_vfree(req->data);
+        g_free(req);
+    }
+}
+
 /* nbd_read_eof
  * Tries to read @size bytes from @ioc. This is a local implementation of
  * qio_channel_readv_all_eof. We have it here because we need it to be
@@ -1463,6 +1567,7 @@ nbd_read_eof(NBDClient *client, void *buffer, size_t size, Error **errp)
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             WITH_QEMU_LOCK_GUARD(&client->lock) {
                 client->read_yielding = true;
+                nbd_client_reap_zero_copy(client);
 
                 /* Prompt main loop thread to re-run nbd_drained_poll() */
                 aio_wait_kick();
@@ -1554,6 +1659,85 @@ static int coroutine_fn nbd_receive_request(NBDClient *client, NBDRequest *reque
 
 #define MAX_NBD_REQUESTS 16
 
+/* How often to check for completions after the client is gone */
+#define NBD_ZERO_COPY_DRAIN_INTERVAL_MS 100
+
+/*
+ * Zero copy requests of a client that went away, whose data may still be
+ * in the socket send queue or on its way to the network device.  The
+ * completions can only be read as long as the socket is open, so it is
+ * kept around until they are all in.
+ */
+typedef struct NBDZeroCopyDrain {
+    QIOChannelSocket *sioc;
+    QSIMPLEQ_HEAD(, NBDRequestData) reqs;
+    QEMUTimer *timer;
+} NBDZeroCopyDrain;
+
+/* Runs in main loop thread */
+static void nbd_zero_copy_drain_cb(void *opaque)
+{
+    NBDZeroCopyDrain *drain = opaque;
+    NBDRequestData *req;
+    Error *local_err = NULL;
+    ssize_t completed;
+
+    completed = qio_channel_socket_zero_copy_completed(drain->sioc,
+                                                       &local_err);
+    if (completed < 0) {
+        /*
+         * There is no telling when the kernel is done with the data, so
+         * leak it rather than letting it be reused while it is being sent
+         */
+        trace_nbd_zero_copy_error(error_get_pretty(local_err));
+        error_free(local_err);
+        QSIMPLEQ_INIT(&drain->reqs);
+    }
+
+    while ((req = QSIMPLEQ_FIRST(&drain->reqs)) &&
+           req->zero_copy_seq <= completed) {
+        QSIMPLEQ_REMOVE_HEAD(&drain->reqs, zero_copy_next);
+        qemu_vfree(req->data);
+        g_free(req);
+    }
+
+    if (!QSIMPLEQ_EMPTY(&drain->reqs)) {
+        timer_mod(drain->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                                NBD_ZERO_COPY_DRAIN_INTERVAL_MS);
+        return;
+    }
+
+    timer_free(drain->timer);
+    object_unref(OBJECT(drain->sioc));
+    g_free(drain);
+}
+
+/*
+ * Frees the data of the zero copy requests of @client once the kernel is
+ * done sending it.  The socket has been shut down, so the remaining data
+ * is either acknowledged by the peer soon or dropped when the connection
+ * times out, and the completions follow.
+ *
+ * Runs in main loop thread.
+ */
+static void nbd_client_drain_zero_copy(NBDClient *client)
+{
+    NBDZeroCopyDrain *drain;
+
+    if (QSIMPLEQ_EMPTY(&client->zero_copy_reqs)) {
+        return;
+    }
+
+    drain = g_new0(NBDZeroCopyDrain, 1);
+    drain->sioc = client->sioc;
+    object_ref(OBJECT(drain->sioc));
+    QSIMPLEQ_INIT(&drain->reqs);
+    QSIMPLEQ_CONCAT(&drain->reqs, &client->zero_copy_reqs);
+    drain->timer = aio_timer_new(qemu_get_aio_context(), QEMU_CLOCK_REALTIME,
+                                 SCALE_MS, nbd_zero_copy_drain_cb, drain);
+    nbd_zero_copy_drain_cb(drain);
+}
+
 /* Runs in export AioContext and main loop thread */
 void nbd_client_get(NBDClient *client)
 {
@@ -1570,6 +1754,7 @@ void nbd_client_put(NBDClient *client)
          */
         assert(client->closing);
 
+        nbd_client_drain_zero_copy(client);
         object_unref(OBJECT(client->sioc));
         object_unref(OBJECT(client->ioc));
         if (client->tlscreds) {
@@ -1653,10 +1838,17 @@ static void nbd_request_put(NBDRequestData *req)
 {
     NBDClient *client = req->client;
 
-    if (req->data) {
-        qemu_vfree(req->data);
+    if (req->zero_copy_seq) {
+        /* The kernel may still be sending from req->data */
+        QSIMPLEQ_INSERT_TAIL(&client->zero_copy_reqs, req, zero_copy_next);
+        client->zero_copy_pending += req->zero_copy_bytes;
+        nbd_client_reap_zero_copy(client);
+    } else {
+        if (req->data) {
+            qemu_vfree(req->data);
+        }
+        g_free(req);
     }
-    g_free(req);
 
     client->nb_requests--;
 
@@ -1727,7 +1919,7 @@ static void nbd_drained_end(void *opaque)
     }
 }
 
-/* Runs in export AioContext */
+/* Runs in the client's AioContext */
 static void nbd_wake_read_bh(void *opaque)
 {
     NBDClient *client = opaque;
@@ -1753,7 +1945,7 @@ static bool nbd_drained_poll(void *opaque)
                  * qio_channel_yield().
                  */
                 if (client->recv_coroutine != NULL && client->read_yielding) {
-                    aio_bh_schedule_oneshot(nbd_export_aio_context(client->exp),
+                    aio_bh_schedule_oneshot(nbd_client_aio_context(client),
                                             nbd_wake_read_bh, client);
                 }
 
@@ -1931,6 +2123,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     }
 
     exp->allocation_depth = arg->allocation_depth;
+    exp->zero_copy = arg->zero_copy;
 
     /*
      * We need to inhibit request queuing in the block layer to ensure we can
@@ -2023,6 +2216,14 @@ static void nbd_export_delete(BlockExport *blk_exp)
     }
 }
 
+static void nbd_export_query(BlockExport *blk_exp, BlockExportInfo *info)
+{
+    NBDExport *exp = container_of(blk_exp, NBDExport, common);
+
+    info->u.nbd.read_bytes = stat64_get(&exp->read_bytes);
+    info->u.nbd.zero_copy_bytes = stat64_get(&exp->zero_copy_bytes);
+}
+
 const BlockExportDriver blk_exp_nbd = {
     .type               = BLOCK_EXPORT_TYPE_NBD,
     .instance_size      = sizeof(NBDExport),
@@ -2030,6 +2231,8 @@ const BlockExportDriver blk_exp_nbd = {
     .create             = nbd_export_create,
     .delete             = nbd_export_delete,
     .request_shutdown   = nbd_export_request_shutdown,
+    .query              = nbd_export_query,
+    .supports_multithread = true,
 };
 
 static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
@@ -2049,6 +2252,94 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     return ret;
 }
 
+/*
+ * Send @len bytes of @req's data with zero copy. Falls back to a normal
+ * send if the kernel refuses zero copy, typically because the process has
+ * reached its limit for locked memory. Caller must hold client->send_lock.
+ */
+static int coroutine_fn nbd_co_write_zero_copy(NBDClient *client,
+                                               NBDRequestData *req,
+                                               uint8_t *buf, size_t len,
+                                               Error **errp)
+{
+    NBDExport *exp = client->exp;
+
+    while (len > 0) {
+        struct iovec iov = { .iov_base = buf, .iov_len = len };
+        ssize_t ret;
+
+        ret = qio_channel_writev_full(client->ioc, &iov, 1, NULL, 0,
+                                      QIO_CHANNEL_WRITE_FLAG_ZERO_COPY, NULL);
+        if (ret == QIO_CHANNEL_ERR_BLOCK) {
+            WITH_QEMU_LOCK_GUARD(&client->lock) {
+                nbd_client_reap_zero_copy(client);
+            }
+            qio_channel_yield(client->ioc, G_IO_OUT);
+            continue;
+        }
+        if (ret < 0) {
+            /* A failed sendmsg() did not send anything, resend with a copy */
+            trace_nbd_co_write_zero_copy_fallback(len);
+            WITH_QEMU_LOCK_GUARD(&client->lock) {
+                client->zero_copy = false;
+            }
+            return qio_channel_write_all(client->ioc, (char *)buf, len,
+                                         errp) < 0 ? -EIO : 0;
+        }
+
+        req->zero_copy_seq = client->sioc->zero_copy_queued;
+        req->zero_copy_bytes += ret;
+        stat64_add(&exp->zero_copy_bytes, ret);
+        buf += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+/*
+ * Send a reply whose last element in @iov is read data from @req->data,
+ * with zero copy for the data if it is large enough.
+ */
+static int coroutine_fn nbd_co_send_read_iov(NBDClient *client,
+                                             NBDRequestData *req,
+                                             struct iovec *iov, unsigned niov,
+                                             Error **errp)
+{
+    struct iovec *data_iov = &iov[niov - 1];
+    bool zero_copy = false;
+    int ret;
+
+    stat64_add(&client->exp->read_bytes, data_iov->iov_len);
+
+    if (data_iov->iov_len >= NBD_ZERO_COPY_MIN_SIZE) {
+        WITH_QEMU_LOCK_GUARD(&client->lock) {
+            zero_copy = client->zero_copy &&
+                client->zero_copy_pending + data_iov->iov_len <=
+                NBD_ZERO_COPY_MAX_PENDING;
+        }
+    }
+    if (!zero_copy) {
+        return nbd_co_send_iov(client, iov, niov, errp);
+    }
+
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+
+    /* The headers live on the stack and must be copied */
+    ret = qio_channel_writev_all(client->ioc, iov, niov - 1, errp) < 0 ?
+          -EIO : 0;
+    if (ret == 0) {
+        ret = nbd_co_write_zero_copy(client, req, data_iov->iov_base,
+                                     data_iov->iov_len, errp);
+    }
+
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+
+    return ret;
+}
+
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
                                        uint64_t cookie)
 {
@@ -2140,6 +2431,7 @@ static int coroutine_fn nbd_co_send_chunk_done(NBDClient *client,
 }
 
 static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
+                                               NBDRequestData *req,
                                                NBDRequest *request,
                                                uint64_t offset,
                                                void *data,
@@ -2161,7 +2453,7 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
                  NBD_REPLY_TYPE_OFFSET_DATA, request);
     stq_be_p(&chunk.offset, offset);
 
-    return nbd_co_send_iov(client, iov, 3, errp);
+    return nbd_co_send_read_iov(client, req, iov, 3, errp);
 }
 
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
@@ -2195,6 +2487,7 @@ static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
  * reported to the client, at which point this function succeeds.
  */
 static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
+                                                NBDRequestData *req,
                                                 NBDRequest *request,
                                                 uint64_t offset,
                                                 uint8_t *data,
@@ -2247,8 +2540,9 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
                 error_setg_errno(errp, -ret, "reading from file failed");
                 break;
             }
-            ret = nbd_co_send_chunk_read(client, request, offset + progress,
-                                         data + progress, pnum, final, errp);
+            ret = nbd_co_send_chunk_read(client, req, request,
+                                         offset + progress, data + progress,
+                                         pnum, final, errp);
         }
 
         if (ret < 0) {
@@ -2843,10 +3137,11 @@ static coroutine_fn int nbd_send_generic_reply(NBDClient *client,
  * Return -errno if sending fails. Other errors are reported directly to the
  * client as an error reply. */
 static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
-                                        uint8_t *data, Error **errp)
+                                        NBDRequestData *req, Error **errp)
 {
     int ret;
     NBDExport *exp = client->exp;
+    uint8_t *data = req->data;
 
     assert(request->type == NBD_CMD_READ);
     assert(request->len <= NBD_MAX_BUFFER_SIZE);
@@ -2863,7 +3158,7 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
     if (client->mode >= NBD_MODE_STRUCTURED &&
         !(request->flags & NBD_CMD_FLAG_DF) && request->len)
     {
-        return nbd_co_send_sparse_read(client, request, request->from,
+        return nbd_co_send_sparse_read(client, req, request, request->from,
                                        data, request->len, errp);
     }
 
@@ -2875,12 +3170,13 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
 
     if (client->mode >= NBD_MODE_STRUCTURED) {
         if (request->len) {
-            return nbd_co_send_chunk_read(client, request, request->from, data,
-                                          request->len, true, errp);
+            return nbd_co_send_chunk_read(client, req, request, request->from,
+                                          data, request->len, true, errp);
         } else {
             return nbd_co_send_chunk_done(client, request, errp);
         }
     } else {
+        stat64_add(&exp->read_bytes, request->len);
         return nbd_co_send_simple_reply(client, request, 0,
                                         data, request->len, errp);
     }
@@ -2914,8 +3210,9 @@ static coroutine_fn int nbd_do_cmd_cache(NBDClient *client, NBDRequest *request,
  * client as an error reply. */
 static coroutine_fn int nbd_handle_request(NBDClient *client,
                                            NBDRequest *request,
-                                           uint8_t *data, Error **errp)
+                                           NBDRequestData *req, Error **errp)
 {
+    uint8_t *data = req->data;
     int ret;
     int flags;
     NBDExport *exp = client->exp;
@@ -2943,7 +3240,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
         return nbd_do_cmd_cache(client, request, errp);
 
     case NBD_CMD_READ:
-        return nbd_do_cmd_read(client, request, data, errp);
+        return nbd_do_cmd_read(client, request, req, errp);
 
     case NBD_CMD_WRITE:
         flags = 0;
@@ -3145,7 +3442,7 @@ static coroutine_fn void nbd_trip(void *opaque)
                                      error_get_pretty(export_err), &local_err);
         error_free(export_err);
     } else {
-        ret = nbd_handle_request(client, &request, req->data, &local_err);
+        ret = nbd_handle_request(client, &request, req, &local_err);
     }
     if (request.contexts && request.contexts != &client->contexts) {
         assert(request.type == NBD_CMD_BLOCK_STATUS);
@@ -3207,7 +3504,7 @@ static void nbd_client_receive_next_request(NBDClient *client)
         nbd_client_get(client);
         req = nbd_request_get(client);
         client->recv_coroutine = qemu_coroutine_create(nbd_trip, req);
-        aio_co_schedule(client->exp->common.ctx, client->recv_coroutine);
+        aio_co_schedule(nbd_client_aio_context(client), client->recv_coroutine);
     }
 }
 
@@ -3276,6 +3573,7 @@ void nbd_client_new(QIOChannelSocket *sioc,
 
     client = g_new0(NBDClient, 1);
     qemu_mutex_init(&client->lock);
+    QSIMPLEQ_INIT(&client->zero_copy_reqs);
     client->refcount = 1;
     client->tlscreds = tlscreds;
     if (tlscreds) {
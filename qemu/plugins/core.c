@@ -457,6 +457,105 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->regular = regular_cb;
 }
 
+static struct qemu_plugin_mem_buffer_vcpu *
+plugin_mem_buffer_vcpu(struct qemu_plugin_mem_buffer *buf,
+                       unsigned int vcpu_index)
+{
+    GArray *arr = buf->score->data;
+
+    return (void *)(arr->data + vcpu_index * g_array_get_element_size(arr));
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                             unsigned int vcpu_index)
+{
+    struct qemu_plugin_mem_buffer_vcpu *b =
+        plugin_mem_buffer_vcpu(buf, vcpu_index);
+
+    if (b->n) {
+        buf->cb(vcpu_index, b->records, b->n, buf->userp);
+        b->n = 0;
+    }
+}
+
+static void plugin_mem_buffer_flush__cb(unsigned int vcpu_index, void *udata)
+{
+    plugin_mem_buffer_flush(udata, vcpu_index);
+}
+
+static void plugin_mem_buffer_append(struct qemu_plugin_mem_buffer_cb *cb,
+                                     unsigned int vcpu_index, uint64_t vaddr,
+                                     qemu_plugin_meminfo_t info)
+{
+    struct qemu_plugin_mem_buffer_vcpu *b =
+        plugin_mem_buffer_vcpu(cb->buf, vcpu_index);
+    struct qemu_plugin_mem_record *rec;
+
+    if (b->n == cb->buf->capacity) {
+        plugin_mem_buffer_flush(cb->buf, vcpu_index);
+    }
+    rec = &b->records[b->n++];
+    rec->vaddr = vaddr;
+    rec->pc = cb->pc;
+    rec->info = info;
+}
+
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records,
+                      qemu_plugin_vcpu_mem_buffer_cb_t cb, void *udata)
+{
+    struct qemu_plugin_mem_buffer *buf = g_new0(struct qemu_plugin_mem_buffer,
+                                                1);
+
+    buf->capacity = MAX(n_records, QEMU_PLUGIN_MEM_BUFFER_MIN_RECORDS);
+    buf->cb = cb;
+    buf->userp = udata;
+    buf->score = plugin_scoreboard_new(
+        sizeof(struct qemu_plugin_mem_buffer_vcpu) +
+        buf->capacity * sizeof(struct qemu_plugin_mem_record));
+    return buf;
+}
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf)
+{
+    plugin_scoreboard_free(buf->score);
+    g_free(buf);
+}
+
+void plugin_register_vcpu_mem_buffer(GArray **arr,
+                                     enum qemu_plugin_mem_rw rw,
+                                     struct qemu_plugin_mem_buffer *buf,
+                                     uint64_t pc)
+{
+    static TCGHelperInfo info = {
+        .flags = TCG_CALL_NO_RWG,
+        /*
+         * Match plugin_mem_buffer_flush__cb:
+         *   void (*)(uint32_t, void *)
+         */
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(i32, 1) |
+                     dh_typemask(ptr, 2))
+    };
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_mem_buffer_cb buffer_cb = {
+        .f.vcpu_udata = plugin_mem_buffer_flush__cb,
+        .info = &info,
+        .buf = buf,
+        .pc = pc,
+        .rw = rw,
+    };
+    dyn_cb->type = PLUGIN_CB_MEM_BUFFER;
+    dyn_cb->mem_buffer = buffer_cb;
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -626,14 +725,208 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                 exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
             }
             break;
+        case PLUGIN_CB_MEM_BUFFER:
+            if (rw & cb->mem_buffer.rw) {
+                plugin_mem_buffer_append(&cb->mem_buffer, cpu->cpu_index,
+                                         vaddr, make_plugin_meminfo(oi, rw));
+            }
+            break;
         default:
             g_assert_not_reached();
         }
     }
 }
 
+/*
+ * PC sampling
+ *
+ * A host thread periodically queues async work on every vCPU, which
+ * then reports its own PC. This keeps the generated code untouched and
+ * lets the plugin aggregate samples per vCPU without locking: the
+ * callback runs outside of @lock, which only covers the bookkeeping.
+ * Queued work may outlive the sampler (e.g. for a vCPU blocked in a
+ * syscall), hence the reference count.
+ */
+struct qemu_plugin_sampler {
+    qemu_plugin_vcpu_sample_cb_t cb;
+    void *udata;
+    unsigned long period_us;
+    QemuThread thread;
+    /* @lock protects @running, @pending and @active */
+    QemuMutex lock;
+    bool running;
+    /* vCPUs with a sample request in flight */
+    GHashTable *pending;
+    /* callbacks in progress, waited for when stopping */
+    unsigned int active;
+    QemuCond active_cond;
+    int refcnt;
+};
+
+static void plugin_sampler_unref(struct qemu_plugin_sampler *s)
+{
+    if (qatomic_fetch_dec(&s->refcnt) == 1) {
+        g_hash_table_destroy(s->pending);
+        qemu_cond_destroy(&s->active_cond);
+        qemu_mutex_destroy(&s->lock);
+        g_free(s);
+    }
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+static void plugin_sample__async(CPUState *cpu, run_on_cpu_data data)
+{
+    struct qemu_plugin_sampler *s = data.host_ptr;
+    bool running;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        g_hash_table_remove(s->pending, GINT_TO_POINTER(cpu->cpu_index));
+        running = s->running;
+        s->active += running;
+    }
+
+    if (running) {
+        s->cb(cpu->cpu_index, cpu->cc->get_pc(cpu), s->udata);
+
+        WITH_QEMU_LOCK_GUARD(&s->lock) {
+            if (--s->active == 0) {
+                qemu_cond_broadcast(&s->active_cond);
+            }
+        }
+    }
+    plugin_sampler_unref(s);
+}
+
+static void plugin_sample_cpu__locked(gpointer k, gpointer v, gpointer udata)
+{
+    CPUState *cpu = container_of(k, CPUState, cpu_index);
+    struct qemu_plugin_sampler *s = udata;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        /* a vCPU that did not answer the previous request is not queued */
+        if (!s->running ||
+            !g_hash_table_add(s->pending, GINT_TO_POINTER(cpu->cpu_index))) {
+            return;
+        }
+        qatomic_inc(&s->refcnt);
+    }
+    async_run_on_cpu(cpu, plugin_sample__async, RUN_ON_CPU_HOST_PTR(s));
+}
+
+static void *plugin_sampler_thread(void *opaque)
+{
+    struct qemu_plugin_sampler *s = opaque;
+
+    while (qatomic_read(&s->running)) {
+        g_usleep(s->period_us);
+        /*
+         * plugin.lock is held while the sampler is stopped and joined,
+         * so never block on it; a busy lock only skips one sample.
+         */
+        if (qemu_rec_mutex_trylock(&plugin.lock) != 0) {
+            continue;
+        }
+        g_hash_table_foreach(plugin.cpu_ht, plugin_sample_cpu__locked, s);
+        qemu_rec_mutex_unlock(&plugin.lock);
+    }
+    return NULL;
+}
+
+void plugin_sampler_stop__locked(struct qemu_plugin_ctx *ctx)
+{
+    struct qemu_plugin_sampler *s = ctx->sampler;
+
+    if (s == NULL) {
+        return;
+    }
+    ctx->sampler = NULL;
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        qatomic_set(&s->running, false);
+        /* no sample is reported once the sampler is stopped */
+        while (s->active) {
+            qemu_cond_wait(&s->active_cond, &s->lock);
+        }
+    }
+    qemu_thread_join(&s->thread);
+    plugin_sampler_unref(s);
+}
+
+/*
+ * fork() in *-user: the sampler thread does not exist in the child. Hold
+ * @lock across the fork so that no vCPU is half-way through a sample, then
+ * reset the state in the child and give it a new thread.
+ */
+static void plugin_sampler_prefork__locked(struct qemu_plugin_ctx *ctx)
+{
+    if (ctx->sampler) {
+        qemu_mutex_lock(&ctx->sampler->lock);
+    }
+}
+
+static void plugin_sampler_postfork__locked(struct qemu_plugin_ctx *ctx,
+                                            bool is_child)
+{
+    struct qemu_plugin_sampler *s = ctx->sampler;
+
+    if (s == NULL) {
+        return;
+    }
+    if (!is_child) {
+        qemu_mutex_unlock(&s->lock);
+        return;
+    }
+
+    qemu_mutex_init(&s->lock);
+    qemu_cond_init(&s->active_cond);
+    /* the callbacks of the other vCPU threads are gone with them */
+    s->active = 0;
+    qemu_thread_create(&s->thread, "plugin-sampler", plugin_sampler_thread,
+                       s, QEMU_THREAD_JOINABLE);
+}
+
+void plugin_register_sample_cb(qemu_plugin_id_t id, unsigned int freq_hz,
+                               qemu_plugin_vcpu_sample_cb_t cb, void *udata)
+{
+    struct qemu_plugin_ctx *ctx;
+    struct qemu_plugin_sampler *s;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    ctx = plugin_id_to_ctx_locked(id);
+    plugin_sampler_stop__locked(ctx);
+    if (freq_hz == 0 || cb == NULL) {
+        return;
+    }
+
+    s = g_new0(struct qemu_plugin_sampler, 1);
+    s->cb = cb;
+    s->udata = udata;
+    s->period_us = MAX(G_USEC_PER_SEC / freq_hz, 1);
+    qemu_mutex_init(&s->lock);
+    qemu_cond_init(&s->active_cond);
+    s->running = true;
+    s->pending = g_hash_table_new(NULL, NULL);
+    s->refcnt = 1;
+    ctx->sampler = s;
+    qemu_thread_create(&s->thread, "plugin-sampler", plugin_sampler_thread,
+                       s, QEMU_THREAD_JOINABLE);
+}
+
 void qemu_plugin_atexit_cb(void)
 {
+    struct qemu_plugin_ctx *ctx;
+
+    /* no more samples once plugins start reporting */
+    qemu_rec_mutex_lock(&plugin.lock);
+    QTAILQ_FOREACH(ctx, &plugin.ctxs, entry) {
+        plugin_sampler_stop__locked(ctx);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
     plugin_cb__udata(QEMU_PLUGIN_EV_ATEXIT);
 }
 
@@ -696,17 +989,27 @@ void qemu_plugin_user_exit(void)
 
 void qemu_plugin_user_prefork_lock(void)
 {
+    struct qemu_plugin_ctx *ctx;
+
     qemu_rec_mutex_lock(&plugin.lock);
+    QTAILQ_FOREACH(ctx, &plugin.ctxs, entry) {
+        plugin_sampler_prefork__locked(ctx);
+    }
 }
 
 void qemu_plugin_user_postfork(bool is_child)
 {
+    struct qemu_plugin_ctx *ctx;
+
     if (is_child) {
         /* should we just reset via plugin_init? */
         qemu_rec_mutex_init(&plugin.lock);
-    } else {
-        qemu_rec_mutex_unlock(&plugin.lock);
+        qemu_rec_mutex_lock(&plugin.lock);
     }
+    QTAILQ_FOREACH(ctx, &plugin.ctxs, entry) {
+        plugin_sampler_postfork__locked(ctx, is_child);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
 }
 
 static bool plugin_dyn_cb_arr_cmp(const void *ap, const void *bp)
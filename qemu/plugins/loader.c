@@ -330,6 +330,7 @@ static void plugin_reset_destroy__locked(struct qemu_plugin_reset_data *data)
      * work environment (i.e. all vCPUs are asleep), or no vCPUs have yet been
      * created.
      */
+    plugin_sampler_stop__locked(ctx);
     for (ev = 0; ev < QEMU_PLUGIN_EV_MAX; ev++) {
         plugin_unregister_cb__locked(ctx, ev);
     }
@@ -52,10 +52,13 @@ struct qemu_plugin_state {
 };
 
 
+struct qemu_plugin_sampler;
+
 struct qemu_plugin_ctx {
     GModule *handle;
     qemu_plugin_id_t id;
     struct qemu_plugin_cb *callbacks[QEMU_PLUGIN_EV_MAX];
+    struct qemu_plugin_sampler *sampler;
     QTAILQ_ENTRY(qemu_plugin_ctx) entry;
     /*
      * keep a reference to @desc until uninstall, so that plugins do not have
@@ -109,6 +112,25 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+void plugin_register_vcpu_mem_buffer(GArray **arr,
+                                     enum qemu_plugin_mem_rw rw,
+                                     struct qemu_plugin_mem_buffer *buf,
+                                     uint64_t pc);
+
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records,
+                      qemu_plugin_vcpu_mem_buffer_cb_t cb, void *udata);
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+void plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                             unsigned int vcpu_index);
+
+void plugin_register_sample_cb(qemu_plugin_id_t id, unsigned int freq_hz,
+                               qemu_plugin_vcpu_sample_cb_t cb, void *udata);
+
+void plugin_sampler_stop__locked(struct qemu_plugin_ctx *ctx);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index);
@@ -44,6 +44,7 @@
 #include "qemu/sockets.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "qemu/rcu.h"
 #include "qom/object_interfaces.h"
 #include "system/block-backend.h"
 #include "block/block_int.h"
@@ -86,6 +87,7 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_THREADS = 278,
 };
 
 typedef enum OutputFormat {
@@ -205,7 +207,9 @@ void help(void)
            "Parameters to convert subcommand:\n"
            "  '--bitmaps' copies all top-level persistent bitmaps to destination\n"
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
-           "       process (defaults to 8)\n"
+           "       process (defaults to 8), per thread if '--threads' is given\n"
+           "  '--threads' specifies how many threads run the convert process\n"
+           "       (defaults to 1)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
@@ -219,6 +223,8 @@ void help(void)
            "  '-f' first image format\n"
            "  '-F' second image format\n"
            "  '-s' run in Strict mode - fail on different image size or sector allocation\n"
+           "  '--threads' specifies how many threads compare the images in parallel\n"
+           "       (defaults to 1)\n"
            "\n"
            "Parameters to dd subcommand:\n"
            "  'bs=BYTES' read and write up to BYTES bytes at a time "
@@ -1273,6 +1279,33 @@ static int is_allocated_sectors_min(const uint8_t *buf, int n, int *pnum,
     return 1;
 }
 
+/*
+ * Like is_allocated_sectors, but for whole clusters of 'cluster_sectors'
+ * sectors (except maybe the last one): returns whether the first cluster
+ * contains non-zero data, and sets *pnum to the number of sectors of the
+ * clusters that follow it in the same state.
+ */
+static int is_allocated_clusters(const uint8_t *buf, int n, int *pnum,
+                                 int cluster_sectors)
+{
+    int i, len;
+    bool is_zero;
+
+    len = MIN(n, cluster_sectors);
+    is_zero = buffer_is_zero(buf, len * BDRV_SECTOR_SIZE);
+
+    for (i = len; i < n; i += len) {
+        len = MIN(n - i, cluster_sectors);
+        if (buffer_is_zero(buf + i * BDRV_SECTOR_SIZE,
+                           len * BDRV_SECTOR_SIZE) != is_zero) {
+            break;
+        }
+    }
+
+    *pnum = i;
+    return !is_zero;
+}
+
 /*
  * Compares two buffers chunk by chunk, where @chsize is the chunk size.
  * If @chsize is 0, default chunk size of BDRV_SECTOR_SIZE is used.
@@ -1310,6 +1343,85 @@ static int compare_buffers(const uint8_t *buf1, const uint8_t *buf2,
 
 #define IO_BUF_SIZE (2 * MiB)
 
+#define MAX_THREADS 256
+
+/*
+ * Worker threads for convert and compare.  Each of them runs its own
+ * AioContext, so that coroutines entered there do their format driver
+ * work and zero detection in parallel.  The first worker is the main
+ * thread itself.
+ */
+typedef struct ImgWorker {
+    QemuThread thread;
+    AioContext *ctx;
+    bool running;
+} ImgWorker;
+
+static void *img_worker_run(void *opaque)
+{
+    ImgWorker *w = opaque;
+
+    rcu_register_thread();
+    qemu_set_current_aio_context(w->ctx);
+
+    while (qatomic_read(&w->running)) {
+        aio_poll(w->ctx, true);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void img_worker_stop_bh(void *opaque)
+{
+    ImgWorker *w = opaque;
+
+    qatomic_set(&w->running, false);
+}
+
+static ImgWorker *img_workers_start(int num_threads)
+{
+    ImgWorker *workers = g_new0(ImgWorker, num_threads);
+    int i;
+
+    workers[0].ctx = qemu_get_aio_context();
+    for (i = 1; i < num_threads; i++) {
+        ImgWorker *w = &workers[i];
+
+        w->ctx = aio_context_new(&error_fatal);
+        w->running = true;
+        qemu_thread_create(&w->thread, "qemu-img-worker", img_worker_run, w,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    return workers;
+}
+
+static void img_workers_stop(ImgWorker *workers, int num_threads)
+{
+    int i;
+
+    for (i = 1; i < num_threads; i++) {
+        ImgWorker *w = &workers[i];
+
+        aio_bh_schedule_oneshot(w->ctx, img_worker_stop_bh, w);
+        qemu_thread_join(&w->thread);
+        aio_context_unref(w->ctx);
+    }
+    g_free(workers);
+}
+
+static bool parse_num_threads(const char *str, long *num_threads)
+{
+    if (qemu_strtol(str, NULL, 0, num_threads) ||
+        *num_threads < 1 || *num_threads > MAX_THREADS) {
+        error_report("Invalid number of threads. Allowed number of"
+                     " threads is between 1 and %d", MAX_THREADS);
+        return false;
+    }
+    return true;
+}
+
 /*
  * Check if passed sectors are empty (not allocated or contain only 0 bytes)
  *
@@ -1348,6 +1460,181 @@ static int check_empty_sectors(BlockBackend *blk, int64_t offset,
     return 0;
 }
 
+typedef struct ImgCompareState {
+    BlockBackend *blk1;
+    BlockBackend *blk2;
+    const char *filename1;
+    const char *filename2;
+    int64_t total_size1;
+    int64_t total_size2;
+    int64_t total_size;
+    uint64_t progress_base;
+    bool strict;
+    bool quiet;
+
+    /* Parallel scan with --threads */
+    CoMutex lock;
+    int64_t next_offset;
+    int64_t mismatch_offset; /* start of the first segment that differs */
+    int running_coroutines;
+} ImgCompareState;
+
+/* Size of the parts of the images that the compare threads scan */
+#define COMPARE_SEGMENT_SIZE (64 * MiB)
+
+/*
+ * Compares the images from @offset up to @end, which must not be beyond
+ * the end of the smaller image.  Returns 0, 1 or the exit status for
+ * errors like img_compare().  Messages and progress are only printed if
+ * @report is true.
+ */
+static int coroutine_mixed_fn GRAPH_RDLOCK
+compare_range(ImgCompareState *s, int64_t offset, int64_t end,
+              uint8_t *buf1, uint8_t *buf2, bool report)
+{
+    BlockDriverState *bs1 = blk_bs(s->blk1);
+    BlockDriverState *bs2 = blk_bs(s->blk2);
+    bool quiet = s->quiet || !report;
+    int64_t pnum1, pnum2, chunk;
+    int allocated1, allocated2;
+    int ret;
+
+    while (offset < end) {
+        int status1, status2;
+
+        status1 = bdrv_block_status_above(bs1, NULL, offset,
+                                          s->total_size1 - offset, &pnum1,
+                                          NULL, NULL);
+        if (status1 < 0) {
+            if (report) {
+                error_report("Sector allocation test failed for %s",
+                             s->filename1);
+            }
+            return 3;
+        }
+        allocated1 = status1 & BDRV_BLOCK_ALLOCATED;
+
+        status2 = bdrv_block_status_above(bs2, NULL, offset,
+                                          s->total_size2 - offset, &pnum2,
+                                          NULL, NULL);
+        if (status2 < 0) {
+            if (report) {
+                error_report("Sector allocation test failed for %s",
+                             s->filename2);
+            }
+            return 3;
+        }
+        allocated2 = status2 & BDRV_BLOCK_ALLOCATED;
+
+        assert(pnum1 && pnum2);
+        chunk = MIN(MIN(pnum1, pnum2), end - offset);
+
+        if (s->strict) {
+            if (status1 != status2) {
+                qprintf(quiet, "Strict mode: Offset %" PRId64
+                        " block status mismatch!\n", offset);
+                return 1;
+            }
+        }
+        if ((status1 & BDRV_BLOCK_ZERO) && (status2 & BDRV_BLOCK_ZERO)) {
+            /* nothing to do */
+        } else if (allocated1 == allocated2) {
+            if (allocated1) {
+                int64_t pnum;
+
+                chunk = MIN(chunk, IO_BUF_SIZE);
+                ret = blk_pread(s->blk1, offset, chunk, buf1, 0);
+                if (ret < 0) {
+                    if (report) {
+                        error_report("Error while reading offset %" PRId64
+                                     " of %s: %s",
+                                     offset, s->filename1, strerror(-ret));
+                    }
+                    return 4;
+                }
+                ret = blk_pread(s->blk2, offset, chunk, buf2, 0);
+                if (ret < 0) {
+                    if (report) {
+                        error_report("Error while reading offset %" PRId64
+                                     " of %s: %s",
+                                     offset, s->filename2, strerror(-ret));
+                    }
+                    return 4;
+                }
+                ret = compare_buffers(buf1, buf2, chunk, 0, &pnum);
+                if (ret || pnum != chunk) {
+                    qprintf(quiet, "Content mismatch at offset %" PRId64 "!\n",
+                            offset + (ret ? 0 : pnum));
+                    return 1;
+                }
+            }
+        } else {
+            chunk = MIN(chunk, IO_BUF_SIZE);
+            if (allocated1) {
+                ret = check_empty_sectors(s->blk1, offset, chunk,
+                                          s->filename1, buf1, quiet);
+            } else {
+                ret = check_empty_sectors(s->blk2, offset, chunk,
+                                          s->filename2, buf1, quiet);
+            }
+            if (ret) {
+                return ret;
+            }
+        }
+        offset += chunk;
+        if (report) {
+            qemu_progress_print(((float) chunk / s->progress_base) * 100, 100);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Compare thread: takes segments of the images in order and scans them
+ * until one that differs is found.  The segments after it are skipped;
+ * those before it are still scanned by the other threads.
+ */
+static void coroutine_fn compare_co_scan(void *opaque)
+{
+    ImgCompareState *s = opaque;
+    uint8_t *buf1 = blk_blockalign(s->blk1, IO_BUF_SIZE);
+    uint8_t *buf2 = blk_blockalign(s->blk2, IO_BUF_SIZE);
+
+    while (1) {
+        int64_t offset, end;
+        int ret;
+
+        qemu_co_mutex_lock(&s->lock);
+        offset = s->next_offset;
+        if (offset >= s->mismatch_offset) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        end = MIN(offset + COMPARE_SEGMENT_SIZE, s->total_size);
+        s->next_offset = end;
+        qemu_co_mutex_unlock(&s->lock);
+
+        WITH_GRAPH_RDLOCK_GUARD() {
+            ret = compare_range(s, offset, end, buf1, buf2, false);
+        }
+
+        qemu_co_mutex_lock(&s->lock);
+        if (ret) {
+            s->mismatch_offset = MIN(s->mismatch_offset, offset);
+        } else {
+            qemu_progress_print(((float) (end - offset) / s->progress_base) *
+                                100, 100);
+        }
+        qemu_co_mutex_unlock(&s->lock);
+    }
+
+    qemu_vfree(buf1);
+    qemu_vfree(buf2);
+    qatomic_dec(&s->running_coroutines);
+    qemu_notify_event();
+}
+
 /*
  * Compares two images. Exit codes:
  *
@@ -1359,11 +1646,8 @@ static int img_compare(int argc, char **argv)
 {
     const char *fmt1 = NULL, *fmt2 = NULL, *cache, *filename1, *filename2;
     BlockBackend *blk1, *blk2;
-    BlockDriverState *bs1, *bs2;
     int64_t total_size1, total_size2;
     uint8_t *buf1 = NULL, *buf2 = NULL;
-    int64_t pnum1, pnum2;
-    int allocated1, allocated2;
     int ret = 0; /* return value - 0 Ident, 1 Different, >1 Error */
     bool progress = false, quiet = false, strict = false;
     int flags;
@@ -1375,6 +1659,8 @@ static int img_compare(int argc, char **argv)
     uint64_t progress_base;
     bool image_opts = false;
     bool force_share = false;
+    long num_threads = 1;
+    ImgCompareState cs;
 
     cache = BDRV_DEFAULT_CACHE;
     for (;;) {
@@ -1383,6 +1669,7 @@ static int img_compare(int argc, char **argv)
             {"object", required_argument, 0, OPTION_OBJECT},
             {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
             {"force-share", no_argument, 0, 'U'},
+            {"threads", required_argument, 0, OPTION_THREADS},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:F:T:pqsU",
@@ -1439,6 +1726,11 @@ static int img_compare(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_THREADS:
+            if (!parse_num_threads(optarg, &num_threads)) {
+                exit(2);
+            }
+            break;
         }
     }
 
@@ -1478,8 +1770,6 @@ static int img_compare(int argc, char **argv)
         ret = 2;
         goto out2;
     }
-    bs1 = blk_bs(blk1);
-    bs2 = blk_bs(blk2);
 
     buf1 = blk_blockalign(blk1, IO_BUF_SIZE);
     buf2 = blk_blockalign(blk2, IO_BUF_SIZE);
@@ -1508,88 +1798,47 @@ static int img_compare(int argc, char **argv)
         goto out;
     }
 
-    while (offset < total_size) {
-        int status1, status2;
+    cs = (ImgCompareState) {
+        .blk1           = blk1,
+        .blk2           = blk2,
+        .filename1      = filename1,
+        .filename2      = filename2,
+        .total_size1    = total_size1,
+        .total_size2    = total_size2,
+        .total_size     = total_size,
+        .progress_base  = progress_base,
+        .strict         = strict,
+        .quiet          = quiet,
+    };
 
-        status1 = bdrv_block_status_above(bs1, NULL, offset,
-                                          total_size1 - offset, &pnum1, NULL,
-                                          NULL);
-        if (status1 < 0) {
-            ret = 3;
-            error_report("Sector allocation test failed for %s", filename1);
-            goto out;
-        }
-        allocated1 = status1 & BDRV_BLOCK_ALLOCATED;
+    if (num_threads > 1) {
+        ImgWorker *workers = img_workers_start(num_threads);
+        int i;
 
-        status2 = bdrv_block_status_above(bs2, NULL, offset,
-                                          total_size2 - offset, &pnum2, NULL,
-                                          NULL);
-        if (status2 < 0) {
-            ret = 3;
-            error_report("Sector allocation test failed for %s", filename2);
-            goto out;
+        qemu_co_mutex_init(&cs.lock);
+        cs.mismatch_offset = total_size;
+        cs.running_coroutines = num_threads;
+        for (i = 0; i < num_threads; i++) {
+            Coroutine *co = qemu_coroutine_create(compare_co_scan, &cs);
+            aio_co_enter(workers[i].ctx, co);
         }
-        allocated2 = status2 & BDRV_BLOCK_ALLOCATED;
-
-        assert(pnum1 && pnum2);
-        chunk = MIN(pnum1, pnum2);
-
-        if (strict) {
-            if (status1 != status2) {
-                ret = 1;
-                qprintf(quiet, "Strict mode: Offset %" PRId64
-                        " block status mismatch!\n", offset);
-                goto out;
-            }
+        while (qatomic_read(&cs.running_coroutines)) {
+            main_loop_wait(false);
         }
-        if ((status1 & BDRV_BLOCK_ZERO) && (status2 & BDRV_BLOCK_ZERO)) {
-            /* nothing to do */
-        } else if (allocated1 == allocated2) {
-            if (allocated1) {
-                int64_t pnum;
+        img_workers_stop(workers, num_threads);
 
-                chunk = MIN(chunk, IO_BUF_SIZE);
-                ret = blk_pread(blk1, offset, chunk, buf1, 0);
-                if (ret < 0) {
-                    error_report("Error while reading offset %" PRId64
-                                 " of %s: %s",
-                                 offset, filename1, strerror(-ret));
-                    ret = 4;
-                    goto out;
-                }
-                ret = blk_pread(blk2, offset, chunk, buf2, 0);
-                if (ret < 0) {
-                    error_report("Error while reading offset %" PRId64
-                                 " of %s: %s",
-                                 offset, filename2, strerror(-ret));
-                    ret = 4;
-                    goto out;
-                }
-                ret = compare_buffers(buf1, buf2, chunk, 0, &pnum);
-                if (ret || pnum != chunk) {
-                    qprintf(quiet, "Content mismatch at offset %" PRId64 "!\n",
-                            offset + (ret ? 0 : pnum));
-                    ret = 1;
-                    goto out;
-                }
-            }
-        } else {
-            chunk = MIN(chunk, IO_BUF_SIZE);
-            if (allocated1) {
-                ret = check_empty_sectors(blk1, offset, chunk,
-                                          filename1, buf1, quiet);
-            } else {
-                ret = check_empty_sectors(blk2, offset, chunk,
-                                          filename2, buf1, quiet);
-            }
-            if (ret) {
-                goto out;
-            }
-        }
-        offset += chunk;
-        qemu_progress_print(((float) chunk / progress_base) * 100, 100);
+        /* Find the first mismatch again, now printing the details */
+        offset = cs.mismatch_offset;
     }
 
+    bdrv_graph_rdlock_main_loop();
+    ret = compare_range(&cs, offset, total_size, buf1, buf2, true);
+    bdrv_graph_rdunlock_main_loop();
+    if (ret) {
+        goto out;
+    }
+    offset = total_size;
+
     if (total_size1 != total_size2) {
         BlockBackend *blk_over;
         const char *filename_over;
@@ -1687,6 +1936,9 @@ typedef struct ImgConvertState {
     int64_t target_backing_sectors; /* negative if unknown */
     bool wr_in_order;
     bool copy_range;
+    /* share extents with the source where possible, even without -C */
+    bool clone;
+    bool clone_ok;
     bool salvage;
     bool quiet;
     int min_sparse;
@@ -1694,10 +1946,10 @@ typedef struct ImgConvertState {
     size_t cluster_sectors;
     size_t buf_sectors;
     long num_coroutines;
+    long num_threads;
     int running_coroutines;
-    Coroutine *co[MAX_COROUTINES];
-    int64_t wait_sector_num[MAX_COROUTINES];
     CoMutex lock;
+    CoQueue wr_queue; /* coroutines waiting for wr_offs, protected by lock */
     int ret;
 } ImgConvertState;
 
@@ -1897,14 +2149,14 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
              * is real non-zero data, we must write it. Otherwise we can treat
              * it as zero sectors.
              * Compressed clusters need to be written as a whole, so in that
-             * case we can only save the write if the buffer is completely
-             * zeroed. */
+             * case we can only save the write of completely zeroed
+             * clusters. */
             if (!s->min_sparse ||
                 (!s->compressed &&
                  is_allocated_sectors_min(buf, n, &n, s->min_sparse,
                                           sector_num, s->alignment)) ||
                 (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
+                 is_allocated_clusters(buf, n, &n, s->cluster_sectors)))
             {
                 ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
                                     n << BDRV_SECTOR_BITS, buf, flags);
@@ -1958,7 +2210,8 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
 
         ret = blk_co_copy_range(blk, offset, s->target,
                                 sector_num << BDRV_SECTOR_BITS,
-                                n << BDRV_SECTOR_BITS, 0, 0);
+                                n << BDRV_SECTOR_BITS, 0,
+                                s->copy_range ? 0 : BDRV_REQ_NO_FALLBACK);
         if (ret < 0) {
             return ret;
         }
@@ -1969,22 +2222,17 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
+/*
+ * With --threads the copy coroutines run in several threads.  The fields
+ * of ImgConvertState that they update are protected by s->lock, except
+ * for s->ret and the copy offloading flags, which are accessed atomically.
+ */
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
     uint8_t *buf = NULL;
-    int ret, i;
-    int index = -1;
-
-    for (i = 0; i < s->num_coroutines; i++) {
-        if (s->co[i] == qemu_coroutine_self()) {
-            index = i;
-            break;
-        }
-    }
-    assert(index >= 0);
+    int ret;
 
-    s->running_coroutines++;
     buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
 
     while (1) {
@@ -1992,9 +2240,11 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         int64_t sector_num;
         enum ImgConvertBlockStatus status;
         bool copy_range;
+        bool fallback = false;
 
         qemu_co_mutex_lock(&s->lock);
-        if (s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
+        if (qatomic_read(&s->ret) != -EINPROGRESS ||
+            s->sector_num >= s->total_sectors) {
             qemu_co_mutex_unlock(&s->lock);
             break;
         }
@@ -2003,7 +2253,7 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         }
         if (n < 0) {
             qemu_co_mutex_unlock(&s->lock);
-            s->ret = n;
+            qatomic_set(&s->ret, n);
             break;
         }
         /* save current sector and allocation status to local variables */
@@ -2015,22 +2265,23 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         /* increment global sector counter so that other coroutines can
          * already continue reading beyond this request */
         s->sector_num += n;
-        qemu_co_mutex_unlock(&s->lock);
 
         if (status == BLK_DATA || (!s->min_sparse && status == BLK_ZERO)) {
             s->allocated_done += n;
             qemu_progress_print(100.0 * s->allocated_done /
                                         s->allocated_sectors, 0);
         }
+        qemu_co_mutex_unlock(&s->lock);
 
 retry:
-        copy_range = s->copy_range && s->status == BLK_DATA;
+        copy_range = !fallback && status == BLK_DATA &&
+                     (qatomic_read(&s->copy_range) || qatomic_read(&s->clone));
         if (status == BLK_DATA && !copy_range) {
             ret = convert_co_read(s, sector_num, n, buf);
             if (ret < 0) {
                 error_report("error while reading at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
-                s->ret = ret;
+                qatomic_set(&s->ret, ret);
             }
         } else if (!s->min_sparse && status == BLK_ZERO) {
             status = BLK_DATA;
@@ -2039,61 +2290,73 @@ retry:
 
         if (s->wr_in_order) {
             /* keep writes in order */
-            while (s->wr_offs != sector_num && s->ret == -EINPROGRESS) {
-                s->wait_sector_num[index] = sector_num;
-                qemu_coroutine_yield();
+            qemu_co_mutex_lock(&s->lock);
+            while (s->wr_offs != sector_num &&
+                   qatomic_read(&s->ret) == -EINPROGRESS) {
+                qemu_co_queue_wait(&s->wr_queue, &s->lock);
             }
-            s->wait_sector_num[index] = -1;
+            qemu_co_mutex_unlock(&s->lock);
         }
 
-        if (s->ret == -EINPROGRESS) {
+        if (qatomic_read(&s->ret) == -EINPROGRESS) {
             if (copy_range) {
                 WITH_GRAPH_RDLOCK_GUARD() {
                     ret = convert_co_copy_range(s, sector_num, n);
                 }
                 if (ret) {
-                    s->copy_range = false;
+                    /*
+                     * Once sharing extents worked, only copy this part
+                     * through the buffer; compressed clusters for example
+                     * cannot be shared.
+                     */
+                    if (qatomic_read(&s->copy_range) ||
+                        !qatomic_read(&s->clone_ok)) {
+                        qatomic_set(&s->copy_range, false);
+                        qatomic_set(&s->clone, false);
+                    }
+                    fallback = true;
                     goto retry;
                 }
+                qatomic_set(&s->clone_ok, true);
             } else {
                 ret = convert_co_write(s, sector_num, n, buf, status);
             }
             if (ret < 0) {
                 error_report("error while writing at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
-                s->ret = ret;
+                qatomic_set(&s->ret, ret);
             }
         }
 
         if (s->wr_in_order) {
-            /* reenter the coroutine that might have waited
-             * for this write to complete */
+            /*
+             * Wake up the coroutine that might have waited
+             * for this write to complete
+             */
+            qemu_co_mutex_lock(&s->lock);
             s->wr_offs = sector_num + n;
-            for (i = 0; i < s->num_coroutines; i++) {
-                if (s->co[i] && s->wait_sector_num[i] == s->wr_offs) {
-                    /*
-                     * A -> B -> A cannot occur because A has
-                     * s->wait_sector_num[i] == -1 during A -> B.  Therefore
-                     * B will never enter A during this time window.
-                     */
-                    qemu_coroutine_enter(s->co[i]);
-                    break;
-                }
-            }
+            qemu_co_queue_restart_all(&s->wr_queue);
+            qemu_co_mutex_unlock(&s->lock);
         }
     }
 
     qemu_vfree(buf);
-    s->co[index] = NULL;
-    s->running_coroutines--;
-    if (!s->running_coroutines && s->ret == -EINPROGRESS) {
-        /* the convert job finished successfully */
-        s->ret = 0;
+
+    /* Waiters must see the error, if any, and give up */
+    qemu_co_mutex_lock(&s->lock);
+    qemu_co_queue_restart_all(&s->wr_queue);
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (qatomic_fetch_dec(&s->running_coroutines) == 1) {
+        /* the convert job finished successfully if there was no error */
+        qatomic_cmpxchg(&s->ret, -EINPROGRESS, 0);
     }
+    qemu_notify_event();
 }
 
 static int convert_do_copy(ImgConvertState *s)
 {
+    ImgWorker *workers;
     int ret, i, n;
     int64_t sector_num = 0;
 
@@ -2105,14 +2368,16 @@ static int convert_do_copy(ImgConvertState *s)
         bdrv_graph_rdunlock_main_loop();
     }
 
-    /* Allocate buffer for copied data. For compressed images, only one cluster
-     * can be copied at a time. */
+    /*
+     * Allocate buffer for copied data. For compressed images, copy whole
+     * clusters so that the target can compress several of them at once.
+     */
     if (s->compressed) {
         if (s->cluster_sectors <= 0 || s->cluster_sectors > s->buf_sectors) {
             error_report("invalid cluster size");
             return -EINVAL;
         }
-        s->buf_sectors = s->cluster_sectors;
+        s->buf_sectors = QEMU_ALIGN_DOWN(s->buf_sectors, s->cluster_sectors);
     }
 
     while (sector_num < s->total_sectors) {
@@ -2134,15 +2399,20 @@ static int convert_do_copy(ImgConvertState *s)
     s->ret = -EINPROGRESS;
 
     qemu_co_mutex_init(&s->lock);
-    for (i = 0; i < s->num_coroutines; i++) {
-        s->co[i] = qemu_coroutine_create(convert_co_do_copy, s);
-        s->wait_sector_num[i] = -1;
-        qemu_coroutine_enter(s->co[i]);
+    qemu_co_queue_init(&s->wr_queue);
+
+    /* Coroutines are spread over the threads, -m is per thread */
+    workers = img_workers_start(s->num_threads);
+    s->running_coroutines = s->num_coroutines * s->num_threads;
+    for (i = 0; i < s->num_coroutines * s->num_threads; i++) {
+        Coroutine *co = qemu_coroutine_create(convert_co_do_copy, s);
+        aio_co_enter(workers[i % s->num_threads].ctx, co);
     }
 
-    while (s->running_coroutines) {
+    while (qatomic_read(&s->running_coroutines)) {
         main_loop_wait(false);
     }
+    img_workers_stop(workers, s->num_threads);
 
     if (s->compressed && !s->ret) {
         /* signal EOF to align */
@@ -2262,6 +2532,7 @@ static int img_convert(int argc, char **argv)
         .buf_sectors        = IO_BUF_SIZE / BDRV_SECTOR_SIZE,
         .wr_in_order        = true,
         .num_coroutines     = 8,
+        .num_threads        = 1,
     };
 
     for(;;) {
@@ -2275,6 +2546,7 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"threads", required_argument, 0, OPTION_THREADS},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2409,6 +2681,11 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_THREADS:
+            if (!parse_num_threads(optarg, &s.num_threads)) {
+                goto fail_getopt;
+            }
+            break;
         }
     }
 
@@ -2436,6 +2713,13 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    /*
+     * Shared extents take no space, so unlike copy offloading this does
+     * not conflict with the default zero detection.
+     */
+    s.clone = !s.copy_range && !s.compressed && !explict_min_sparse &&
+              !s.salvage;
+
     if (tgt_image_opts && !skip_create) {
         error_report("--target-image-opts requires use of -n flag");
         goto fail_getopt;
@@ -228,7 +228,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
-    "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                dirty-ring-size=n (KVM/TCG dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n"
@@ -289,6 +289,10 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+        With the TCG accelerator, it sets the number of pages each vCPU can
+        record before having to flush them to the dirty bitmap itself.  Any
+        non-zero value enables the feature; 4096 is a reasonable choice.
+
     ``eager-split-size=n``
         KVM implements dirty page logging at the PAGE_SIZE granularity and
         enabling dirty-logging on a huge-page requires breaking it into
@@ -6097,7 +6101,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch,io-uring-sqpoll-idle-ms=io-uring-sqpoll-idle-ms``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -6137,6 +6141,14 @@ SRST
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
+        The ``io-uring-sqpoll-idle-ms`` parameter makes the io_uring AIO
+        engine submit requests through a kernel thread (SQPOLL), which
+        goes to sleep after being idle for that many milliseconds. This
+        saves the IOThread a system call per batch of requests at the
+        cost of a host CPU spent polling. 0, the default, disables it.
+        It only takes effect if set before the IOThread first runs an
+        ``aio=io_uring`` block node.
+
         The IOThread parameters can be modified at run-time using the
         ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
@@ -40,6 +40,14 @@
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
+/*
+ * Topmost containers of the regions changed since the FlatViews were
+ * rendered, see memory_region_update_mark().  Only the FlatViews that
+ * depend on one of them are rendered again.
+ */
+static GHashTable *memory_region_update_tops;
+/* Set for changes that affect all FlatViews, such as dirty logging. */
+static bool memory_region_update_all;
 unsigned int global_dirty_tracking;
 
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
@@ -298,6 +306,9 @@ static void flatview_destroy(FlatView *view)
         memory_region_unref(view->ranges[i].mr);
     }
     g_free(view->ranges);
+    if (view->deps) {
+        g_ptr_array_free(view->deps, true);
+    }
     memory_region_unref(view->root);
     g_free(view);
 }
@@ -586,6 +597,45 @@ static AddressSpace *memory_region_to_address_space(MemoryRegion *mr)
     return NULL;
 }
 
+/* Return the region at the top of the container hierarchy of @mr. */
+static MemoryRegion *memory_region_get_top(MemoryRegion *mr)
+{
+    while (mr->container) {
+        mr = mr->container;
+    }
+    return mr;
+}
+
+/* Record that @view must be rendered again if anything under @mr changes. */
+static void flatview_add_dep(FlatView *view, MemoryRegion *mr)
+{
+    MemoryRegion *top = memory_region_get_top(mr);
+
+    if (!view->deps) {
+        view->deps = g_ptr_array_new();
+    } else if (g_ptr_array_find(view->deps, top, NULL)) {
+        return;
+    }
+    g_ptr_array_add(view->deps, top);
+}
+
+/* Return the index of the first range of @view that ends after @addr. */
+static unsigned flatview_find_after(FlatView *view, Int128 addr)
+{
+    unsigned lo = 0, hi = view->nr;
+
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+
+        if (int128_ge(addr, addrrange_end(view->ranges[mid].addr))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 /* Render a memory region into the global view.  Ranges in @view obscure
  * ranges in @mr.
  */
@@ -623,6 +673,7 @@ static void render_memory_region(FlatView *view,
     clip = addrrange_intersection(tmp, clip);
 
     if (mr->alias) {
+        flatview_add_dep(view, mr->alias);
         int128_subfrom(&base, int128_make64(mr->alias->addr));
         int128_subfrom(&base, int128_make64(mr->alias_offset));
         render_memory_region(view, mr->alias, base, clip,
@@ -651,8 +702,12 @@ static void render_memory_region(FlatView *view,
     fr.nonvolatile = nonvolatile;
     fr.unmergeable = unmergeable;
 
-    /* Render the region itself into any gaps left by the current view. */
-    for (i = 0; i < view->nr && int128_nz(remain); ++i) {
+    /*
+     * Render the region itself into any gaps left by the current view,
+     * starting with the first range that is not entirely below it.
+     */
+    for (i = flatview_find_after(view, base);
+         i < view->nr && int128_nz(remain); ++i) {
         if (int128_ge(base, addrrange_end(view->ranges[i].addr))) {
             continue;
         }
@@ -749,6 +804,7 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     view = flatview_new(mr);
 
     if (mr) {
+        flatview_add_dep(view, mr);
         render_memory_region(view, mr, int128_zero(),
                              addrrange_make(int128_zero(), int128_2_64()),
                              false, false, false);
@@ -1053,26 +1109,72 @@ static void flatviews_init(void)
     }
 }
 
+/*
+ * Record a change to @mr, to be rendered by the next transaction commit
+ * that has memory_region_update_pending set.
+ */
+static void memory_region_update_mark(MemoryRegion *mr)
+{
+    if (!memory_region_update_tops) {
+        memory_region_update_tops = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(memory_region_update_tops, memory_region_get_top(mr));
+}
+
+/* Return true if @view may be affected by the changes marked so far. */
+static bool flatview_needs_update(FlatView *view)
+{
+    unsigned i;
+
+    if (memory_region_update_all) {
+        return true;
+    }
+    if (!view->deps || !memory_region_update_tops) {
+        return false;
+    }
+    for (i = 0; i < view->deps->len; i++) {
+        if (g_hash_table_contains(memory_region_update_tops,
+                                  g_ptr_array_index(view->deps, i))) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /* Render unique FVs, reusing those that did not change */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
+        view = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        if (view && !flatview_needs_update(view)) {
+            flatview_ref(view);
+            g_hash_table_replace(flat_views, physmr, view);
+            continue;
+        }
+
         generate_memory_topology(physmr);
     }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
+    if (memory_region_update_tops) {
+        g_hash_table_remove_all(memory_region_update_tops);
+    }
+    memory_region_update_all = false;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1460,6 +1562,23 @@ static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
     }
 }
 
+bool memory_region_read_shadow(MemoryRegion *mr, hwaddr addr,
+                               uint64_t *pval, MemOp op, MemTxAttrs attrs)
+{
+    uint32_t *shadow = qatomic_read(&mr->read_shadow);
+
+    if (!shadow || memop_size(op) != 4 || (addr & 3) || addr >= 64 * 4 ||
+        !(mr->ops->read_shadow_regs & BIT_ULL(addr / 4)) ||
+        mr->flush_coalesced_mmio ||
+        !memory_region_access_valid(mr, addr, 4, false, attrs)) {
+        return false;
+    }
+
+    *pval = qatomic_read(&shadow[addr / 4]);
+    adjust_endianness(mr, pval, op);
+    return true;
+}
+
 MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                         hwaddr addr,
                                         uint64_t *pval,
@@ -2258,6 +2377,7 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
+    memory_region_update_mark(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2388,6 +2508,7 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
+        memory_region_update_mark(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2398,6 +2519,7 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
+        memory_region_update_mark(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2408,6 +2530,7 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
+        memory_region_update_mark(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2558,6 +2681,13 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_set_read_shadow(MemoryRegion *mr, uint32_t *shadow)
+{
+    /* Shadow reads are done without the BQL, so they cannot call back. */
+    assert(mr->ops->read_shadow_regs && !mr->ops->valid.accepts);
+    qatomic_set(&mr->read_shadow, shadow);
+}
+
 void memory_region_add_eventfd(MemoryRegion *mr,
                                hwaddr addr,
                                unsigned size,
@@ -2646,6 +2776,7 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
+    memory_region_update_mark(mr);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
@@ -2657,6 +2788,8 @@ static void memory_region_add_subregion_common(MemoryRegion *mr,
     MemoryRegion *alias;
 
     assert(!subregion->container);
+    /* FlatViews that depend on @subregion now depend on @mr. */
+    memory_region_update_mark(subregion);
     subregion->container = mr;
     for (alias = subregion->alias; alias; alias = alias->alias) {
         alias->mapped_via_alias++;
@@ -2689,6 +2822,7 @@ void memory_region_del_subregion(MemoryRegion *mr,
 
     memory_region_transaction_begin();
     assert(subregion->container == mr);
+    memory_region_update_mark(mr);
     subregion->container = NULL;
     for (alias = subregion->alias; alias; alias = alias->alias) {
         alias->mapped_via_alias--;
@@ -2707,6 +2841,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
+    memory_region_update_mark(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2723,6 +2858,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
+    memory_region_update_mark(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2759,6 +2895,7 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
+    memory_region_update_mark(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2771,6 +2908,7 @@ void memory_region_set_unmergeable(MemoryRegion *mr, bool unmergeable)
 
     memory_region_transaction_begin();
     mr->unmergeable = unmergeable;
+    memory_region_update_mark(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2970,6 +3108,7 @@ bool memory_global_dirty_log_start(unsigned int flags, Error **errp)
         }
 
         memory_region_transaction_begin();
+        memory_region_update_all = true;
         memory_region_update_pending = true;
         memory_region_transaction_commit();
     }
@@ -2986,6 +3125,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
 
     if (!global_dirty_tracking) {
         memory_region_transaction_begin();
+        memory_region_update_all = true;
         memory_region_update_pending = true;
         memory_region_transaction_commit();
         MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
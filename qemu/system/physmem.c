@@ -921,7 +921,7 @@ bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
     }
 
     if (dirty) {
-        cpu_physical_memory_dirty_bits_cleared(start, length);
+        cpu_physical_memory_dirty_bits_cleared(start, length, client);
     }
 
     return dirty;
@@ -974,7 +974,7 @@ DirtyBitmapSnapshot *cpu_physical_memory_snapshot_and_clear_dirty
         }
     }
 
-    cpu_physical_memory_dirty_bits_cleared(start, length);
+    cpu_physical_memory_dirty_bits_cleared(start, length, client);
 
     memory_region_clear_dirty_bitmap(mr, offset, length);
 
@@ -2375,6 +2375,74 @@ void qemu_ram_remap(ram_addr_t addr)
         }
     }
 }
+
+/* Apply the advice of ram_block_add() to a new mapping of guest RAM */
+static void qemu_ram_setup_mapping(void *addr, size_t length)
+{
+    memory_try_enable_merging(addr, length);
+    qemu_ram_setup_dump(addr, length);
+    qemu_madvise(addr, length, QEMU_MADV_HUGEPAGE);
+    if (!qtest_enabled()) {
+        qemu_madvise(addr, length, QEMU_MADV_DONTFORK);
+    }
+}
+
+/*
+ * qemu_ram_map_file_private - back guest RAM by a private file mapping
+ *
+ * @block: anonymous, private RAMBlock
+ * @start: offset in @block, aligned to the host page size
+ * @length: length of the range, aligned to the host page size
+ * @fd: file to map
+ * @fd_offset: offset of the content of @start in @fd
+ *
+ * Replaces the memory of the range with a MAP_PRIVATE mapping of @fd, so
+ * that the content is only read from the file when the pages are first
+ * accessed.  Writes stay private to QEMU.  The previous content of the
+ * range is lost, even on failure.
+ *
+ * Returns: 0 on success, negative errno on failure
+ */
+int qemu_ram_map_file_private(RAMBlock *block, uint64_t start, size_t length,
+                              int fd, uint64_t fd_offset)
+{
+    void *host_startaddr = block->host + start;
+    void *area;
+    int ret;
+
+    assert(block->fd < 0 && !qemu_ram_is_shared(block));
+    assert(QEMU_PTR_IS_ALIGNED(host_startaddr, qemu_real_host_page_size()));
+    assert(QEMU_IS_ALIGNED(length, qemu_real_host_page_size()));
+    assert(start + length <= block->used_length);
+
+    area = mmap(host_startaddr, length,
+                PROT_READ | (block->flags & RAM_READONLY ? 0 : PROT_WRITE),
+                MAP_PRIVATE | MAP_FIXED |
+                (block->flags & RAM_NORESERVE ? MAP_NORESERVE : 0),
+                fd, fd_offset);
+    if (area != host_startaddr) {
+        ret = -errno;
+        /* A failed MAP_FIXED may have unmapped the range, map it again */
+        if (qemu_ram_remap_mmap(block, start, length) != 0) {
+            error_report("Could not remap RAM %s:%" PRIx64 " +%zx",
+                         block->idstr, start, length);
+            exit(1);
+        }
+        qemu_ram_setup_mapping(host_startaddr, length);
+        return ret;
+    }
+
+    /* Discarding must not bring back the content of the file */
+    block->file_mapped = true;
+    qemu_ram_setup_mapping(host_startaddr, length);
+    return 0;
+}
+#else
+int qemu_ram_map_file_private(RAMBlock *block, uint64_t start, size_t length,
+                              int fd, uint64_t fd_offset)
+{
+    return -ENOTSUP;
+}
 #endif /* !_WIN32 */
 
 /*
@@ -3872,7 +3940,17 @@ int ram_block_discard_range(RAMBlock *rb, uint64_t start, size_t length)
              * fallocate'd away).
              */
 #if defined(CONFIG_MADVISE)
-            if (qemu_ram_is_shared(rb) && rb->fd < 0) {
+            if (rb->file_mapped) {
+                /*
+                 * Part of the block is a private mapping of a migration
+                 * file, see qemu_ram_map_file_private(): DONTNEED would
+                 * bring back the file content, map anonymous memory.
+                 */
+                ret = qemu_ram_remap_mmap(rb, start, length);
+                if (!ret) {
+                    qemu_ram_setup_mapping(host_startaddr, length);
+                }
+            } else if (qemu_ram_is_shared(rb) && rb->fd < 0) {
                 ret = madvise(host_startaddr, length, QEMU_MADV_REMOVE);
             } else {
                 ret = madvise(host_startaddr, length, QEMU_MADV_DONTNEED);
@@ -9,6 +9,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "disas/disas.h"
 #include "elf.h"
 #include "exec/target_page.h"
 #include "exec/translation-block.h"
@@ -294,7 +295,18 @@ static void write_jr_code_load(const void *start, uint16_t host_size,
     const char *symbol;
     size_t symbol_size;
 
-    symbol = pretty_symbol(q, &symbol_size);
+    /*
+     * Name the code after the guest function only: the offset of the
+     * first instruction would give each TB its own name and spread the
+     * cost of a function over all of its TBs, while the exact guest
+     * location is already in the JIT_CODE_DEBUG_INFO record.
+     */
+    if (q->symbol) {
+        symbol = q->symbol;
+        symbol_size = strlen(symbol) + 1;
+    } else {
+        symbol = pretty_symbol(q, &symbol_size);
+    }
     rec.p.id = JIT_CODE_LOAD;
     rec.p.total_size = sizeof(rec) + symbol_size + host_size;
     rec.p.timestamp = get_clock();
@@ -341,6 +353,23 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     }
     debuginfo_query(q, tb->icount);
 
+    /*
+     * Fall back to the symbols captured when the guest ELF was loaded,
+     * e.g. the firmware passed to -kernel when QEMU is built without
+     * libdw or the ELF has no DWARF.
+     */
+    for (insn = 0; insn < tb->icount; insn++) {
+        if (!q[insn].symbol) {
+            uint64_t offset = 0;
+            const char *sym = lookup_symbol_offset(q[insn].address, &offset);
+
+            if (sym[0]) {
+                q[insn].symbol = sym;
+                q[insn].offset = offset;
+            }
+        }
+    }
+
     /* Emit perfmap entries if needed. */
     if (perfmap) {
         flockfile(perfmap);
@@ -0,0 +1,123 @@
+/*
+ * qcow2 metadata cache benchmark
+ *
+ * Random reads all over a sparse image with allocated L2 tables, through
+ * an L2 cache that only holds part of them.  The reads hit unallocated
+ * clusters, so that their cost is mostly the L2 cache lookup and, on a
+ * miss, the replacement of a cache entry.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qobject/qdict.h"
+#include "qemu/main-loop.h"
+#include "qemu/units.h"
+#include "block/block.h"
+#include "system/block-backend.h"
+
+#define IMG_SIZE        (256 * GiB)
+#define CLUSTER_SIZE    (64 * KiB)
+/* Guest data covered by a 64 KiB L2 table with 64 KiB clusters */
+#define L2_TABLE_SPAN   (512 * MiB)
+#define L2_SLICE_SIZE   (4 * KiB)
+/* Guest data covered by one cache entry */
+#define L2_SLICE_SPAN   (L2_TABLE_SPAN / (CLUSTER_SIZE / L2_SLICE_SIZE))
+
+static char *img_path;
+
+static BlockBackend *open_image(int flags, uint64_t l2_cache_size)
+{
+    QDict *opts = qdict_new();
+
+    qdict_put_str(opts, "driver", "qcow2");
+    qdict_put_str(opts, "file.driver", "file");
+    qdict_put_str(opts, "file.filename", img_path);
+    qdict_put_str(opts, "cache-clean-interval", "0");
+    qdict_put_str(opts, "l2-cache-entry-size", "4096");
+    if (l2_cache_size) {
+        g_autofree char *size = g_strdup_printf("%" PRIu64, l2_cache_size);
+        qdict_put_str(opts, "l2-cache-size", size);
+    }
+
+    return blk_new_open(NULL, NULL, opts, flags, &error_abort);
+}
+
+static void create_image(void)
+{
+    g_autofree void *buf = g_malloc0(BDRV_SECTOR_SIZE);
+    BlockBackend *blk;
+    int64_t offset;
+    int fd;
+
+    img_path = g_strdup_printf("%s/qcow2-cache-bench-XXXXXX",
+                               g_get_tmp_dir());
+    fd = g_mkstemp(img_path);
+    g_assert(fd >= 0);
+    close(fd);
+
+    bdrv_img_create(img_path, "qcow2", NULL, NULL, NULL, IMG_SIZE,
+                    BDRV_O_RDWR, true, &error_abort);
+
+    /* Allocate one data cluster, and thus an L2 table, per L2 table span */
+    blk = open_image(BDRV_O_RDWR, 0);
+    for (offset = 0; offset < IMG_SIZE; offset += L2_TABLE_SPAN) {
+        g_assert(blk_pwrite(blk, offset, BDRV_SECTOR_SIZE, buf, 0) >= 0);
+    }
+    blk_unref(blk);
+}
+
+static void test_random_read(const void *opaque)
+{
+    uint64_t n_entries = (uintptr_t) opaque;
+    g_autofree void *buf = g_malloc(BDRV_SECTOR_SIZE);
+    BlockBackend *blk = open_image(0, n_entries * L2_SLICE_SIZE);
+    uint64_t reads = 0;
+
+    g_test_timer_start();
+    do {
+        for (int i = 0; i < 1000; i++) {
+            /* Skip the first cluster of each slice, it may be allocated */
+            int64_t slice = g_test_rand_int_range(0, IMG_SIZE / L2_SLICE_SPAN);
+            int64_t offset = slice * L2_SLICE_SPAN + CLUSTER_SIZE;
+
+            g_assert(blk_pread(blk, offset, BDRV_SECTOR_SIZE, buf, 0) >= 0);
+        }
+        reads += 1000;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    g_test_message("%" PRIu64 " of %" PRIu64 " L2 slices cached: "
+                   "%.0f reads/sec", n_entries, IMG_SIZE / L2_SLICE_SPAN,
+                   reads / g_test_timer_last());
+
+    blk_unref(blk);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint64_t n_entries[] = { 1024, 4096, 7168 };
+    int ret;
+
+    qemu_init_main_loop(&error_abort);
+    bdrv_init();
+    g_test_init(&argc, &argv, NULL);
+
+    create_image();
+
+    for (int i = 0; i < ARRAY_SIZE(n_entries); i++) {
+        g_autofree char *path =
+            g_strdup_printf("/qcow2-cache/random-read/%" PRIu64, n_entries[i]);
+
+        g_test_add_data_func(path, (void *)(uintptr_t) n_entries[i],
+                             test_random_read);
+    }
+
+    ret = g_test_run();
+
+    unlink(img_path);
+    g_free(img_path);
+    return ret;
+}
@@ -0,0 +1,353 @@
+/*
+ * fp-test-hardfloat.c - test inexact detection in QEMU's hardfloat paths
+ *
+ * The hardfloat paths of softfloat compute the result with the host FPU
+ * and, when the inexact flag is not set yet, check themselves whether the
+ * result was rounded.  Compare the result and the inexact flag they return
+ * with the host FPU and its exception flags, starting every operation with
+ * clear flags.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef HW_POISON_H
+#error Must define HW_POISON_H to work around TARGET_* poisoning
+#endif
+
+#include "qemu/osdep.h"
+#include <float.h>
+#include <math.h>
+#include <fenv.h>
+#include "fpu/softfloat.h"
+
+#define N_RANDOM 100000
+
+typedef union {
+    float f;
+    float32 i;
+} ufloat32;
+
+typedef union {
+    double d;
+    float64 i;
+} ufloat64;
+
+static float_status qsf;
+static int errors;
+
+static void compare(const char *op, uint64_t a, uint64_t b, uint64_t c,
+                    uint64_t soft, bool soft_inexact,
+                    uint64_t host, bool host_inexact)
+{
+    if (soft == host && soft_inexact == host_inexact) {
+        return;
+    }
+
+    printf("%s(%016" PRIx64 ", %016" PRIx64 ", %016" PRIx64 ")\n"
+           "  sf: %016" PRIx64 " inexact %d\n"
+           "host: %016" PRIx64 " inexact %d\n\n",
+           op, a, b, c, soft, soft_inexact, host, host_inexact);
+
+    if (++errors == 20) {
+        exit(1);
+    }
+}
+
+static void soft_clear_flags(void)
+{
+    qsf.float_exception_flags = 0;
+}
+
+static bool soft_inexact(void)
+{
+    return qsf.float_exception_flags & float_flag_inexact;
+}
+
+static void host_clear_flags(void)
+{
+    feclearexcept(FE_ALL_EXCEPT);
+}
+
+static bool host_inexact(void)
+{
+    return fetestexcept(FE_INEXACT);
+}
+
+enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_SQRT,
+    OP_MULADD,
+};
+
+static const char * const op_names[] = {
+    [OP_ADD] = "add",
+    [OP_SUB] = "sub",
+    [OP_MUL] = "mul",
+    [OP_DIV] = "div",
+    [OP_SQRT] = "sqrt",
+    [OP_MULADD] = "muladd",
+};
+
+static void test_f32(int op, float fa, float fb, float fc)
+{
+    /* volatile, so that the compiler doesn't fold the host operation */
+    volatile float va = fa, vb = fb, vc = fc;
+    ufloat32 a = { .f = fa }, b = { .f = fb }, c = { .f = fc };
+    ufloat32 soft, host;
+    char name[16];
+
+    soft_clear_flags();
+    host_clear_flags();
+    switch (op) {
+    case OP_ADD:
+        soft.i = float32_add(a.i, b.i, &qsf);
+        host.f = va + vb;
+        break;
+    case OP_SUB:
+        soft.i = float32_sub(a.i, b.i, &qsf);
+        host.f = va - vb;
+        break;
+    case OP_MUL:
+        soft.i = float32_mul(a.i, b.i, &qsf);
+        host.f = va * vb;
+        break;
+    case OP_DIV:
+        soft.i = float32_div(a.i, b.i, &qsf);
+        host.f = va / vb;
+        break;
+    case OP_SQRT:
+        soft.i = float32_sqrt(a.i, &qsf);
+        host.f = sqrtf(va);
+        break;
+    case OP_MULADD:
+        soft.i = float32_muladd(a.i, b.i, c.i, 0, &qsf);
+        host.f = fmaf(va, vb, vc);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    snprintf(name, sizeof(name), "f32_%s", op_names[op]);
+    compare(name, a.i, b.i, c.i, soft.i, soft_inexact(),
+            host.i, host_inexact());
+}
+
+static void test_f64(int op, double da, double db, double dc)
+{
+    /* volatile, so that the compiler doesn't fold the host operation */
+    volatile double va = da, vb = db, vc = dc;
+    ufloat64 a = { .d = da }, b = { .d = db }, c = { .d = dc };
+    ufloat64 soft, host;
+    char name[16];
+
+    soft_clear_flags();
+    host_clear_flags();
+    switch (op) {
+    case OP_ADD:
+        soft.i = float64_add(a.i, b.i, &qsf);
+        host.d = va + vb;
+        break;
+    case OP_SUB:
+        soft.i = float64_sub(a.i, b.i, &qsf);
+        host.d = va - vb;
+        break;
+    case OP_MUL:
+        soft.i = float64_mul(a.i, b.i, &qsf);
+        host.d = va * vb;
+        break;
+    case OP_DIV:
+        soft.i = float64_div(a.i, b.i, &qsf);
+        host.d = va / vb;
+        break;
+    case OP_SQRT:
+        soft.i = float64_sqrt(a.i, &qsf);
+        host.d = sqrt(va);
+        break;
+    case OP_MULADD:
+        soft.i = float64_muladd(a.i, b.i, c.i, 0, &qsf);
+        host.d = fma(va, vb, vc);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    snprintf(name, sizeof(name), "f64_%s", op_names[op]);
+    compare(name, a.i, b.i, c.i, soft.i, soft_inexact(),
+            host.i, host_inexact());
+}
+
+static void test_int64_to_float(int64_t i)
+{
+    /* volatile, so that the compiler doesn't fold the host conversion */
+    volatile int64_t vi = i;
+    ufloat32 soft32, host32;
+    ufloat64 soft64, host64;
+
+    soft_clear_flags();
+    host_clear_flags();
+    soft32.i = int64_to_float32(i, &qsf);
+    host32.f = vi;
+    compare("i64_to_f32", i, 0, 0, soft32.i, soft_inexact(),
+            host32.i, host_inexact());
+
+    soft_clear_flags();
+    host_clear_flags();
+    soft64.i = int64_to_float64(i, &qsf);
+    host64.d = vi;
+    compare("i64_to_f64", i, 0, 0, soft64.i, soft_inexact(),
+            host64.i, host_inexact());
+}
+
+/* @d must be within the int32 range once rounded */
+static void test_float_to_int32(double d)
+{
+    ufloat32 a32 = { .f = d };
+    ufloat64 a64 = { .d = d };
+    double r;
+    int32_t soft;
+
+    soft_clear_flags();
+    soft = float64_to_int32(a64.i, &qsf);
+    r = rint(d);
+    compare("f64_to_i32", a64.i, 0, 0, soft, soft_inexact(),
+            (int32_t)r, r != d);
+
+    soft_clear_flags();
+    soft = float64_to_int32_round_to_zero(a64.i, &qsf);
+    r = trunc(d);
+    compare("f64_to_i32_r_minMag", a64.i, 0, 0, soft, soft_inexact(),
+            (int32_t)r, r != d);
+
+    soft_clear_flags();
+    soft = float32_to_int32(a32.i, &qsf);
+    r = rintf(a32.f);
+    compare("f32_to_i32", a32.i, 0, 0, soft, soft_inexact(),
+            (int32_t)r, r != a32.f);
+
+    soft_clear_flags();
+    soft = float32_to_int32_round_to_zero(a32.i, &qsf);
+    r = truncf(a32.f);
+    compare("f32_to_i32_r_minMag", a32.i, 0, 0, soft, soft_inexact(),
+            (int32_t)r, r != a32.f);
+}
+
+/*
+ * Random finite operands.  Half of them only have a few significant bits,
+ * so that many results are exact; the exponent range also makes some
+ * results overflow or become denormal, which exercises the fallbacks.
+ */
+static int64_t rand_int64(void)
+{
+    return ((uint64_t)mrand48() << 32) ^ (uint32_t)mrand48();
+}
+
+static double rand_double(int max_exp)
+{
+    int exp = (int)(lrand48() % (2 * max_exp + 1)) - max_exp;
+
+    if (lrand48() & 1) {
+        return ldexp(mrand48() >> 20, exp);
+    }
+    return ldexp(copysign(drand48() + 1.0, mrand48()), exp);
+}
+
+static float rand_float(int max_exp)
+{
+    int exp = (int)(lrand48() % (2 * max_exp + 1)) - max_exp;
+
+    if (lrand48() & 1) {
+        return ldexpf(mrand48() >> 24, exp);
+    }
+    return ldexpf(copysignf(drand48() + 1.0, mrand48()), exp);
+}
+
+static void test_fixed(void)
+{
+    /* exact results */
+    test_f32(OP_ADD, 1.0f, 2.0f, 0);
+    test_f32(OP_SUB, 1.0f, ldexpf(1, -23), 0);
+    test_f32(OP_MUL, 3.0f, 5.0f, 0);
+    test_f32(OP_DIV, 1.0f, 4.0f, 0);
+    test_f32(OP_SQRT, 2.25f, 0, 0);
+    test_f32(OP_MULADD, 3.0f, 5.0f, -15.0f);
+    test_f64(OP_ADD, 1.0, ldexp(1, -52), 0);
+    test_f64(OP_SUB, 0x1p53, 1.0, 0);
+    test_f64(OP_MUL, 0x1.8p0, 0x1.8p0, 0);
+    test_f64(OP_DIV, 10.0, 4.0, 0);
+    test_f64(OP_SQRT, ldexp(1, -1000), 0, 0);
+    test_f64(OP_MULADD, 0x1.000001p0, 0x1.000001p0, -1.0);
+    test_int64_to_float(1 << 24);
+    test_int64_to_float(INT64_MIN);
+    test_float_to_int32(-42.0);
+
+    /* inexact results */
+    test_f32(OP_ADD, 1.0f, ldexpf(1, -30), 0);
+    test_f32(OP_SUB, 1.0f, ldexpf(1, -25), 0);
+    test_f32(OP_MUL, 0x1.000002p0f, 0x1.000002p0f, 0);
+    test_f32(OP_DIV, 1.0f, 3.0f, 0);
+    test_f32(OP_SQRT, 2.0f, 0, 0);
+    test_f32(OP_MULADD, 0x1.000002p0f, 0x1.000002p0f, 1.0f);
+    test_f64(OP_ADD, 1.0, ldexp(1, -60), 0);
+    test_f64(OP_SUB, 0x1p53, 0x1.8p0, 0);
+    test_f64(OP_MUL, 0x1.0000000000001p0, 0x1.0000000000001p0, 0);
+    test_f64(OP_DIV, 1.0, 10.0, 0);
+    test_f64(OP_SQRT, 3.0, 0, 0);
+    test_f64(OP_MULADD, 0x1.0000000000001p0, 0x1.0000000000001p0, -1.0);
+    test_int64_to_float((1 << 24) + 1);
+    test_int64_to_float(INT64_MAX);
+    test_float_to_int32(2.5);
+    test_float_to_int32(-0.75);
+
+    /* overflow is inexact too */
+    test_f32(OP_MUL, 0x1p100f, 0x1p100f, 0);
+    test_f64(OP_ADD, DBL_MAX, DBL_MAX, 0);
+}
+
+static void test_random(void)
+{
+    int i, op;
+
+    for (i = 0; i < N_RANDOM; i++) {
+        for (op = OP_ADD; op <= OP_MULADD; op++) {
+            float fa = rand_float(70), fb = rand_float(70);
+            double da = rand_double(560), db = rand_double(560);
+
+            if (op == OP_SQRT) {
+                fa = fabsf(fa);
+                da = fabs(da);
+            } else if (op == OP_DIV) {
+                /* 0 / 0 is a NaN, whose pattern differs between hosts */
+                fb = fb ? fb : 1.0f;
+                db = db ? db : 1.0;
+            }
+            test_f32(op, fa, fb, rand_float(120));
+            test_f64(op, da, db, rand_double(1000));
+        }
+
+        test_int64_to_float(rand_int64() >> (lrand48() % 64));
+        test_float_to_int32(ldexp(drand48(), lrand48() % 31) *
+                            (lrand48() & 1 ? 1 : -1));
+    }
+}
+
+int main(int ac, char **av)
+{
+#if FLT_EVAL_METHOD != 0
+    /* The host results can't be used as a reference, and hardfloat is off */
+    return 77;
+#endif
+
+    set_float_2nan_prop_rule(float_2nan_prop_s_ab, &qsf);
+    set_float_3nan_prop_rule(float_3nan_prop_s_cab, &qsf);
+    set_float_infzeronan_rule(float_infzeronan_dnan_if_qnan, &qsf);
+    set_float_default_nan_pattern(0b01000000, &qsf);
+    set_float_rounding_mode(float_round_nearest_even, &qsf);
+
+    test_fixed();
+    test_random();
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Machine startup benchmark
+ *
+ * Boards mapping hundreds of memory regions, most of them stubbed out
+ * with unimplemented devices, spend a noticeable part of their startup
+ * updating the memory topology.  Time how long it takes from launching
+ * QEMU until it answers on QMP, for a few such boards.
+ *
+ * This is run by "make bench", with "-m perf" to get the best of several
+ * iterations.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+static const char *const machines[] = {
+    "nxps32k358evb",
+    "ast2500-evb",
+    "ast2600-evb",
+    "npcm750-evb",
+    "quanta-gsj",
+    "mps3-an547",
+};
+
+static void test_startup(const void *data)
+{
+    const char *machine = data;
+    int iterations = g_test_perf() ? 20 : 1;
+    double best = G_MAXDOUBLE, total = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        QTestState *qts;
+        double elapsed;
+
+        g_test_timer_start();
+        qts = qtest_initf("-machine %s", machine);
+        elapsed = g_test_timer_elapsed();
+        qtest_quit(qts);
+
+        best = MIN(best, elapsed);
+        total += elapsed;
+    }
+
+    g_test_minimized_result(best, "%s startup: best %.1f ms, average %.1f ms",
+                            machine, best * 1000, total * 1000 / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    for (int i = 0; i < ARRAY_SIZE(machines); i++) {
+        g_autofree char *path = NULL;
+
+        if (!qtest_has_machine(machines[i])) {
+            continue;
+        }
+        path = g_strdup_printf("startup/%s", machines[i]);
+        qtest_add_data_func(path, machines[i], test_startup);
+    }
+
+    return g_test_run();
+}
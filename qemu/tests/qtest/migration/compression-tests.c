@@ -151,6 +151,30 @@ static void test_multifd_tcp_zlib(void)
     test_precopy_common(&args);
 }
 
+static void *
+migrate_hook_start_precopy_tcp_multifd_xbzrle(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "xbzrle");
+}
+
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_precopy_tcp_multifd_xbzrle,
+        .iterations = 2,
+        /*
+         * The pages need to be modified after the first round for the
+         * channels to send deltas.
+         */
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
 static void migration_test_add_compression_smoke(MigrationTestEnv *env)
 {
     migration_test_add("/migration/multifd/tcp/plain/zlib",
@@ -172,6 +196,9 @@ void migration_test_add_compression(MigrationTestEnv *env)
                        test_multifd_tcp_zstd);
 #endif
 
+    migration_test_add("/migration/multifd/tcp/plain/xbzrle",
+                       test_multifd_tcp_xbzrle);
+
 #ifdef CONFIG_QATZIP
     migration_test_add("/migration/multifd/tcp/plain/qatzip",
                        test_multifd_tcp_qatzip);
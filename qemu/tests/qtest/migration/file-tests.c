@@ -182,6 +182,90 @@ static void test_multifd_file_mapped_ram(void)
     test_file_common(&args, true);
 }
 
+static void *migrate_hook_start_multifd_mapped_ram_lazy(QTestState *from,
+                                                        QTestState *to)
+{
+    migrate_hook_start_multifd_mapped_ram(from, to);
+
+    migrate_set_capability(to, "mapped-ram-lazy-load", true);
+
+    return NULL;
+}
+
+static void test_multifd_file_mapped_ram_lazy(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_multifd_mapped_ram_lazy,
+    };
+
+    test_file_common(&args, true);
+}
+
+static void *migrate_hook_start_multifd_mapped_ram_zlib(QTestState *from,
+                                                        QTestState *to)
+{
+    migrate_hook_start_multifd_mapped_ram(from, to);
+
+    migrate_set_parameter_str(from, "multifd-compression", "zlib");
+    migrate_set_parameter_str(to, "multifd-compression", "zlib");
+
+    return NULL;
+}
+
+static void test_multifd_file_mapped_ram_zlib(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_multifd_mapped_ram_zlib,
+    };
+
+    test_file_common(&args, true);
+}
+
+static void test_multifd_file_mapped_ram_zlib_live(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_multifd_mapped_ram_zlib,
+    };
+
+    test_file_common(&args, false);
+}
+
+static void *migrate_hook_start_multifd_mapped_ram_xbzrle(QTestState *from,
+                                                          QTestState *to)
+{
+    /* Set the compression first, so that enabling mapped-ram can't fail */
+    migrate_set_parameter_str(from, "multifd-compression", "xbzrle");
+    migrate_set_parameter_str(to, "multifd-compression", "xbzrle");
+
+    return migrate_hook_start_multifd_mapped_ram(from, to);
+}
+
+static void test_multifd_file_mapped_ram_xbzrle(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_multifd_mapped_ram_xbzrle,
+        .result = MIG_TEST_QMP_ERROR,
+    };
+
+    test_file_common(&args, true);
+}
+
 static void *migrate_hook_start_multifd_mapped_ram_dio(QTestState *from,
                                                        QTestState *to)
 {
@@ -337,6 +421,14 @@ void migration_test_add_file(MigrationTestEnv *env)
                        test_multifd_file_mapped_ram);
     migration_test_add("/migration/multifd/file/mapped-ram/live",
                        test_multifd_file_mapped_ram_live);
+    migration_test_add("/migration/multifd/file/mapped-ram/lazy",
+                       test_multifd_file_mapped_ram_lazy);
+    migration_test_add("/migration/multifd/file/mapped-ram/zlib",
+                       test_multifd_file_mapped_ram_zlib);
+    migration_test_add("/migration/multifd/file/mapped-ram/zlib/live",
+                       test_multifd_file_mapped_ram_zlib_live);
+    migration_test_add("/migration/multifd/file/mapped-ram/xbzrle",
+                       test_multifd_file_mapped_ram_xbzrle);
 
 #ifndef _WIN32
     migration_test_add("/migration/multifd/file/mapped-ram/fdset",
@@ -99,6 +99,21 @@ static void test_precopy_unix_dirty_ring(void)
     test_precopy_common(&args);
 }
 
+static void test_precopy_unix_tcg_dirty_ring(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            .use_tcg_dirty_ring = true,
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_tcp_plain(void)
 {
     MigrateCommon args = {
@@ -1118,6 +1133,10 @@ static void migration_test_add_precopy_smoke(MigrationTestEnv *env)
 
     migration_test_add("/migration/precopy/unix/plain",
                        test_precopy_unix_plain);
+    if (env->has_tcg) {
+        migration_test_add("/migration/dirty_ring/tcg",
+                           test_precopy_unix_tcg_dirty_ring);
+    }
 
     migration_test_add("/migration/precopy/tcp/plain", test_precopy_tcp_plain);
     migration_test_add("/migration/multifd/tcp/uri/plain/none",
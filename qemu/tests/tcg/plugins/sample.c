@@ -0,0 +1,85 @@
+/*
+ * PC sampling test plugin
+ *
+ * Sample every vCPU at a high frequency and check that the samples come
+ * from the sampled vCPU itself, counting them per vCPU without locking,
+ * and that none is reported once atexit callbacks run.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t samples;
+    uint64_t last_pc;
+    /* the host thread of the vCPU, set by vcpu_init */
+    GThread *thread;
+} VCPUSamples;
+
+static struct qemu_plugin_scoreboard *vcpus;
+static bool exiting;
+
+static void vcpu_init(qemu_plugin_id_t id, unsigned int vcpu_index)
+{
+    VCPUSamples *vs = qemu_plugin_scoreboard_find(vcpus, vcpu_index);
+
+    vs->thread = g_thread_self();
+}
+
+static void vcpu_sample(unsigned int vcpu_index, uint64_t pc, void *udata)
+{
+    VCPUSamples *vs = qemu_plugin_scoreboard_find(vcpus, vcpu_index);
+
+    g_assert(!__atomic_load_n(&exiting, __ATOMIC_SEQ_CST));
+    g_assert(vcpu_index < qemu_plugin_num_vcpus());
+    g_assert(vs->thread == g_thread_self());
+
+    vs->samples++;
+    vs->last_pc = pc;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) out = g_string_new("");
+    uint64_t total = 0;
+
+    __atomic_store_n(&exiting, true, __ATOMIC_SEQ_CST);
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        VCPUSamples *vs = qemu_plugin_scoreboard_find(vcpus, i);
+        const char *sym;
+
+        total += vs->samples;
+        if (vs->samples) {
+            sym = qemu_plugin_vaddr_symbol(vs->last_pc);
+            g_string_append_printf(out, "vcpu%d: %" PRIu64 " samples, "
+                                   "last at 0x%" PRIx64 " (%s)\n",
+                                   i, vs->samples, vs->last_pc,
+                                   sym ? sym : "?");
+        }
+    }
+    g_string_append_printf(out, "samples: %" PRIu64 "\n", total);
+    qemu_plugin_outs(out->str);
+
+    qemu_plugin_scoreboard_free(vcpus);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    vcpus = qemu_plugin_scoreboard_new(sizeof(VCPUSamples));
+
+    qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+    /* replace a first sampler, which must not report anything */
+    qemu_plugin_register_vcpu_sample_cb(id, 1000, vcpu_sample, NULL);
+    qemu_plugin_register_vcpu_sample_cb(id, 10000, vcpu_sample, NULL);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -1042,6 +1042,81 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+/* Large enough for the last level to be mmapped, where supported */
+#define L_SPARSE                   (UINT64_C(1) << 24)
+
+static void test_hbitmap_sparse(TestHBitmapData *data, const void *unused)
+{
+    hbitmap_test_init(data, L_SPARSE, 0);
+    hbitmap_test_set(data, 0, 1);
+    hbitmap_test_set(data, L_SPARSE / 2 - 7, L2 + 3);
+    hbitmap_test_set(data, L_SPARSE - 1, 1);
+    hbitmap_test_reset(data, L_SPARSE / 2, L1);
+    hbitmap_test_reset_all(data);
+    hbitmap_test_set(data, L_SPARSE / 3, L1);
+    hbitmap_test_check(data, 0);
+}
+
+static void test_hbitmap_sparse_truncate(TestHBitmapData *data,
+                                         const void *unused)
+{
+    hbitmap_test_init(data, L3, 0);
+    hbitmap_test_set(data, L2 - 1, 2);
+    hbitmap_test_set(data, L3 - 1, 1);
+
+    /* Move the last level to mmapped memory, then grow and shrink it */
+    hbitmap_test_truncate_impl(data, L_SPARSE);
+    hbitmap_test_set(data, L_SPARSE - L1, L1);
+    hbitmap_test_check(data, 0);
+    hbitmap_test_truncate_impl(data, L_SPARSE * 2);
+    hbitmap_test_set(data, L_SPARSE * 2 - 1, 1);
+    hbitmap_test_check(data, 0);
+    hbitmap_test_truncate_impl(data, L_SPARSE + 3);
+    hbitmap_test_check(data, 0);
+    hbitmap_test_truncate_impl(data, L_SPARSE * 2);
+    hbitmap_test_check(data, 0);
+
+    /* And back */
+    hbitmap_test_truncate_impl(data, L3);
+    hbitmap_test_check(data, 0);
+}
+
+static void test_hbitmap_merge_sparse(TestHBitmapData *data,
+                                      const void *unused)
+{
+    HBitmap *a = hbitmap_alloc(L_SPARSE, 0);
+    HBitmap *b = hbitmap_alloc(L_SPARSE, 0);
+    HBitmap *r = hbitmap_alloc(L_SPARSE, 0);
+
+    hbitmap_set(a, L1, 3);
+    hbitmap_set(a, L_SPARSE - L2, L2);
+    hbitmap_set(b, L1 + 1, 10);
+    hbitmap_set(b, L_SPARSE / 3, 1);
+    /* Not in a or b, must be cleared by the merge */
+    hbitmap_set(r, L3, 1);
+
+    hbitmap_merge(a, b, r);
+    g_assert_cmpuint(hbitmap_count(r), ==, 11 + L2 + 1);
+    g_assert(!hbitmap_get(r, L1 - 1));
+    g_assert(hbitmap_get(r, L1 + 10));
+    g_assert(!hbitmap_get(r, L1 + 11));
+    g_assert(!hbitmap_get(r, L3));
+    g_assert_cmpint(hbitmap_next_dirty(r, L1 + 11, L_SPARSE), ==,
+                    L_SPARSE / 3);
+    g_assert_cmpint(hbitmap_next_dirty(r, L_SPARSE / 3 + 1, L_SPARSE), ==,
+                    L_SPARSE - L2);
+
+    /* In place */
+    hbitmap_merge(a, b, a);
+    g_assert_cmpuint(hbitmap_count(a), ==, hbitmap_count(r));
+    g_assert_cmpint(hbitmap_next_dirty(a, L1 + 11, L_SPARSE), ==,
+                    L_SPARSE / 3);
+
+    hbitmap_free(a);
+    hbitmap_free(b);
+    hbitmap_free(r);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1113,6 +1188,10 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
 
+    hbitmap_test_add("/hbitmap/sparse/set_reset", test_hbitmap_sparse);
+    hbitmap_test_add("/hbitmap/sparse/truncate", test_hbitmap_sparse_truncate);
+    hbitmap_test_add("/hbitmap/sparse/merge", test_hbitmap_merge_sparse);
+
     g_test_run();
 
     return 0;
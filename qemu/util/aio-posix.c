@@ -808,13 +808,15 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     aio_notify(ctx);
 }
 
-void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
+void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
+                                int64_t sqpoll_idle_ms)
 {
     /*
      * No thread synchronization here, it doesn't matter if an incorrect value
      * is used once.
      */
     ctx->aio_max_batch = max_batch;
+    ctx->io_uring_sqpoll_idle_ms = sqpoll_idle_ms;
 
     aio_notify(ctx);
 }
@@ -469,7 +469,8 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(MIN(ctx->io_uring_sqpoll_idle_ms,
+                                          UINT32_MAX), errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -614,6 +615,7 @@ AioContext *aio_context_new(Error **errp)
     ctx->poll_shrink = 0;
 
     ctx->aio_max_batch = 0;
+    ctx->io_uring_sqpoll_idle_ms = 0;
 
     ctx->thread_pool_min = 0;
     ctx->thread_pool_max = THREAD_POOL_MAX_THREADS_DEFAULT;
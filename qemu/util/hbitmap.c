@@ -12,6 +12,7 @@
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
 #include "qemu/host-utils.h"
+#include "qemu/units.h"
 #include "trace.h"
 #include "crypto/hash.h"
 
@@ -50,8 +51,18 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * Dirty bitmaps for large disks are usually sparse, and the last level can
+ * be hundreds of megabytes large.  On Linux, large levels are therefore
+ * allocated with mmap(), so that pages that never had a bit set are not
+ * backed by memory.  Operations that cover large ranges (reset, merge,
+ * deserialization) only write words that actually change, and use the
+ * upper levels to skip clean regions, in order to keep it that way.
  */
 
+/* Levels of at least this size are allocated with mmap() */
+#define HBITMAP_MMAP_THRESHOLD (1 * MiB)
+
 struct HBitmap {
     /*
      * Size of the bitmap, as requested in hbitmap_alloc or in hbitmap_truncate.
@@ -101,6 +112,117 @@ struct HBitmap {
     uint64_t sizes[HBITMAP_LEVELS];
 };
 
+#ifdef CONFIG_LINUX
+static bool hbitmap_level_is_mmapped(uint64_t size)
+{
+    return size * sizeof(unsigned long) >= HBITMAP_MMAP_THRESHOLD;
+}
+
+static size_t hbitmap_level_mmap_size(uint64_t size)
+{
+    return ROUND_UP(size * sizeof(unsigned long), qemu_real_host_page_size());
+}
+#else
+static bool hbitmap_level_is_mmapped(uint64_t size)
+{
+    return false;
+}
+#endif
+
+/* Allocate a zeroed array of @size longs for one of the levels */
+static unsigned long *hbitmap_level_alloc(uint64_t size)
+{
+#ifdef CONFIG_LINUX
+    if (hbitmap_level_is_mmapped(size)) {
+        void *p = mmap(NULL, hbitmap_level_mmap_size(size),
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("failed to allocate memory for bitmap");
+            abort();
+        }
+        return p;
+    }
+#endif
+    return g_new0(unsigned long, size);
+}
+
+static void hbitmap_level_free(unsigned long *level, uint64_t size)
+{
+#ifdef CONFIG_LINUX
+    if (hbitmap_level_is_mmapped(size)) {
+        munmap(level, hbitmap_level_mmap_size(size));
+        return;
+    }
+#endif
+    g_free(level);
+}
+
+/* Zero a level of @size longs, dropping its pages if it was mmapped */
+static void hbitmap_level_zero(unsigned long *level, uint64_t size)
+{
+#ifdef CONFIG_LINUX
+    if (hbitmap_level_is_mmapped(size)) {
+        size_t len = size * sizeof(unsigned long);
+        size_t aligned_len = QEMU_ALIGN_DOWN(len, qemu_real_host_page_size());
+
+        /* Private anonymous pages read back as zeroes after MADV_DONTNEED */
+        if (madvise(level, aligned_len, MADV_DONTNEED) == 0) {
+            memset((char *)level + aligned_len, 0, len - aligned_len);
+            return;
+        }
+    }
+#endif
+    memset(level, 0, size * sizeof(unsigned long));
+}
+
+/*
+ * Resize a level from @old_size to @size longs.  Added longs are zero.
+ */
+static unsigned long *hbitmap_level_realloc(unsigned long *level,
+                                            uint64_t old_size, uint64_t size)
+{
+    unsigned long *new_level;
+    uint64_t i;
+
+    if (!hbitmap_level_is_mmapped(old_size) &&
+        !hbitmap_level_is_mmapped(size)) {
+        level = g_renew(unsigned long, level, size);
+        if (size > old_size) {
+            memset(&level[old_size], 0, (size - old_size) * sizeof(*level));
+        }
+        return level;
+    }
+
+#ifdef CONFIG_LINUX
+    if (hbitmap_level_is_mmapped(old_size) && hbitmap_level_is_mmapped(size)) {
+        size_t old_len = hbitmap_level_mmap_size(old_size);
+        size_t len = hbitmap_level_mmap_size(size);
+
+        /* Shrinking keeps the tail of the last page, clear it */
+        if (size < old_size) {
+            memset(&level[size], 0, len - size * sizeof(*level));
+        }
+        new_level = mremap(level, old_len, len, MREMAP_MAYMOVE);
+        if (new_level == MAP_FAILED) {
+            perror("failed to resize memory for bitmap");
+            abort();
+        }
+        return new_level;
+    }
+#endif
+
+    /* Crossing the threshold: copy only the nonzero words */
+    new_level = hbitmap_level_alloc(size);
+    for (i = 0; i < MIN(old_size, size); i++) {
+        if (level[i]) {
+            new_level[i] = level[i];
+        }
+    }
+    hbitmap_level_free(level, old_size);
+    return new_level;
+}
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -499,7 +621,11 @@ static inline bool hb_reset_elem(unsigned long *elem, uint64_t start, uint64_t l
 
     mask = 2UL << (last & (BITS_PER_LONG - 1));
     mask -= 1UL << (start & (BITS_PER_LONG - 1));
-    blanked = *elem != 0 && ((*elem & ~mask) == 0);
+    if (!(*elem & mask)) {
+        /* Avoid touching (and thus populating) clean pages */
+        return false;
+    }
+    blanked = (*elem & ~mask) == 0;
     *elem &= ~mask;
     return blanked;
 }
@@ -535,8 +661,10 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] != 0);
-            hb->levels[level][i] = 0UL;
+            if (hb->levels[level][i]) {
+                changed = true;
+                hb->levels[level][i] = 0UL;
+            }
         }
     }
 
@@ -587,9 +715,9 @@ void hbitmap_reset_all(HBitmap *hb)
 {
     unsigned int i;
 
-    /* Same as hbitmap_alloc() except for memset() instead of malloc() */
+    /* Same as hbitmap_alloc() except for clearing instead of allocating */
     for (i = HBITMAP_LEVELS; --i >= 1; ) {
-        memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
+        hbitmap_level_zero(hb->levels[i], hb->sizes[i]);
     }
 
     hb->levels[0][0] = 1UL << (BITS_PER_LONG - 1);
@@ -706,12 +834,19 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        memcpy(cur, buf, sizeof(*cur));
+        unsigned long el;
+
+        memcpy(&el, buf, sizeof(el));
 
         if (BITS_PER_LONG == 32) {
-            le32_to_cpus((uint32_t *)cur);
+            le32_to_cpus((uint32_t *)&el);
         } else {
-            le64_to_cpus((uint64_t *)cur);
+            le64_to_cpus((uint64_t *)&el);
+        }
+
+        /* Do not populate clean pages by writing zeroes to them */
+        if (el || *cur) {
+            *cur = el;
         }
 
         buf += sizeof(unsigned long);
@@ -725,7 +860,7 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
 void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
                                 bool finish)
 {
-    uint64_t el_count;
+    uint64_t el_count, i;
     unsigned long *first;
 
     if (!count) {
@@ -733,7 +868,12 @@ void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0, el_count * sizeof(unsigned long));
+    /* Do not populate clean pages by writing zeroes to them */
+    for (i = 0; i < el_count; i++) {
+        if (first[i]) {
+            first[i] = 0;
+        }
+    }
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -767,7 +907,7 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
     for (lev = HBITMAP_LEVELS - 1; lev-- > 0; ) {
         prev_size = size;
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
-        memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
+        hbitmap_level_zero(bitmap->levels[lev], size);
 
         for (i = 0; i < prev_size; ++i) {
             if (bitmap->levels[lev + 1][i]) {
@@ -786,7 +926,7 @@ void hbitmap_free(HBitmap *hb)
     unsigned i;
     assert(!hb->meta);
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
-        g_free(hb->levels[i]);
+        hbitmap_level_free(hb->levels[i], hb->sizes[i]);
     }
     g_free(hb);
 }
@@ -808,7 +948,7 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         hb->sizes[i] = size;
-        hb->levels[i] = g_new0(unsigned long, size);
+        hb->levels[i] = hbitmap_level_alloc(size);
     }
 
     /* We necessarily have free bits in level 0 due to the definition
@@ -862,11 +1002,7 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
         }
         old = hb->sizes[i];
         hb->sizes[i] = size;
-        hb->levels[i] = g_renew(unsigned long, hb->levels[i], size);
-        if (!shrink) {
-            memset(&hb->levels[i][old], 0x00,
-                   (size - old) * sizeof(*hb->levels[i]));
-        }
+        hb->levels[i] = hbitmap_level_realloc(hb->levels[i], old, size);
     }
     if (hb->meta) {
         hbitmap_truncate(hb->meta, hb->size << hb->granularity);
@@ -892,6 +1028,31 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/**
+ * hbitmap_merge_words: performs dst = dst | src
+ * for bitmaps of the same size and granularity.  Only the words that are
+ * nonzero in src are visited, which the upper levels of src find without
+ * scanning clean regions.
+ */
+static void hbitmap_merge_words(HBitmap *dst, const HBitmap *src)
+{
+    unsigned long *last_lev = dst->levels[HBITMAP_LEVELS - 1];
+    HBitmapIter hbi;
+    unsigned long cur;
+    size_t pos;
+
+    hbitmap_iter_init(&hbi, src, 0);
+    while ((pos = hbitmap_iter_next_word(&hbi, &cur)) != (size_t)-1) {
+        if ((last_lev[pos] | cur) == last_lev[pos]) {
+            continue;
+        }
+        if (!last_lev[pos]) {
+            hb_set_between(dst, HBITMAP_LEVELS - 2, pos, pos);
+        }
+        last_lev[pos] |= cur;
+    }
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -900,9 +1061,6 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
  */
 void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 {
-    int i;
-    uint64_t j;
-
     assert(a->orig_size == result->orig_size);
     assert(b->orig_size == result->orig_size);
 
@@ -929,15 +1087,19 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return;
     }
 
-    /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
-     * It may be possible to improve running times for sparsely populated maps
-     * by using hbitmap_iter_next, but this is suboptimal for dense maps.
+    /*
+     * This merge is O(number of nonzero words in A and B), plus the cost of
+     * skipping clean regions through the upper levels.
      */
     assert(a->size == b->size);
-    for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
-        for (j = 0; j < a->sizes[i]; j++) {
-            result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
-        }
+    if (a != result && b != result) {
+        hbitmap_reset_all(result);
+    }
+    if (a != result) {
+        hbitmap_merge_words(result, a);
+    }
+    if (b != result) {
+        hbitmap_merge_words(result, b);
     }
 
     /* Recompute the dirty count */
@@ -8,7 +8,9 @@
  * later.  See the COPYING file in the top-level directory.
  */
 #include "qemu/osdep.h"
+#include <sys/eventfd.h>
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
 #include "qemu/main-loop.h"
 #include "qemu/vhost-user-server.h"
 #include "block/aio-wait.h"
@@ -44,6 +46,13 @@
  * dev->broken flag. Both vu_client_trip() and kick fd processing stop when
  * the dev->broken flag is set.
  *
+ * Virtqueues can also be given AioContexts of their own, so that requests are
+ * processed in several threads. Their kick fds are then monitored in these
+ * AioContexts, and VuServer->queues[i].lock serializes the processing of
+ * virtqueue i against vhost-user message handling in VuServer->ctx, which
+ * holds the locks of all virtqueues from the time a message has been received
+ * until vu_dispatch() returns.
+ *
  * It is possible to switch AioContexts using
  * vhost_user_server_detach_aio_context() and
  * vhost_user_server_attach_aio_context(). They stop monitoring fds in the old
@@ -107,6 +116,38 @@ bool vhost_user_server_has_in_flight(VuServer *server)
     return qatomic_load_acquire(&server->in_flight) > 0;
 }
 
+/*
+ * Must be held around libvhost-user calls for @vq outside of the queue
+ * handler, e.g. to complete requests.
+ */
+void vhost_user_server_lock_queue(VuServer *server, VuVirtq *vq)
+{
+    if (server->queues) {
+        qemu_rec_mutex_lock(&server->queues[vq - server->vu_dev.vq].lock);
+    }
+}
+
+void vhost_user_server_unlock_queue(VuServer *server, VuVirtq *vq)
+{
+    if (server->queues) {
+        qemu_rec_mutex_unlock(&server->queues[vq - server->vu_dev.vq].lock);
+    }
+}
+
+static void vu_lock_queues(VuServer *server)
+{
+    for (int i = 0; i < server->max_queues; i++) {
+        qemu_rec_mutex_lock(&server->queues[i].lock);
+    }
+}
+
+static void vu_unlock_queues(VuServer *server)
+{
+    for (int i = server->max_queues - 1; i >= 0; i--) {
+        qemu_rec_mutex_unlock(&server->queues[i].lock);
+    }
+}
+
 static bool coroutine_fn
 vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
 {
@@ -199,6 +240,11 @@ vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
         }
     }
 
+    /* Released in vu_client_trip() once the message has been handled */
+    if (server->queues && !server->queues_locked) {
+        vu_lock_queues(server);
+        server->queues_locked = true;
+    }
     return true;
 
 fail:
@@ -211,6 +257,7 @@ static coroutine_fn void vu_client_trip(void *opaque)
 {
     VuServer *server = opaque;
     VuDev *vu_dev = &server->vu_dev;
+    bool ok;
 
     while (!vu_dev->broken) {
         if (server->quiescing) {
@@ -219,7 +266,12 @@ static coroutine_fn void vu_client_trip(void *opaque)
             return;
         }
         /* vu_dispatch() returns false if server->ctx went away */
-        if (!vu_dispatch(vu_dev) && server->ctx) {
+        ok = vu_dispatch(vu_dev);
+        if (server->queues_locked) {
+            server->queues_locked = false;
+            vu_unlock_queues(server);
+        }
+        if (!ok && server->ctx) {
             break;
         }
     }
@@ -232,7 +284,13 @@ static coroutine_fn void vu_client_trip(void *opaque)
     }
     assert(!vhost_user_server_has_in_flight(server));
 
+    if (server->queues) {
+        vu_lock_queues(server);
+    }
     vu_deinit(vu_dev);
+    if (server->queues) {
+        vu_unlock_queues(server);
+    }
 
     /* vu_deinit() should have called remove_watch() */
     assert(QTAILQ_EMPTY(&server->vu_fd_watches));
@@ -272,6 +330,48 @@ static void kick_handler(void *opaque)
     }
 }
 
+/* Kick handler for virtqueues in their own AioContext */
+static void queue_kick_handler(void *opaque)
+{
+    VuQueue *q = opaque;
+    VuDev *vu_dev = q->vu_dev;
+    int idx = q - container_of(vu_dev, VuServer, vu_dev)->queues;
+    eventfd_t kick_data;
+
+    qemu_rec_mutex_lock(&q->lock);
+    /*
+     * The handler may have been removed, or the kick fd replaced, while we
+     * were waiting for the lock.  Read the eventfd here rather than in
+     * vu_kick_cb(), which considers a spurious wakeup an error.
+     */
+    if (q->enabled && eventfd_read(q->kick_fd, &kick_data) == 0) {
+        VuVirtq *vq = vu_get_queue(vu_dev, idx);
+
+        if (vq->handler) {
+            vq->handler(vu_dev, idx);
+        }
+    }
+    qemu_rec_mutex_unlock(&q->lock);
+
+    if (vu_dev->broken) {
+        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+
+        qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    }
+}
+
+/* Called with q->lock held */
+static void vu_queue_set_enabled(VuQueue *q, bool enabled)
+{
+    if (q->kick_fd < 0 || q->enabled == enabled) {
+        return;
+    }
+    aio_set_fd_handler(q->ctx, q->kick_fd,
+                       enabled ? queue_kick_handler : NULL,
+                       NULL, NULL, NULL, q);
+    q->enabled = enabled;
+}
+
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
 {
 
@@ -294,6 +394,19 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
     g_assert(fd >= 0);
     g_assert(cb);
 
+    if (server->queues) {
+        /* libvhost-user only watches kick fds, @pvt is the queue index */
+        VuQueue *q = &server->queues[(intptr_t)pvt];
+
+        if (q->kick_fd != fd) {
+            vu_queue_set_enabled(q, false);
+            q->kick_fd = fd;
+            qemu_socket_set_nonblock(fd);
+        }
+        vu_queue_set_enabled(q, true);
+        return;
+    }
+
     VuFdWatch *vu_fd_watch = find_vu_fd_watch(server, fd);
 
     if (!vu_fd_watch) {
@@ -320,6 +433,18 @@ static void remove_watch(VuDev *vu_dev, int fd)
 
     server = container_of(vu_dev, VuServer, vu_dev);
 
+    if (server->queues) {
+        for (int i = 0; i < server->max_queues; i++) {
+            VuQueue *q = &server->queues[i];
+
+            if (q->kick_fd == fd) {
+                vu_queue_set_enabled(q, false);
+                q->kick_fd = -1;
+            }
+        }
+        return;
+    }
+
     VuFdWatch *vu_fd_watch = find_vu_fd_watch(server, fd);
 
     if (!vu_fd_watch) {
@@ -375,6 +500,24 @@ static void vu_accept(QIONetListener *listener, QIOChannelSocket *sioc,
     vhost_user_server_attach_aio_context(server, server->ctx);
 }
 
+static void vu_set_queues_enabled(VuServer *server, bool enabled)
+{
+    if (!server->queues) {
+        return;
+    }
+    for (int i = 0; i < server->max_queues; i++) {
+        VuQueue *q = &server->queues[i];
+
+        WITH_QEMU_LOCK_GUARD(&q->lock) {
+            vu_queue_set_enabled(q, enabled);
+        }
+    }
+}
+
+static void vu_queue_sync_bh(void *opaque)
+{
+}
+
 /* server->ctx acquired by caller */
 void vhost_user_server_stop(VuServer *server)
 {
@@ -388,12 +531,23 @@ void vhost_user_server_stop(VuServer *server)
             aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
                                NULL, NULL, NULL, NULL, vu_fd_watch);
         }
+        vu_set_queues_enabled(server, false);
 
         qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
 
         AIO_WAIT_WHILE(server->ctx, server->co_trip);
     }
 
+    if (server->queues) {
+        for (int i = 0; i < server->max_queues; i++) {
+            /* A kick handler may still be running in another thread */
+            aio_wait_bh_oneshot(server->queues[i].ctx, vu_queue_sync_bh, NULL);
+            qemu_rec_mutex_destroy(&server->queues[i].lock);
+        }
+        g_free(server->queues);
+        server->queues = NULL;
+    }
+
     if (server->listener) {
         qio_net_listener_disconnect(server->listener);
         object_unref(OBJECT(server->listener));
@@ -427,6 +581,7 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
         aio_set_fd_handler(ctx, vu_fd_watch->fd, kick_handler, NULL,
                            NULL, NULL, vu_fd_watch);
     }
+    vu_set_queues_enabled(server, true);
 
     if (server->co_trip) {
         /*
@@ -459,6 +614,7 @@ void vhost_user_server_detach_aio_context(VuServer *server)
             aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
                                NULL, NULL, NULL, NULL, vu_fd_watch);
         }
+        vu_set_queues_enabled(server, false);
     }
 
     server->ctx = NULL;
@@ -475,6 +631,7 @@ bool vhost_user_server_start(VuServer *server,
                              SocketAddress *socket_addr,
                              AioContext *ctx,
                              uint16_t max_queues,
+                             AioContext *const *queue_ctx,
                              const VuDevIface *vu_iface,
                              Error **errp)
 {
@@ -513,5 +670,17 @@ bool vhost_user_server_start(VuServer *server,
                                      NULL);
 
     QTAILQ_INIT(&server->vu_fd_watches);
+
+    if (queue_ctx) {
+        server->queues = g_new0(VuQueue, max_queues);
+        for (int i = 0; i < max_queues; i++) {
+            VuQueue *q = &server->queues[i];
+
+            q->vu_dev = &server->vu_dev;
+            q->ctx = queue_ctx[i];
+            q->kick_fd = -1;
+            qemu_rec_mutex_init(&q->lock);
+        }
+    }
     return true;
 }